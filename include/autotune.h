@@ -0,0 +1,76 @@
+#pragma once
+
+#include <stdint.h>
+
+// Search for the fastest velocity and acceleration an axis can hold with the
+// mounted payload. The caller runs each trial move and feeds in the driver's
+// StallGuard load readings; a reading well below the baseline taken at a
+// gentle speed counts as the onset of a stall. Values grow geometrically until
+// the first failure and are then refined by bisection. Units are whatever the
+// caller uses consistently (the firmware uses degrees and seconds).
+//
+// Acceleration is found first, each trial ramping for rampTime. The velocity
+// trials then ramp at the tuned acceleration, which is what lets them reach
+// high speeds within a trial move of the given travel.
+struct TuneConfig {
+    float startVelocity;
+    float maxVelocity;
+    float startAcceleration;
+    float maxAcceleration;
+    float growth;         // Step factor while no trial has failed yet
+    int refineSteps;      // Bisection steps after the first failure
+    float stallFraction;  // Load below this fraction of the baseline is a stall
+    float margin;         // Safety factor applied to the highest passing values
+    float travel;         // Length of a trial move, bounds the speed it reaches
+    float rampTime;       // Acceleration trials ramp up for this long
+};
+
+enum TunePhase {
+    TUNE_BASELINE,
+    TUNE_ACCELERATION,
+    TUNE_VELOCITY,
+    TUNE_DONE,
+    TUNE_FAILED
+};
+
+class AutoTuner {
+public:
+    explicit AutoTuner(const TuneConfig& config);
+
+    void start();
+    TunePhase phase() const { return _phase; }
+    bool running() const { return _phase < TUNE_DONE; }
+
+    // Parameters for the trial move the caller should run next
+    float trialVelocity() const { return _trialVelocity; }
+    float trialAcceleration() const { return _trialAcceleration; }
+
+    // Feed a load reading taken while the trial is at its tested speed or acceleration
+    void addSample(uint16_t load);
+
+    // Judge the trial from the collected samples and pick the next one
+    void finishTrial();
+
+    // Tuned limits, with the safety margin applied
+    float velocity() const { return _velocityPass * _config.margin; }
+    float acceleration() const { return _accelerationPass * _config.margin; }
+    float baseline() const { return _baseline; }
+
+private:
+    void nextTrial();
+    float reachableVelocity(float acceleration) const;
+
+    TuneConfig _config;
+    TunePhase _phase;
+    float _trialVelocity;
+    float _trialAcceleration;
+    float _baseline;
+    float _velocityPass;
+    float _accelerationPass;
+    float _fail;       // First failing value in the current phase, 0 if none yet
+    int _refinements;
+
+    uint32_t _samples;
+    uint32_t _loadSum;
+    uint16_t _minLoad;
+};
@@ -0,0 +1,22 @@
+#pragma once
+
+// Microbenchmarks for the code that runs per command and per motion tick:
+// command parsing, degree/step conversion, status formatting, the motion
+// pipeline and the handoffs between the BLE callbacks and the motion loop,
+// plus the per-frame vision kernels in both their scalar and fast variants.
+// The same suite builds for the host (env:native runs it from main()) and
+// for the device (env:seeed_xiao_esp32s3_bench runs it from setup() before
+// BLE starts). Each case prints one line,
+//
+//   bench,<name>,<ns/op>,<cycles/op>,<spread %>
+//
+// between "bench,begin,<target>,<MHz>" and "bench,end". Each case runs a
+// fixed number of iterations per run, set in bench.cpp, so results compare
+// across builds. The figure is the median of the timed runs, the spread
+// their interquartile range; cycle counts are 0 on the host. mac/bench.py
+// collects the lines and compares them against a saved baseline.
+
+#define BENCH_RUNS 15  // Timed runs per case
+#define BENCH_WARMUP_RUNS 3  // Untimed runs before them
+
+void benchRun();
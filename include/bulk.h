@@ -0,0 +1,91 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+class BLECharacteristic;
+
+// Bulk transfer service for large uploads such as firmware images.
+//
+// The host starts a transfer with "start,<kind>,<size>,<crc32 hex>" on the
+// control characteristic and gets "ready,<chunk>,<window>,<offset>" back. It
+// then streams chunks as write-without-response on the data characteristic,
+// each a 32-bit byte offset, a CRC-16/CCITT of the payload and up to <chunk>
+// payload bytes, starting at <offset> and keeping at most <window> chunks
+// beyond the last acknowledged offset in flight. The device notifies
+// "ack,<offset>" every few chunks and "nak,<offset>" once per gap or bad CRC,
+// after which the host resends from <offset>. The transfer ends with "done"
+// once the whole-image CRC-32 matches, or "error,<reason>".
+//
+// Sending the same start command again resumes an interrupted transfer from
+// the last good offset, e.g. after a reconnect. Chunks are queued to a
+// task, so slow sinks like flash never block the BLE stack.
+
+#define BULK_CHUNK_HEADER 6  // u32 offset, u16 CRC-16
+#define BULK_MAX_CHUNK 512  // Largest payload per chunk
+#define BULK_WINDOW 16  // Chunks in flight before the host waits for an ack
+#define BULK_ACK_INTERVAL 8  // Chunks between acks
+
+enum BulkKind : uint8_t {
+    BULK_OTA  // Firmware image for the inactive app partition
+};
+
+// Destination of a transfer. Calls come from the bulk task.
+class BulkSink {
+public:
+    virtual ~BulkSink() {}
+    virtual bool begin(uint32_t size) = 0;
+    virtual bool write(const uint8_t* data, size_t length) = 0;
+    virtual bool finish() = 0;  // Whole image received and CRC checked
+    virtual void abort() = 0;
+    virtual void completed() {}  // After "done" has been sent
+};
+
+// Transfer state machine, free of BLE and FreeRTOS so it can be driven
+// directly from a host harness. It and the CRCs are in bulkreceiver.cpp;
+// bulk.cpp has the task and BLE side.
+class BulkReceiver {
+public:
+    enum Result { BULK_NONE, BULK_ACK, BULK_NAK, BULK_DONE, BULK_FAILED };
+
+    BulkReceiver();
+
+    // Begin a transfer, or resume the one in progress when the kind, size and
+    // CRC match. Returns false if the sink refuses it.
+    bool start(BulkSink* sink, uint8_t kind, uint32_t size, uint32_t crc);
+
+    // Handle one data packet; the result says what to tell the host
+    Result receive(const uint8_t* packet, size_t length);
+
+    void abort();
+
+    bool active() const { return _sink != NULL; }
+    uint8_t kind() const { return _kind; }
+    uint32_t received() const { return _received; }
+    uint32_t size() const { return _size; }
+
+private:
+    BulkSink* _sink;
+    uint8_t _kind;
+    uint32_t _size;
+    uint32_t _expectedCrc;
+    uint32_t _crc;  // Running CRC-32 of the bytes accepted so far
+    uint32_t _received;
+    uint16_t _sinceAck;
+    bool _nakSent;  // One nak per gap; later out-of-order chunks are dropped quietly
+};
+
+uint16_t bulkCrc16(const uint8_t* data, size_t length);
+uint32_t bulkCrc32(uint32_t crc, const uint8_t* data, size_t length);  // zlib compatible
+
+// Start the bulk task. Notifications go out on the control characteristic,
+// to the connection that sent the last control command only.
+void bulkInit(BLECharacteristic* control);
+void bulkRegisterSink(uint8_t kind, BulkSink* sink);
+
+// Queue a control command or data packet from a BLE write callback
+void bulkControl(const char* command, uint16_t connId);
+void bulkData(const uint8_t* data, size_t length);
+
+// Text summary for the control characteristic
+int bulkFormatStatus(char* buffer, size_t size);
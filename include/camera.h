@@ -0,0 +1,22 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "vision.h"
+
+// On-board camera of the XIAO ESP32-S3 Sense, built with -DVISION_ENABLED
+// (the seeed_xiao_esp32s3_sense environment). A task on core 0 captures QVGA
+// YUYV frames, runs the vision kernels and hands every result to the
+// callback, so step generation on core 1 is never held up by a frame.
+
+typedef void (*CameraTargetCallback)(const VisionTarget& target, uint32_t captureTime);
+
+// Configure the sensor; false when there is no camera
+bool cameraInit();
+void cameraStart(CameraTargetCallback callback);
+
+// Time the scalar and fast kernels on the next frame and check they agree
+void cameraRequestBench();
+
+// Text summary for the vision characteristic
+int cameraFormatStats(char* buffer, size_t size);
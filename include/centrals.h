@@ -0,0 +1,108 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <BLEDevice.h>
+
+// Several centrals can be connected at once, e.g. the phone as operator and
+// the Mac tracker. Each connection keeps its own state: the priority it
+// claimed, its MTU, the telemetry it subscribed to and how often it wants it.
+//
+// Motion commands and settings writes are arbitrated, so one client cannot
+// retune the head under another's move. The client whose command was last
+// accepted owns control until it has been quiet for CONTROL_LEASE; until then
+// only a client of higher priority may take over, so the operator pre-empts
+// the tracker at once and control falls back to the tracker when the
+// operator lets go. Telemetry goes to each subscriber separately, skipping links that
+// are congested or whose own rate limit is not due, so one slow client
+// never holds up the rest.
+//
+// A client that drops and comes back from the same address within
+// RECONNECT_MEMORY gets its slot back with the priority and rate limits it
+// had, so a link hiccup needs no renegotiation; only the subscriptions start
+// afresh, as the client writes them again on every connection.
+
+#define MAX_CENTRALS 3  // Concurrent connections, the controller's default limit
+#define CONTROL_LEASE 3000  // Milliseconds without commands before control is handed back
+#define CONTROL_NONE 0xFFFF  // Connection id when nobody owns control
+#define RECONNECT_MEMORY 60000  // Milliseconds a dropped client's settings are kept for it
+#define RECONNECT_NONE 0xFFFFFFFF  // From centralsConnected for a client not seen recently
+
+enum ControlPriority : uint8_t {
+    PRIORITY_DEFAULT,   // Has not claimed a role
+    PRIORITY_TRACKER,   // Automatic tracking
+    PRIORITY_OPERATOR   // A person at the controls
+};
+
+enum TelemetryChannel : uint8_t {
+    CHANNEL_STATUS,
+    CHANNEL_POSE,
+    CHANNEL_DIAG,
+    CHANNEL_COUNT
+};
+
+// Install the GATT event hook that tracks MTU, subscriptions and congestion
+void centralsInit();
+
+// A notifying characteristic with a BLE2902 descriptor to fan out per connection
+void centralsRegister(TelemetryChannel channel, BLECharacteristic* characteristic);
+
+// From the server callbacks. centralsConnected returns how long the client
+// was away in milliseconds, or RECONNECT_NONE; centralsDisconnected returns
+// true if the connection owned control.
+uint32_t centralsConnected(uint16_t connId, const uint8_t* address);
+bool centralsDisconnected(uint16_t connId);
+uint8_t centralsCount();
+
+// Arbitrate a motion command; false if another client holds control
+bool controlAcquire(uint16_t connId);
+uint16_t controlOwner();
+
+void centralsSetPriority(uint16_t connId, ControlPriority priority);
+void centralsRelease(uint16_t connId);
+
+// Minimum interval between notifications on a channel for one connection
+void centralsSetRate(uint16_t connId, TelemetryChannel channel, uint16_t interval);
+uint16_t centralsMtu(uint16_t connId);
+
+// Notify every subscriber that is due. The characteristic's own value is left
+// alone so this does not allocate; TelemetryCallbacks serves it to reads.
+void centralsNotify(TelemetryChannel channel, const char* value);
+
+// Notify one connection only, cut to its MTU; for replies and downloads meant
+// for the client that asked. With wait, returns once the stack has sent it,
+// which paces a stream of them; the BLE task itself must not wait, as it
+// delivers the confirmation. False if the connection is gone or the send
+// failed or timed out.
+bool centralsSend(uint16_t connId, BLECharacteristic* characteristic, const uint8_t* data, size_t length,
+                  bool wait = true);
+
+// "owner,reconnects,last,max;id,priority,mtu,subscriptions,sent,skipped,denied;..."
+// with the reconnect times in milliseconds and subscriptions a bit mask of
+// TelemetryChannel
+int centralsFormat(char* buffer, size_t size);
+
+// Base for characteristic callbacks that need to know which connection wrote
+class CommandCallbacks: public BLECharacteristicCallbacks {
+public:
+    using BLECharacteristicCallbacks::onWrite;
+
+    void onWrite(BLECharacteristic* pCharacteristic, esp_ble_gatts_cb_param_t* param) override {
+        _connId = param->write.conn_id;
+        onWrite(pCharacteristic);
+    }
+
+protected:
+    uint16_t _connId = CONTROL_NONE;
+};
+
+// Read callback for a telemetry characteristic: the value last notified on it
+class TelemetryCallbacks: public BLECharacteristicCallbacks {
+public:
+    explicit TelemetryCallbacks(TelemetryChannel channel) : _channel(channel) {}
+
+    void onRead(BLECharacteristic* pCharacteristic) override;
+
+private:
+    TelemetryChannel _channel;
+};
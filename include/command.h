@@ -0,0 +1,22 @@
+#pragma once
+
+#include <stddef.h>
+
+// Parsers and formatters for the text characteristics. They do not touch
+// Arduino or BLE so the benchmark suite (include/bench.h) runs the same code
+// on the host as on the device.
+
+// "pan,tilt" in degrees
+bool parsePosition(const char* text, float& pan, float& tilt);
+
+// "pan,tilt[,timeout]" in degrees per second and milliseconds. Returns the
+// number of fields read, 0 if the command is invalid; timeout is only set
+// when there are three.
+int parseJog(const char* text, float& pan, float& tilt, long& timeout);
+
+// "panVel,panAccel,panJerk,tiltVel,tiltAccel,tiltJerk". Velocities and
+// accelerations must be positive, a jerk of 0 means unlimited. All must be finite.
+bool parseLimits(const char* text, float fields[6]);
+
+// The periodic status notification, positions in whole degrees
+int formatStatus(char* buffer, size_t size, long position1, long position2);
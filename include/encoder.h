@@ -0,0 +1,39 @@
+#pragma once
+
+#include <Wire.h>
+
+// AS5600 absolute magnetic encoder on an output shaft. The chip has a fixed
+// I2C address, so each encoder needs its own bus. read() does one blocking
+// register read (about 100 us at 400 kHz), so call it from a task rather than
+// the step loop. Readings are unwrapped into a multi-turn count, which
+// needs at least two reads per half turn.
+
+#define AS5600_ADDRESS 0x36
+#define AS5600_COUNTS 4096  // Counts per shaft revolution
+
+class ShaftEncoder {
+public:
+    explicit ShaftEncoder(TwoWire& wire);
+
+    // Start the bus and check for a magnet at a usable distance. Returns
+    // false (and present() stays false) when there is no usable encoder.
+    bool begin(int sda, int scl, uint32_t frequency);
+
+    // Read the raw angle and update the multi-turn count; false on a bus error
+    bool read();
+
+    bool present() const { return _present; }
+    uint16_t raw() const { return _raw; }  // Last 12-bit angle
+    long counts() const { return _turns * AS5600_COUNTS + _raw; }
+    uint32_t errors() const { return _errors; }
+
+private:
+    bool readRegister(uint8_t reg, uint8_t* data, size_t length);
+
+    TwoWire& _wire;
+    bool _present;
+    bool _valid;  // _raw holds a reading to unwrap against
+    uint16_t _raw;
+    long _turns;
+    uint32_t _errors;
+};
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include "log_messages.h"
+
+// Asynchronous binary logger. Records are pushed into a lock-free ring buffer
+// from any task and drained to USB serial by a low-priority task, so logging
+// from the BLE callbacks never blocks on the UART. When the buffer is full the
+// record is dropped and counted instead.
+
+enum LogMessage : uint16_t {
+#define LOG_MESSAGE_ID(id, text) id,
+    LOG_MESSAGES(LOG_MESSAGE_ID)
+#undef LOG_MESSAGE_ID
+    MSG_COUNT
+};
+
+enum LogLevel : uint8_t {
+    LOG_LEVEL_DEBUG,
+    LOG_LEVEL_INFO,
+    LOG_LEVEL_WARN,
+    LOG_LEVEL_ERROR
+};
+
+enum LogCategory : uint8_t {
+    LOG_CAT_SYSTEM,
+    LOG_CAT_BLE,
+    LOG_CAT_MOTION,
+    LOG_CAT_MEMORY,
+    LOG_CAT_COUNT
+};
+
+// Compile-time filters; call sites below these are removed entirely
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL LOG_LEVEL_DEBUG
+#endif
+#ifndef LOG_COMPILE_CATEGORIES
+#define LOG_COMPILE_CATEGORIES 0xFFFFFFFFu
+#endif
+
+#define LOG_MAX_ARGS 6
+#define LOG_BUFFER_SLOTS 256  // Must be a power of two
+#define LOG_FRAME_SYNC_1 0xA5
+#define LOG_FRAME_SYNC_2 0x5A
+
+struct LogEntry {
+    uint32_t timestamp;  // micros()
+    uint16_t id;
+    uint8_t level;
+    uint8_t category;
+    uint8_t argc;
+    uint32_t args[LOG_MAX_ARGS];
+};
+
+// Runtime filters
+extern volatile uint8_t logLevel;
+extern volatile uint32_t logCategoryMask;
+
+// Start the drain task. Call before anything logs.
+void logInit();
+void logWrite(uint8_t level, uint8_t category, uint16_t id, const uint32_t* args, uint8_t argc);
+uint32_t logDropped();
+
+inline uint32_t logWord(float value) {
+    uint32_t word;
+    memcpy(&word, &value, sizeof(word));
+    return word;
+}
+
+inline uint32_t logWord(double value) {
+    return logWord((float)value);
+}
+
+template<typename T>
+inline uint32_t logWord(T value) {
+    return (uint32_t)value;
+}
+
+template<typename... Args>
+inline void logRecord(uint8_t level, uint8_t category, uint16_t id, Args... args) {
+    static_assert(sizeof...(Args) <= LOG_MAX_ARGS, "Too many log arguments");
+    const uint32_t words[] = { 0, logWord(args)... };
+    logWrite(level, category, id, words + 1, sizeof...(Args));
+}
+
+#define LOG_COMPILED(level, category) \
+    ((level) >= LOG_COMPILE_LEVEL && ((LOG_COMPILE_CATEGORIES >> (category)) & 1u))
+
+#define LOG(level, category, id, ...) \
+    do { \
+        if (LOG_COMPILED(level, category)) { \
+            logRecord(level, category, id, ##__VA_ARGS__); \
+        } \
+    } while (0)
+
+#define LOG_DEBUG(category, id, ...) LOG(LOG_LEVEL_DEBUG, category, id, ##__VA_ARGS__)
+#define LOG_INFO(category, id, ...) LOG(LOG_LEVEL_INFO, category, id, ##__VA_ARGS__)
+#define LOG_WARN(category, id, ...) LOG(LOG_LEVEL_WARN, category, id, ##__VA_ARGS__)
+#define LOG_ERROR(category, id, ...) LOG(LOG_LEVEL_ERROR, category, id, ##__VA_ARGS__)
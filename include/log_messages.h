@@ -0,0 +1,62 @@
+#pragma once
+
+// Log message table shared with the host decoder (mac/log_decode.py), which
+// parses the X(...) entries in order. Record ids are the entry index, so only
+// ever append new messages at the end. Arguments are sent as 32-bit words and
+// decoded according to the conversions in the format string.
+#define LOG_MESSAGES(X) \
+    X(MSG_BOOT, "Camera Robot Starting...") \
+    X(MSG_SETUP_DONE, "Setup complete!") \
+    X(MSG_CONNECTED, "Device connected, id: %u clients: %u") \
+    X(MSG_DISCONNECTED, "Device disconnected, id: %u clients: %u") \
+    X(MSG_POSITION_CMD, "Position command pan: %f tilt: %f steps1: %d steps2: %d") \
+    X(MSG_POSITION_INVALID, "Invalid position format") \
+    X(MSG_JOG_INVALID, "Invalid jog format") \
+    X(MSG_ZERO, "Zero position set") \
+    X(MSG_MEM_HEAP, "Heap free: %u max block: %u min free: %u") \
+    X(MSG_MEM_STACK, "Stack free loop: %u btc: %u btu: %u log: %u") \
+    X(MSG_MEM_ALLOC, "Allocations ble: %u telemetry: %u") \
+    X(MSG_LOG_DROPPED, "Log buffer full, dropped %u records") \
+    X(MSG_LOG_CONFIG, "Log level: %u categories: %x") \
+    X(MSG_RECORDER_NO_PSRAM, "Flight recorder disabled, no PSRAM") \
+    X(MSG_RECORDER_TRIGGER, "Flight recorder triggered, reason: %u") \
+    X(MSG_RECORDER_FROZEN, "Flight recorder frozen, reason: %u") \
+    X(MSG_RECORDER_DOWNLOAD, "Flight recorder download records: %u per chunk: %u from chunk: %u") \
+    X(MSG_DRIVER_FAULT, "Driver %u fault, DRV_STATUS: %x") \
+    X(MSG_LIMITS, "Limits pan: %f %f %f tilt: %f %f %f") \
+    X(MSG_LIMITS_INVALID, "Invalid limits format") \
+    X(MSG_TUNE_START, "Auto-tune started on axis %u") \
+    X(MSG_TUNE_DONE, "Auto-tune axis %u done, velocity: %f acceleration: %f") \
+    X(MSG_TUNE_FAILED, "Auto-tune axis %u failed, no usable StallGuard readings") \
+    X(MSG_SHAPER, "Input shaper axis %u type: %u frequency: %f damping: %f") \
+    X(MSG_SHAPER_INVALID, "Invalid input shaper settings") \
+    X(MSG_CALIBRATION_START, "Resonance calibration started on axis %u") \
+    X(MSG_ENCODER_MISSING, "No encoder on axis %u, running open-loop") \
+    X(MSG_ENCODER_UNSTABLE, "Encoder on axis %u unreliable (%u), running open-loop") \
+    X(MSG_ENCODER_HOMED, "Axis %u homed from encoder at %f degrees") \
+    X(MSG_STEP_LOSS, "Axis %u lost %d steps, corrected from encoder (%u total)") \
+    X(MSG_BULK_START, "Bulk transfer kind: %u size: %u from: %u chunk: %u") \
+    X(MSG_BULK_DONE, "Bulk transfer kind: %u complete, %u bytes") \
+    X(MSG_BULK_FAILED, "Bulk transfer kind: %u failed after %u bytes") \
+    X(MSG_OTA_RESTART, "Firmware update installed, restarting") \
+    X(MSG_OTA_CONFIRMED, "New firmware confirmed, rollback cancelled") \
+    X(MSG_CAMERA_FAILED, "Camera unavailable, error: %x") \
+    X(MSG_VISION_BENCH, "Vision bench scalar: %u us fast: %u us match: %u") \
+    X(MSG_SERVO_CONFIG, "Servo kp: %f near: %f ki: %f kd: %f fov: %f x %f") \
+    X(MSG_SERVO_INVALID, "Invalid servo command") \
+    X(MSG_POWER_CONFIG, "Idle mode: %u after: %u ms hold: %u%% light sleep: %u") \
+    X(MSG_POWER_INVALID, "Invalid power command") \
+    X(MSG_POWER_UNSUPPORTED, "Power management configuration refused, light sleep: %u") \
+    X(MSG_POWER_STATS, "Power idle: %u%% tilt: %u mA pan: %u mA wakes: %u last: %u us max: %u us") \
+    X(MSG_IDLE_ENTER, "Idle, mode: %u") \
+    X(MSG_IDLE_EXIT, "Active") \
+    X(MSG_CONTROL_DENIED, "Command from %u refused, control held by %u") \
+    X(MSG_CONTROL_CLAIM, "Client %u priority: %u") \
+    X(MSG_CONTROL_INVALID, "Invalid control command") \
+    X(MSG_SCAN_START, "Scan %u x %u tiles, rows first: %u, travel: %f s") \
+    X(MSG_SCAN_DONE, "Scan done, %u tiles in %u ms, unsettled: %u") \
+    X(MSG_SCAN_CANCELLED, "Scan cancelled at tile %u of %u") \
+    X(MSG_SCAN_INVALID, "Invalid scan command") \
+    X(MSG_RECONNECTED, "Client %u back after %u ms") \
+    X(MSG_OTA_BUSY, "Firmware update refused while the head is moving") \
+    X(MSG_DRIVER_STALL, "Driver %u stall, SG_RESULT: %u")
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Code paths whose heap allocations are counted separately
+enum AllocSite {
+    ALLOC_BLE_CALLBACK,
+    ALLOC_TELEMETRY,
+    ALLOC_SITE_COUNT
+};
+
+// Tasks whose stack high-water marks are reported
+enum StackTask {
+    STACK_LOOP,     // Arduino loop()
+    STACK_BTC,      // Bluedroid callback task, runs the characteristic callbacks
+    STACK_BTU,      // Bluedroid stack task
+    STACK_LOG,      // Log drain task
+    STACK_TASK_COUNT
+};
+
+struct MemStats {
+    uint32_t freeHeap;          // Bytes currently free
+    uint32_t largestFreeBlock;  // Largest single allocation that would succeed
+    uint32_t minFreeHeap;       // Lowest free heap since boot
+    uint32_t stackFree[STACK_TASK_COUNT];  // Unused stack bytes at the worst point, 0 if unknown
+    uint32_t allocCount[ALLOC_SITE_COUNT];
+};
+
+// Counts every malloc/calloc/realloc made by the current task while in scope.
+// Counting relies on the --wrap linker flags in platformio.ini.
+class AllocScope {
+public:
+    explicit AllocScope(AllocSite site);
+    ~AllocScope();
+
+private:
+    AllocSite _site;
+};
+
+void memstatsInit();
+void memstatsSample(MemStats& stats);
+
+// Write a one-line text record, returns the length like snprintf
+int memstatsFormat(char* buffer, size_t size, const MemStats& stats);
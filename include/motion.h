@@ -0,0 +1,64 @@
+#pragma once
+
+// Kinematic limits for one axis in steps per second, per second squared and
+// per second cubed. A jerk of 0 means unlimited (trapezoidal profiles).
+struct AxisLimits {
+    float velocity;
+    float acceleration;
+    float jerk;
+};
+
+// Jerk-limited trajectory generator for one axis. Every update() replans from
+// the current position, velocity and acceleration, so new targets, velocity
+// commands or limits take effect mid-move without stopping or jumping.
+//
+// A new velocity limit applies at once. Lower acceleration or jerk limits
+// only take over once the axis can keep to them: its acceleration is within
+// the new limit, ramping it out does not carry the speed past the velocity
+// limit, and it can still stop at the target. Until then the previous
+// acceleration and jerk stay in use, so a change mid-move never overshoots.
+class MotionAxis {
+public:
+    explicit MotionAxis(const AxisLimits& limits);
+
+    void setLimits(const AxisLimits& limits);
+    const AxisLimits& limits() const { return _limits; }
+    // The limits in use, which lag lowered acceleration or jerk limits mid-move
+    const AxisLimits& activeLimits() const { return _active; }
+
+    // Position mode: come to rest at the target step
+    void moveTo(long target);
+
+    // Velocity mode: track the given velocity until told otherwise
+    void setVelocity(float velocity);
+
+    // Decelerate to a standstill wherever that ends up
+    void stop() { setVelocity(0.0f); }
+
+    // Redefine the current position, e.g. after zeroing, and halt instantly
+    void setPosition(double position);
+
+    // Advance the trajectory by dt seconds
+    void update(float dt);
+
+    double position() const { return _position; }
+    float velocity() const { return _velocity; }
+    float acceleration() const { return _acceleration; }
+    long target() const { return _target; }
+    bool velocityMode() const { return _velocityMode; }
+    bool isMoving() const;
+
+private:
+    static float stoppingDistance(float v, float a, const AxisLimits& limits);
+    bool fits(const AxisLimits& limits) const;
+
+    AxisLimits _limits;  // As set
+    AxisLimits _active;  // In use
+    double _position;
+    float _velocity;
+    float _acceleration;
+    long _target;
+    float _targetVelocity;
+    bool _velocityMode;
+    bool _braking;  // Committed to stopping at the position target
+};
@@ -0,0 +1,19 @@
+#pragma once
+
+#include "bulk.h"
+
+// Firmware update over the bulk transfer service. The image is streamed into
+// the inactive app partition; esp_ota_end() verifies it before it is made
+// the boot partition, and the device restarts once the host has been told.
+// A new image boots in pending-verify state and rolls back on the next reset
+// unless otaConfirm() marks it good, so an image that cannot get through
+// setup() reverts to the previous firmware. A transfer only starts for the
+// client holding control ("error,control" otherwise) and with the head at
+// rest ("error,busy").
+
+#define OTA_RESTART_DELAY 1000  // Time for the "done" notification to go out, in milliseconds
+
+BulkSink* otaSink();
+
+// Call once setup() has brought up the motors and BLE
+void otaConfirm();
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// CPU power management for idle periods. While the head is active the CPU is
+// held at full speed; once idle it may drop its clock and, where the
+// framework's Bluetooth controller supports modem sleep, enter automatic
+// light sleep between connection events. Either way the connection stays up.
+// loop() blocks in powerWait() while idle, and a command ends the wait
+// through powerWake(). The time from that call until the motion loop is
+// active again is recorded as the wake latency.
+
+#define POWER_MAX_FREQUENCY 240  // MHz while active
+#define POWER_MIN_FREQUENCY 80  // MHz floor while idle; BLE needs the 80 MHz APB clock
+
+struct PowerStats {
+    bool lightSleep;  // Automatic light sleep accepted by the framework
+    uint8_t idlePercent;  // Share of loop() time spent blocked since the last sample
+    uint32_t wakes;
+    uint32_t lastWakeLatency;  // Microseconds
+    uint32_t maxWakeLatency;
+};
+
+// Set up frequency scaling, with automatic light sleep if requested. Returns
+// false if the framework refused the configuration. Call once from loop()'s
+// task.
+bool powerInit(bool lightSleep);
+
+// Change the light sleep setting later, from any task. Reconfiguring power
+// management is slow, so not from the motion tick.
+bool powerConfigure(bool lightSleep);
+
+// Hold full CPU speed while active; release it when idle
+void powerSetActive(bool active);
+
+// From any task or BLE callback: end a powerWait() and time the wake
+void powerWake();
+
+// From loop() only: block until powerWake() or the timeout
+void powerWait(uint32_t timeoutMs);
+
+void powerSample(PowerStats& stats);
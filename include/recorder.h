@@ -0,0 +1,80 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+class BLECharacteristic;
+
+// Motion flight recorder. Fixed-size records go into a large PSRAM ring that
+// always holds the most recent history. A trigger (manual, driver fault, ...)
+// records a few more seconds and then freezes the ring so it can be
+// downloaded over BLE and converted on the host with mac/recorder_dump.py.
+
+#define RECORDER_BYTES (4 * 1024 * 1024)   // PSRAM ring size, power of two
+#define RECORDER_POST_TRIGGER 4000         // Records kept after a trigger
+#define RECORDER_SAMPLE_INTERVAL 1000      // Axis sample period in microseconds
+
+enum RecordType : uint8_t {
+    REC_COMMAND,   // flags: RecordCommand, a/b: pan/tilt as float bits
+    REC_PLAN,      // flags: RecordPlan, a: target steps or velocity, b: max speed (float bits)
+    REC_SAMPLE,    // a: position in steps, b: speed in steps/s (float bits)
+    REC_DRIVER,    // flags: SG_RESULT, a: DRV_STATUS, b: actual current scale
+    REC_TRIGGER,   // flags: RecordTrigger
+    REC_LOAD,      // flags: SG_RESULT from fast sampling during tuning/calibration
+    REC_ENCODER    // a: encoder position in steps, b: step count at the reading
+};
+
+enum RecordCommand : uint16_t {
+    CMD_POSITION,
+    CMD_JOG,
+    CMD_ZERO
+};
+
+enum RecordPlan : uint16_t {
+    PLAN_POSITION,
+    PLAN_JOG
+};
+
+enum RecordTrigger : uint16_t {
+    TRIGGER_MANUAL,
+    TRIGGER_DRIVER_FAULT,
+    TRIGGER_STALL,
+    TRIGGER_CALIBRATION,
+    TRIGGER_STEP_LOSS
+};
+
+struct RecorderRecord {
+    uint32_t time;     // micros()
+    uint8_t type;      // RecordType
+    uint8_t axis;      // 1 or 2, 0 when not axis specific
+    uint16_t flags;
+    int32_t a;
+    int32_t b;
+};
+
+inline int32_t recorderFloat(float value) {
+    int32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+// Allocate the ring in PSRAM and start the download task. Recording is a
+// no-op if PSRAM is missing.
+void recorderInit();
+void recorderRecord(uint8_t type, uint8_t axis, uint16_t flags, int32_t a, int32_t b);
+
+// Freeze the ring after RECORDER_POST_TRIGGER more records. Later triggers
+// are ignored until recorderArm() clears the freeze.
+void recorderTrigger(uint16_t reason);
+void recorderArm();
+bool recorderFrozen();
+
+// Text summary for the recorder characteristic
+int recorderFormatInfo(char* buffer, size_t size);
+
+// Stream the frozen ring as notifications to the connection that asked,
+// starting at the given chunk. Each chunk is a 32-bit chunk index followed by
+// whole records; the transfer ends with index 0xFFFFFFFF followed by the
+// total record count.
+void recorderStartDownload(BLECharacteristic* pCharacteristic, uint16_t connId, uint32_t fromChunk);
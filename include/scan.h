@@ -0,0 +1,92 @@
+#pragma once
+
+#include <stdint.h>
+
+// Grid scans for panoramas. A field of view to cover, the lens field of view
+// and the overlap between neighbouring frames give a grid of tiles, visited
+// in serpentine order so each move is a single tile step. On a full grid a
+// nearest-neighbour tour comes out the same, so the only choice left is
+// which axis steps along the rows; SCAN_AUTO picks the one whose tile
+// moves are quicker. Angles are in degrees, times in seconds.
+
+#define MAX_SCAN_TILES 4096  // Largest grid accepted
+
+enum ScanOrder : uint8_t {
+    SCAN_AUTO,
+    SCAN_ROWS,     // Pan steps along each row, tilt between rows
+    SCAN_COLUMNS   // Tilt steps along each column, pan between columns
+};
+
+struct ScanConfig {
+    float panFrom;   // Field to cover, frame edges
+    float panTo;
+    float tiltFrom;
+    float tiltTo;
+    float overlap;   // Fraction of a frame shared with its neighbour, 0..0.9
+    float fovH;      // Lens field of view
+    float fovV;
+    ScanOrder order;
+};
+
+struct AxisMove {
+    float velocity;
+    float acceleration;
+    float jerk;  // 0 for unlimited
+};
+
+// Time for a point-to-point move, a trapezoid plus the jerk ramps
+float scanMoveTime(float distance, const AxisMove& limits);
+
+class ScanPlan {
+public:
+    ScanPlan();
+
+    // Lay out the grid; false if the configuration is invalid or too large.
+    // The move limits are only used to choose the order for SCAN_AUTO.
+    bool configure(const ScanConfig& config, const AxisMove& pan, const AxisMove& tilt);
+
+    uint16_t count() const { return _columns * _rows; }
+    uint16_t columns() const { return _columns; }
+    uint16_t rows() const { return _rows; }
+    bool rowMajor() const { return _rowMajor; }
+
+    // Estimated time spent moving between tiles, without settling or exposure
+    float travelTime() const { return _travelTime; }
+
+    // Frame centre of the tile visited at index
+    void tile(uint16_t index, float& pan, float& tilt) const;
+
+private:
+    uint16_t _columns;
+    uint16_t _rows;
+    float _panStart;
+    float _panStep;
+    float _tiltStart;
+    float _tiltStep;
+    bool _rowMajor;
+    float _travelTime;
+};
+
+// Decides when the head has stopped ringing after a move: the measured
+// position has to stay within the tolerance of where the window began for
+// the whole window. Only the movement counts, not any steady offset between
+// the measurement and the target. Without a measurement (no encoder) feed a
+// constant and the window becomes a fixed wait after the commanded motion
+// ends. Times in milliseconds.
+class SettleDetector {
+public:
+    SettleDetector();
+
+    void start(uint32_t now);
+    bool update(float position, float tolerance, uint32_t window, uint32_t now);
+    bool settled() const { return _settled; }
+    uint32_t elapsed() const { return _settleTime; }  // From start to settled
+
+private:
+    uint32_t _start;
+    uint32_t _windowStart;
+    float _reference;  // Position at the start of the window
+    bool _inWindow;
+    bool _settled;
+    uint32_t _settleTime;
+};
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <stdint.h>
+
+// Visual servo for one axis. Image-space error measurements arrive at the
+// camera frame rate with some latency; each is turned into an absolute target
+// using where the axis was when the frame was captured, so latency does not
+// show up as overshoot. Between measurements the target is extrapolated
+// with its estimated velocity, and a PI controller with velocity feedforward
+// and a damping term runs at the motion tick rate. Its output is a velocity
+// command for the jerk-limited planner.
+
+#define SERVO_HISTORY 128  // Position samples kept for latency compensation
+#define SERVO_HISTORY_INTERVAL 4000  // Microseconds between position samples
+#define SERVO_MAX_PREDICT 200000  // Longest extrapolation past a measurement, microseconds
+#define SERVO_LOST_TIMEOUT 500000  // No measurement for this long stops the axis, microseconds
+#define SERVO_VELOCITY_FILTER 0.7f  // Weight of a new target velocity estimate
+
+// Gains in steps: the proportional gain is scheduled between kpNear at zero
+// error and kp at scheduleError and beyond, so large errors close fast while
+// small ones do not hunt. kd damps the difference between target and axis
+// velocity.
+struct ServoGains {
+    float kp;  // 1/s
+    float kpNear;  // 1/s
+    float scheduleError;  // steps
+    float ki;  // 1/s^2
+    float kd;
+};
+
+class VisualServo {
+public:
+    explicit VisualServo(const ServoGains& gains);
+
+    void setGains(const ServoGains& gains) { _gains = gains; }
+    const ServoGains& gains() const { return _gains; }
+
+    // Call every motion tick, in any control mode, to keep the history current
+    void record(long position, uint32_t now);
+
+    // A new measurement: error in steps at the given capture time (micros)
+    void measure(float error, uint32_t captureTime);
+
+    // Velocity command for this tick, limited to velocityLimit with
+    // conditional integration as anti-windup
+    float update(long position, float velocity, uint32_t now, float dt, float velocityLimit);
+
+    void reset();
+    bool tracking() const { return _valid; }
+    float targetVelocity() const { return _targetVelocity; }
+
+private:
+    double positionAt(uint32_t time) const;
+
+    ServoGains _gains;
+    long _history[SERVO_HISTORY];
+    uint32_t _historyTime[SERVO_HISTORY];
+    int _historyHead;
+    int _historyCount;
+    bool _valid;  // Holding a fresh target
+    double _target;  // Target position at _measureTime, in steps
+    uint32_t _measureTime;
+    float _targetVelocity;
+    float _integral;
+};
+
+// Maps a host clock onto micros(). The smallest observed difference between
+// arrival and host send time is taken as the offset, so the estimate lags
+// the true capture time by the fastest transport delay seen. It creeps up
+// slowly so clock drift cannot strand it.
+class ClockSync {
+public:
+    ClockSync();
+    uint32_t toLocal(uint32_t remoteMicros, uint32_t now);
+
+private:
+    bool _valid;
+    int32_t _offset;
+};
@@ -0,0 +1,57 @@
+#pragma once
+
+// Input shaper for one axis. The planned trajectory is convolved with a short
+// impulse sequence whose spacing and amplitudes are chosen so the residual
+// vibration of a payload resonating at the given frequency and damping ratio
+// cancels out. The shaper is fed one sample per motion tick.
+
+#define SHAPER_MAX_IMPULSES 3
+#define SHAPER_HISTORY 1024  // Ticks of history, bounds the lowest usable frequency
+
+enum ShaperType {
+    SHAPER_NONE,
+    SHAPER_ZV,   // Two impulses, shortest delay, sensitive to frequency error
+    SHAPER_ZVD,  // Three impulses, more robust, twice the delay
+    SHAPER_EI    // Extra-insensitive, 5% vibration tolerance, widest robustness
+};
+
+class InputShaper {
+public:
+    InputShaper();
+
+    // Returns false if the shaper would not fit in the history at this tick
+    bool configure(ShaperType type, float frequency, float damping, float tick);
+
+    // Fill the history with a resting position, e.g. after zeroing
+    void reset(double position);
+
+    // Push the planned position and velocity for this tick
+    void update(double position, float velocity);
+
+    double position() const { return _position; }
+    float velocity() const { return _velocity; }
+
+    ShaperType type() const { return _type; }
+    float frequency() const { return _frequency; }
+    float damping() const { return _damping; }
+
+    // Delay from the first to the last impulse, in seconds
+    float duration() const { return _duration; }
+
+private:
+    ShaperType _type;
+    float _frequency;
+    float _damping;
+    float _duration;
+
+    int _impulses;
+    float _amplitude[SHAPER_MAX_IMPULSES];
+    int _delay[SHAPER_MAX_IMPULSES];  // In ticks
+
+    double _positions[SHAPER_HISTORY];
+    float _velocities[SHAPER_HISTORY];
+    int _head;
+
+    double _position;
+    float _velocity;
+};
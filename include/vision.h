@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Subject detection kernels for the on-board camera (XIAO ESP32-S3 Sense).
+// A YUYV frame is halved to the working resolution, skin-coloured pixels are
+// masked by their chroma and brightness, and the centroid of the densest
+// face-sized patch becomes the target. Each kernel has a scalar reference and
+// a fast variant working on four bytes per 32-bit word; both produce
+// identical output, which the vision "bench" command checks on the device.
+
+#define VISION_WIDTH 160  // Working resolution, half of the QVGA capture
+#define VISION_HEIGHT 120
+#define VISION_PIXELS (VISION_WIDTH * VISION_HEIGHT)
+#define VISION_CELL 8  // Grid cell for the patch search, in working pixels
+#define VISION_PATCH_CELLS 3  // Patch size in cells, about a face at 1-3 m
+#define VISION_MIN_PIXELS 40  // Fewer skin pixels in the best patch is no target
+
+// Skin chroma box in YCbCr; the ranges must stay under 128 wide for the
+// four-pixel compare
+#define VISION_U_MIN 77
+#define VISION_U_MAX 127
+#define VISION_V_MIN 133
+#define VISION_V_MAX 173
+#define VISION_Y_MIN 40  // Ignore dark pixels, whose chroma is mostly noise
+
+struct VisionFrame {
+    uint8_t y[VISION_PIXELS];
+    uint8_t u[VISION_PIXELS];
+    uint8_t v[VISION_PIXELS];
+};
+
+// Normalised image position, -1..1 with x right and y down, like mac/main.py
+struct VisionTarget {
+    bool found;
+    float x;
+    float y;
+    float confidence;  // Fraction of the patch that is skin
+};
+
+// Halve a width x height YUYV frame into the working planes
+void visionDownscaleScalar(const uint8_t* yuyv, int width, int height, VisionFrame& frame);
+void visionDownscaleFast(const uint8_t* yuyv, int width, int height, VisionFrame& frame);
+
+// One byte per working pixel, 1 for skin
+void visionSkinMaskScalar(const VisionFrame& frame, uint8_t* mask);
+void visionSkinMaskFast(const VisionFrame& frame, uint8_t* mask);
+
+void visionCentroid(const uint8_t* mask, VisionTarget& target);
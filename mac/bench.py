@@ -0,0 +1,105 @@
+import argparse
+import json
+import os
+import re
+import sys
+import time
+
+# Collects the firmware microbenchmarks (see include/bench.h) and compares
+# them with a saved baseline. Host numbers come from the native build on
+# stdin, device numbers from the serial port of a board running the
+# seeed_xiao_esp32s3_bench build:
+#
+#   pio run -e native && .pio/build/native/program | python bench.py
+#   pio run -e seeed_xiao_esp32s3_bench -t upload && python bench.py --port /dev/cu.usbmodem101
+#
+# Host and device results are kept apart in the baseline file. --save
+# replaces the stored numbers for that target with this run.
+
+BASELINE_FILE = os.path.join(os.path.dirname(__file__), "bench_baseline.json")
+SERIAL_TIMEOUT = 30.0  # seconds to wait for the suite after a reset
+DEFAULT_THRESHOLD = 10.0  # percent slower than the baseline that counts as a regression
+
+# The device also prints binary log frames, so lines are matched anywhere
+LINE = re.compile(rb"bench,([\w.,-]+)")
+
+def parse(lines):
+    target = None
+    results = {}
+    for line in lines:
+        match = LINE.search(line)
+        if not match:
+            continue
+        fields = match.group(1).decode().split(",")
+        if fields[0] == "begin":
+            target = fields[1]
+            results = {}
+        elif fields[0] == "end":
+            return target, results
+        elif target is not None and len(fields) == 4:
+            name, ns, cycles, spread = fields
+            results[name] = {"ns": float(ns), "cycles": float(cycles), "spread": float(spread)}
+    raise RuntimeError("Benchmark output ended before bench,end")
+
+def serial_lines(port):
+    import serial
+    with serial.Serial(port, 115200, timeout=1) as connection:
+        # Toggling DTR resets the board so the suite runs again
+        connection.dtr = False
+        time.sleep(0.1)
+        connection.dtr = True
+        deadline = time.monotonic() + SERIAL_TIMEOUT
+        while time.monotonic() < deadline:
+            yield connection.readline()
+    raise RuntimeError("Timed out waiting for the benchmark over serial")
+
+def compare(results, baseline, threshold):
+    regressions = []
+    print(f"{'case':<26}{'ns/op':>10}{'cycles':>10}{'spread':>9}{'baseline':>10}{'change':>9}")
+    for name, result in results.items():
+        line = f"{name:<26}{result['ns']:>10.1f}{result['cycles']:>10.0f}{result['spread']:>8.1f}%"
+        previous = baseline.get(name)
+        if previous:
+            change = 100.0 * (result["ns"] - previous["ns"]) / previous["ns"]
+            # Within the noise of either run is not a regression
+            noise = max(result["spread"], previous["spread"])
+            flag = ""
+            if change > max(threshold, noise):
+                flag = "  REGRESSION"
+                regressions.append(name)
+            line += f"{previous['ns']:>10.1f}{change:>+8.1f}%{flag}"
+        print(line)
+    for name in baseline:
+        if name not in results:
+            print(f"{name:<26}{'missing':>10}")
+    return regressions
+
+def main():
+    parser = argparse.ArgumentParser(description="Run the CameraRobot microbenchmarks against a baseline")
+    parser.add_argument("--port", help="Serial port of a board running the bench build; stdin otherwise")
+    parser.add_argument("--baseline", default=BASELINE_FILE, help="Baseline file to compare against")
+    parser.add_argument("--save", action="store_true", help="Store this run as the baseline")
+    parser.add_argument("--threshold", type=float, default=DEFAULT_THRESHOLD, help="Regression threshold in percent")
+    args = parser.parse_args()
+
+    lines = serial_lines(args.port) if args.port else (line.encode() for line in sys.stdin)
+    target, results = parse(lines)
+
+    baselines = {}
+    if os.path.exists(args.baseline):
+        with open(args.baseline) as f:
+            baselines = json.load(f)
+    print(f"Target: {target}")
+    regressions = compare(results, baselines.get(target, {}), args.threshold)
+
+    if args.save:
+        baselines[target] = results
+        with open(args.baseline, "w") as f:
+            json.dump(baselines, f, indent=2, sort_keys=True)
+        print(f"Saved {target} baseline to {args.baseline}")
+    elif regressions:
+        print(f"{len(regressions)} regression(s): {', '.join(regressions)}")
+        sys.exit(1)
+
+if __name__ == "__main__":
+    main()
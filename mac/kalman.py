@@ -0,0 +1,99 @@
+# Subject state estimator for the tracker. Each axis is a constant-velocity
+# Kalman filter driven by white-noise acceleration; measurements carry the
+# capture time of their frame, so frame jitter and dropped frames are handled
+# by the time step rather than assumed away. Detections far outside the
+# predicted spread are gated out, short dropouts are coasted through on the
+# velocity estimate, and the target is the prediction for when the command
+# will reach the head. Units are degrees and seconds.
+
+PROCESS_NOISE = 200.0  # Acceleration spectral density, deg^2/s^3; higher follows manoeuvres faster
+MEASUREMENT_NOISE = 1.0  # Detection jitter, degrees standard deviation
+INITIAL_VELOCITY = 30.0  # Velocity uncertainty when a track starts, deg/s standard deviation
+GATE = 13.8  # Squared Mahalanobis distance over both axes (chi-square, 2 dof, 99.9%)
+GATE_RESET = 3  # Consecutive gated detections that restart the track there
+COAST_TIME = 0.5  # Longest dropout predicted through, seconds
+MAX_PREDICTION = 0.3  # Furthest the velocity is extrapolated past the last detection
+
+class AxisFilter:
+    def __init__(self, position, measurement_noise):
+        self.x = position
+        self.v = 0.0
+        self.p00 = measurement_noise ** 2
+        self.p01 = 0.0
+        self.p11 = INITIAL_VELOCITY ** 2
+
+    def predict(self, dt, q):
+        """Advance the state and covariance by dt"""
+        self.x += self.v * dt
+        p00 = self.p00 + dt * (2 * self.p01 + dt * self.p11) + q * dt ** 3 / 3
+        p01 = self.p01 + dt * self.p11 + q * dt ** 2 / 2
+        self.p11 += q * dt
+        self.p00 = p00
+        self.p01 = p01
+
+    def innovation(self, z, r):
+        """Measurement residual and its variance"""
+        return z - self.x, self.p00 + r
+
+    def correct(self, y, s):
+        k0 = self.p00 / s
+        k1 = self.p01 / s
+        self.x += k0 * y
+        self.v += k1 * y
+        p00 = self.p00 - k0 * self.p00
+        p01 = self.p01 - k0 * self.p01
+        self.p11 -= k1 * self.p01
+        self.p00 = p00
+        self.p01 = p01
+
+class SubjectTracker:
+    """Pan/tilt of one subject from timed detections"""
+
+    def __init__(self, process_noise=PROCESS_NOISE, measurement_noise=MEASUREMENT_NOISE):
+        self.q = process_noise
+        self.r = measurement_noise
+        self.accepted = 0
+        self.gated = 0
+        self.reset()
+
+    def reset(self):
+        self.axes = None
+        self.time = None  # Time of the filter state, the last detection
+        self.misses = 0
+
+    def update(self, t, measurement):
+        """Fold in a detection captured at t; returns False if it was gated out"""
+        if self.axes is not None and t - self.time > COAST_TIME:
+            self.reset()  # Lost too long ago for the old track to mean anything
+        if self.axes is None:
+            self.axes = [AxisFilter(z, self.r) for z in measurement]
+            self.time = t
+            self.accepted += 1
+            return True
+
+        dt = max(t - self.time, 0.0)
+        for axis in self.axes:
+            axis.predict(dt, self.q)
+        self.time = t
+        residuals = [axis.innovation(z, self.r ** 2) for axis, z in zip(self.axes, measurement)]
+        if sum(y * y / s for y, s in residuals) > GATE:
+            # Probably a false detection or a different person; a subject
+            # that really jumped keeps being seen there
+            self.gated += 1
+            self.misses += 1
+            if self.misses >= GATE_RESET:
+                self.reset()
+                return self.update(t, measurement)
+            return False
+        self.misses = 0
+        for axis, (y, s) in zip(self.axes, residuals):
+            axis.correct(y, s)
+        self.accepted += 1
+        return True
+
+    def predict(self, t):
+        """Expected pan/tilt at time t, or None with no live track"""
+        if self.axes is None or t - self.time > COAST_TIME + MAX_PREDICTION:
+            return None
+        ahead = min(max(t - self.time, 0.0), MAX_PREDICTION)
+        return tuple(axis.x + axis.v * ahead for axis in self.axes)
@@ -0,0 +1,101 @@
+import os
+import re
+import struct
+import sys
+import argparse
+
+# Decodes the firmware's binary log stream (see include/log.h) into text.
+# Reads from a serial port (needs pyserial) or from a captured file.
+
+MESSAGES_HEADER = os.path.join(os.path.dirname(__file__), "..", "include", "log_messages.h")
+SYNC = b"\xa5\x5a"
+HEADER_SIZE = 11  # sync, timestamp, id, level, category, argc
+MAX_ARGS = 6
+LEVELS = ["DEBUG", "INFO", "WARN", "ERROR"]
+CATEGORIES = ["SYSTEM", "BLE", "MOTION", "MEMORY"]
+CONVERSION = re.compile(r"%[-+ #0]*\d*(?:\.\d+)?([dufxXc])")
+
+def load_messages(path=MESSAGES_HEADER):
+    # Record ids are the order of the X(...) entries in the header
+    with open(path) as f:
+        text = f.read()
+    return re.findall(r'X\(\s*\w+\s*,\s*"((?:[^"\\]|\\.)*)"\s*\)', text)
+
+def format_record(fmt, words):
+    values = []
+    for conversion, word in zip(CONVERSION.findall(fmt), words):
+        if conversion == "f":
+            values.append(struct.unpack("<f", struct.pack("<I", word))[0])
+        elif conversion == "d":
+            values.append(struct.unpack("<i", struct.pack("<I", word))[0])
+        else:
+            values.append(word)
+    try:
+        return fmt % tuple(values)
+    except TypeError:
+        return f"{fmt} {words}"
+
+def decode(stream, messages):
+    buffer = b""
+    while True:
+        chunk = stream.read(256)
+        if not chunk:
+            return
+        buffer += chunk
+
+        while True:
+            start = buffer.find(SYNC)
+            if start < 0:
+                buffer = buffer[-1:]  # Keep a possible first sync byte
+                break
+            buffer = buffer[start:]
+            if len(buffer) < HEADER_SIZE:
+                break
+
+            timestamp, msg_id, level, category, argc = struct.unpack_from("<IHBBB", buffer, 2)
+            if argc > MAX_ARGS or msg_id >= len(messages):
+                buffer = buffer[1:]  # Not a real frame, resync
+                continue
+            size = HEADER_SIZE + argc * 4
+            if len(buffer) < size:
+                break
+
+            words = struct.unpack_from(f"<{argc}I", buffer, HEADER_SIZE)
+            buffer = buffer[size:]
+            level_name = LEVELS[level] if level < len(LEVELS) else str(level)
+            category_name = CATEGORIES[category] if category < len(CATEGORIES) else str(category)
+            yield f"{timestamp / 1e6:12.6f} {level_name:<5} {category_name:<6} {format_record(messages[msg_id], words)}"
+
+def main():
+    parser = argparse.ArgumentParser(description="Decode CameraRobot binary logs")
+    parser.add_argument("source", help="Serial port (e.g. /dev/cu.usbmodem1101) or captured log file")
+    parser.add_argument("--baud", type=int, default=115200)
+    args = parser.parse_args()
+
+    messages = load_messages()
+    if os.path.exists(args.source) and not args.source.startswith("/dev/"):
+        stream = open(args.source, "rb")
+    else:
+        import serial
+        stream = serial.Serial(args.source, args.baud, timeout=1)
+        stream.read = _blocking_read(stream.read)
+
+    try:
+        for line in decode(stream, messages):
+            print(line, flush=True)
+    except KeyboardInterrupt:
+        pass
+    finally:
+        stream.close()
+
+def _blocking_read(read):
+    # pyserial returns b"" on timeout; only a closed file should end decoding
+    def wrapper(size):
+        data = b""
+        while not data:
+            data = read(size)
+        return data
+    return wrapper
+
+if __name__ == "__main__":
+    main()
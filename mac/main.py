@@ -1,42 +1,50 @@
+import argparse
 import asyncio
 import cv2
 from ultralytics import YOLO
 from bleak import BleakClient, BleakScanner
+import csv
 import time
-from collections import deque
+from pose import PoseHistory, image_to_bearing
+from kalman import SubjectTracker
+import replay
 
 # BLE Constants
 SERVICE_UUID = "4fafc201-1fb5-459e-8fcc-c5c9c331914b"
 POSITION_CHAR_UUID = "beb5483e-36e1-4688-b7f5-ea07361b26a8"
+SERVO_CHAR_UUID = "beb5483e-36e1-4688-b7f5-ea07361b26b2"
+POSE_CHAR_UUID = "5b818d26-7c11-4f24-b87f-4f8a8cc974ef"
+CONTROL_CHAR_UUID = "beb5483e-36e1-4688-b7f5-ea07361b26b4"
 DEVICE_NAME = "CameraRobot"
-RECONNECT_DELAY = 5  # seconds to wait before attempting reconnect
+RECONNECT_DELAY = 5  # Longest wait between reconnect attempts, seconds
+RECONNECT_FIRST_DELAY = 0.1  # First retry after losing the link; doubles up to RECONNECT_DELAY
+CONNECT_TIMEOUT = 5  # Seconds for one connection attempt to the cached device
 TARGET_FPS = 5  # Target frames per second for processing
 FRAME_INTERVAL = 1.0 / TARGET_FPS  # Time between frames in seconds
-AVG_WINDOW_SIZE = 5  # Number of frames to average over
+# "world": aim at world-frame bearings from the device pose at capture time,
+# "servo": send image-space error to the firmware servo,
+# "image": legacy image-relative targets
+TRACKING_MODE = "world"
+CAMERA_FOV_H = 70.0  # Webcam field of view in degrees
+CAMERA_FOV_V = 43.0
+CAMERA_LATENCY = 0.05  # Seconds from exposure until cap.read() returns the frame
+COMMAND_DELAY = 0.015  # Seconds from a position write until the motion tick applies it
 
-# Camera and detection model
+# Detection model
 model = YOLO("yolov8n-pose.pt")  # Using pose detection model
-cap = cv2.VideoCapture(0)
 
-# Moving average filters for pan and tilt
-pan_history = deque(maxlen=AVG_WINDOW_SIZE)
-tilt_history = deque(maxlen=AVG_WINDOW_SIZE)
+# Device pose for the world-frame tracker and the subject estimate
+pose = PoseHistory()
+tracker = SubjectTracker()
+trace = None  # csv writer for detection traces (--trace)
 
-# Store last sent positions
-last_sent_pan = 0
-last_sent_tilt = 0
+# The robot found by the first scan. Reconnects go straight to it, without
+# scanning; the OS keeps its GATT table from the previous connection.
+robot = None
+link_lost_at = None  # time.monotonic() when the link dropped, for the reconnect time
 
-def get_person_center(results, frame_width, frame_height):
-    global last_sent_pan, last_sent_tilt
-    
-    # Calculate dynamic step size based on distance to target
-    def calculate_step_size(distance):
-        # More consistent step size with slight adjustment for small distances
-        base_step = 0.25  # 25% base step size
-        if abs(distance) < 3:  # When very close
-            return 0.35  # Slightly more aggressive
-        return base_step
-    
+def find_eye_center(results, frame_width, frame_height):
+    """Normalised (-1..1) point between the eyes of the first confident person, or (None, None)"""
     for result in results:
         if result.keypoints is not None:  # Check if pose keypoints are available
             for kpts in result.keypoints:
@@ -62,82 +70,112 @@ def get_person_center(results, frame_width, frame_height):
                         # Normalize coordinates to -1 to 1
                         norm_x = (cx - frame_width / 2) / (frame_width / 2)
                         norm_y = (cy - frame_height / 2) / (frame_height / 2)
-                        
-                        # Apply sigmoid-like function for smoother response
-                        def smooth_response(x):
-                            return x * (1.0 - 0.7 * x * x)  # More gentle cubic function
-                        
-                        # Calculate target angles with smoothed response
-                        target_pan = smooth_response(norm_x) * 45
-                        target_tilt = smooth_response(norm_y) * 30
-                        
-                        # Add to history
-                        pan_history.append(target_pan)
-                        tilt_history.append(target_tilt)
-                        
-                        # Calculate moving average of target positions
-                        avg_target_pan = sum(pan_history) / len(pan_history)
-                        avg_target_tilt = sum(tilt_history) / len(tilt_history)
-                        
-                        # Calculate step size based on distance to target
-                        pan_distance = avg_target_pan - last_sent_pan
-                        tilt_distance = avg_target_tilt - last_sent_tilt
-                        
-                        # Use dynamic step size
-                        pan_step_size = calculate_step_size(pan_distance)
-                        tilt_step_size = calculate_step_size(tilt_distance)
-                        
-                        # Move a fraction of the distance to the target
-                        step_pan = last_sent_pan + (pan_distance * pan_step_size)
-                        step_tilt = last_sent_tilt + (tilt_distance * tilt_step_size)
-                        
-                        # Update last sent positions
-                        last_sent_pan = step_pan
-                        last_sent_tilt = step_tilt
-                        
-                        return step_pan, step_tilt
-    
-    # If no person detected, clear the history to prevent bias
-    pan_history.clear()
-    tilt_history.clear()
-    for _ in range(AVG_WINDOW_SIZE):
-        pan_history.append(last_sent_pan)
-        tilt_history.append(last_sent_tilt)
+                        return norm_x, norm_y
     return None, None
 
+def get_person_center(norm_x, norm_y, capture_time, now):
+    """Image-relative target: the eye position mapped straight onto pan/tilt"""
+    if norm_x is not None:
+        # Apply sigmoid-like function for smoother response
+        def smooth_response(x):
+            return x * (1.0 - 0.7 * x * x)  # More gentle cubic function
+
+        tracker.update(capture_time, (smooth_response(norm_x) * 45, smooth_response(norm_y) * 30))
+    return tracker.predict(now + COMMAND_DELAY) or (None, None)
+
+def get_world_target(norm_x, norm_y, capture_time, now, pose=pose, tracker=tracker):
+    """Next pan/tilt target from the eye position in a frame captured at
+    capture_time; multi_tracker.py passes each head's own pose and tracker"""
+    pose_then = pose.at(capture_time)
+    if norm_x is not None and pose_then is not None:
+        # Where the head pointed at exposure, not where it is now, so frames
+        # that arrive late do not make the tracker chase its own motion
+        tracker.update(capture_time, image_to_bearing(norm_x, norm_y, pose_then, CAMERA_FOV_H, CAMERA_FOV_V))
+    # Aim where the subject will be when the command takes effect; through
+    # a short dropout this coasts on the estimated velocity
+    return tracker.predict(now + COMMAND_DELAY) or (None, None)
+
+def track_frame(results, frame_width, frame_height, capture_time, now):
+    """Pan/tilt target for a frame in the world or image tracking modes"""
+    norm_x, norm_y = find_eye_center(results, frame_width, frame_height)
+    if trace is not None:
+        pose_then = pose.at(capture_time) or ("", "")
+        trace.writerow([f"{capture_time:.4f}", norm_x if norm_x is not None else "",
+                        norm_y if norm_y is not None else "", *pose_then, CAMERA_FOV_H, CAMERA_FOV_V])
+    if TRACKING_MODE == "world":
+        return get_world_target(norm_x, norm_y, capture_time, now)
+    return get_person_center(norm_x, norm_y, capture_time, now)
+
+def reset_tracker():
+    """Forget the subject and the head pose, as after a reconnect"""
+    pose.reset()
+    tracker.reset()
+
+def on_disconnect(_):
+    global link_lost_at
+    if link_lost_at is None:
+        link_lost_at = time.monotonic()
+
 async def connect_to_robot():
+    global robot, link_lost_at
+    delay = RECONNECT_FIRST_DELAY
     while True:
         try:
-            device = await BleakScanner.find_device_by_filter(lambda d, ad: d.name == DEVICE_NAME)
-            if not device:
-                print("Robot not found over BLE, retrying...")
-                await asyncio.sleep(RECONNECT_DELAY)
-                continue
+            if robot is None:
+                robot = await BleakScanner.find_device_by_filter(lambda d, ad: d.name == DEVICE_NAME)
+                if not robot:
+                    print("Robot not found over BLE, retrying...")
+                    await asyncio.sleep(RECONNECT_DELAY)
+                    continue
 
-            client = BleakClient(device)
+            # Only our service is discovered, not the whole table
+            client = BleakClient(robot, disconnected_callback=on_disconnect, services=[SERVICE_UUID],
+                                 timeout=CONNECT_TIMEOUT)
             await client.connect()
-            print("Connected to robot!")
+            # The phone, as operator, can take over at any time; control
+            # comes back once it has been quiet for a few seconds. After a
+            # reconnect the robot remembers the role, but it may have
+            # restarted meanwhile.
+            await client.write_gatt_char(CONTROL_CHAR_UUID, b"claim,tracker", response=True)
+            if TRACKING_MODE == "servo":
+                fov = f"fov,{CAMERA_FOV_H},{CAMERA_FOV_V}"
+                await client.write_gatt_char(SERVO_CHAR_UUID, fov.encode(), response=True)
+            elif TRACKING_MODE == "world":
+                # The subject estimate and pose history carry on across a
+                # dropout; the clock sync is dropped only if the robot restarted
+                if link_lost_at is None:
+                    reset_tracker()
+                else:
+                    pose.resume()
+                await client.start_notify(POSE_CHAR_UUID, pose.on_notify)
+
+            if link_lost_at is None:
+                print("Connected to robot!")
+            else:
+                # The robot's own count: "owner,reconnects,last,max;..." in ms
+                stats = (await client.read_gatt_char(CONTROL_CHAR_UUID)).decode().split(";")[0].split(",")
+                print(f"Reconnected in {(time.monotonic() - link_lost_at) * 1000:.0f} ms "
+                      f"(robot: {stats[1]} reconnects, last {stats[2]} ms, max {stats[3]} ms)")
+            link_lost_at = None
             return client
         except Exception as e:
             print(f"Connection failed: {e}")
-            print(f"Retrying in {RECONNECT_DELAY} seconds...")
-            await asyncio.sleep(RECONNECT_DELAY)
+            print(f"Retrying in {delay:.1f} seconds...")
+            await asyncio.sleep(delay)
+            delay = min(delay * 2, RECONNECT_DELAY)
 
 async def run_tracking():
     client = None
     last_frame_time = time.time()
-    
-    # Initialize history with zeros
-    for _ in range(AVG_WINDOW_SIZE):
-        pan_history.append(0)
-        tilt_history.append(0)
+    cap = cv2.VideoCapture(0)
+    reset_tracker()
     
     while True:
         try:
             if client is None or not client.is_connected:
                 client = await connect_to_robot()
 
-            while cap.isOpened():
+            while cap.isOpened() and client.is_connected:
                 current_time = time.time()
                 elapsed = current_time - last_frame_time
                 
@@ -145,10 +183,25 @@ async def run_tracking():
                     ret, frame = cap.read()
                     if not ret:
                         break
+                    capture_time = time.monotonic() - CAMERA_LATENCY
+                    capture_ms = int(capture_time * 1000) & 0xFFFFFFFF
 
                     results = model.predict(source=frame, verbose=False)
                     height, width, _ = frame.shape
-                    pan, tilt = get_person_center(results, width, height)
+
+                    if TRACKING_MODE == "servo":
+                        # The firmware servo compensates latency from the capture time
+                        norm_x, norm_y = find_eye_center(results, width, height)
+                        pan = tilt = None
+                        if norm_x is not None:
+                            message = f"{norm_x:.4f},{norm_y:.4f},{capture_ms}"
+                            try:
+                                await client.write_gatt_char(SERVO_CHAR_UUID, message.encode(), response=False)
+                            except Exception as e:
+                                print(f"Error sending data: {e}")
+                                break  # Break inner loop to attempt reconnection
+                    else:
+                        pan, tilt = track_frame(results, width, height, capture_time, time.monotonic())
 
                     if pan is not None and tilt is not None:
                         pan = max(min(pan, 90), -90)   # clamp values if needed
@@ -181,16 +234,55 @@ async def run_tracking():
 
         except Exception as e:
             print(f"Error in main loop: {e}")
+            on_disconnect(client)
             if client:
                 try:
                     await client.disconnect()
                 except:
                     pass
             client = None
-            print(f"Retrying in {RECONNECT_DELAY} seconds...")
-            await asyncio.sleep(RECONNECT_DELAY)
 
     cap.release()
     cv2.destroyAllWindows()
 
-asyncio.run(run_tracking())
\ No newline at end of file
+def main():
+    global TRACKING_MODE, CAMERA_FOV_H, CAMERA_FOV_V, trace
+    parser = argparse.ArgumentParser(description="Track a person with the camera robot")
+    parser.add_argument("--replay", nargs="+", metavar="VIDEO",
+                        help="benchmark offline on recorded video against a simulated head")
+    parser.add_argument("--mode", choices=("world", "image"), default=None,
+                        help="tracking mode for the replay (default: TRACKING_MODE, servo runs on the device)")
+    parser.add_argument("--scene-fov", nargs=2, type=float, default=(CAMERA_FOV_H, CAMERA_FOV_V),
+                        metavar=("H", "V"), help="field of view the video was recorded with, degrees")
+    parser.add_argument("--crop", type=float, default=0.5,
+                        help="share of the recorded frame the simulated camera sees")
+    parser.add_argument("--fps", type=float, default=TARGET_FPS, help="frames taken per second of video")
+    parser.add_argument("--latency", type=float, default=CAMERA_LATENCY,
+                        help="exposure to frame delivery, seconds")
+    parser.add_argument("--show", action="store_true", help="display the simulated camera view")
+    parser.add_argument("--json", help="also write the results to this file")
+    parser.add_argument("--trace", help="record detections with capture time and head pose to this CSV "
+                                        "for tune_tracker.py")
+    args = parser.parse_args()
+
+    if args.trace:
+        trace_file = open(args.trace, "w", newline="", buffering=1)
+        trace = csv.writer(trace_file)
+        trace.writerow(["time", "norm_x", "norm_y", "pan", "tilt", "fov_h", "fov_v"])
+
+    if not args.replay:
+        asyncio.run(run_tracking())
+        return
+
+    TRACKING_MODE = args.mode or TRACKING_MODE
+    if TRACKING_MODE == "servo":
+        parser.error("the servo mode runs on the device; replay with --mode world or image")
+    if not 0 < args.crop < 1:
+        parser.error("--crop must be between 0 and 1")
+    # The tracker sees through the simulated camera
+    CAMERA_FOV_H = replay.view_fov(args.scene_fov[0], args.crop)
+    CAMERA_FOV_V = replay.view_fov(args.scene_fov[1], args.crop)
+    replay.run(args, model, find_eye_center, track_frame, reset_tracker, pose)
+
+if __name__ == "__main__":
+    main()
\ No newline at end of file
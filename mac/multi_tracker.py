@@ -0,0 +1,254 @@
+import argparse
+import asyncio
+import os
+import threading
+import time
+
+import cv2
+import torch
+from bleak import BleakClient, BleakScanner
+
+import main
+from kalman import SubjectTracker
+from pose import PoseHistory
+
+# Several heads from one process. Each camera is read on its own thread,
+# which only keeps the newest frame; the detection loop takes the newest
+# frame of every camera that has a new one and runs them through the model
+# as one batch, so there is a single copy of the weights and one set of
+# inference threads across all the cores instead of a process per head
+# fighting over them. Each result goes back to its own head: its pose
+# history, subject tracker and BLE link are separate, as in main.py.
+#
+#   python multi_tracker.py --scan
+#   python multi_tracker.py --head 0 <address> --head 1 <address>
+#
+# Tracking is in the world frame, as main.py does by default.
+
+STATS_INTERVAL = 5.0  # Seconds between throughput reports
+
+class Camera:
+    """Reads a camera continuously, keeping only the newest frame"""
+
+    def __init__(self, index):
+        self.capture = cv2.VideoCapture(index)
+        if not self.capture.isOpened():
+            raise RuntimeError(f"Cannot open camera {index}")
+        self.lock = threading.Lock()
+        self.frame = None
+        self.capture_time = None
+        self.sequence = 0
+        self.running = True
+        self.thread = threading.Thread(target=self.run, daemon=True)
+        self.thread.start()
+
+    def run(self):
+        while self.running:
+            ret, frame = self.capture.read()
+            if not ret:
+                time.sleep(0.01)
+                continue
+            capture_time = time.monotonic() - main.CAMERA_LATENCY
+            with self.lock:
+                self.frame = frame
+                self.capture_time = capture_time
+                self.sequence += 1
+
+    def latest(self):
+        """(sequence, frame, capture time) of the newest frame"""
+        with self.lock:
+            return self.sequence, self.frame, self.capture_time
+
+    def close(self):
+        self.running = False
+        self.thread.join()
+        self.capture.release()
+
+class Head:
+    """One robot and the camera on it"""
+
+    def __init__(self, camera_index, address):
+        self.name = f"camera {camera_index}"
+        self.camera = Camera(camera_index)
+        self.address = address
+        self.device = None  # Cached after the first scan, as robot in main.py
+        self.client = None
+        self.link_lost_at = None
+        self.pose = PoseHistory()
+        self.tracker = SubjectTracker()
+        self.processed = 0  # Sequence of the last frame detected on
+        self.last_detection = 0.0  # time.monotonic() of the last batch it was in
+
+    def on_disconnect(self, _):
+        if self.link_lost_at is None:
+            self.link_lost_at = time.monotonic()
+
+    @property
+    def connected(self):
+        return self.client is not None and self.client.is_connected
+
+    async def connect(self):
+        """Connect and set up, retrying until it works; same sequence as main.connect_to_robot"""
+        delay = main.RECONNECT_FIRST_DELAY
+        while True:
+            try:
+                if self.device is None:
+                    self.device = await BleakScanner.find_device_by_address(self.address)
+                    if self.device is None:
+                        print(f"{self.name}: robot {self.address} not found, retrying...")
+                        await asyncio.sleep(main.RECONNECT_DELAY)
+                        continue
+                client = BleakClient(self.device, disconnected_callback=self.on_disconnect,
+                                     services=[main.SERVICE_UUID], timeout=main.CONNECT_TIMEOUT)
+                await client.connect()
+                await client.write_gatt_char(main.CONTROL_CHAR_UUID, b"claim,tracker", response=True)
+                if self.link_lost_at is None:
+                    self.pose.reset()
+                    self.tracker.reset()
+                    print(f"{self.name}: connected to {self.address}")
+                else:
+                    self.pose.resume()
+                    print(f"{self.name}: reconnected in {(time.monotonic() - self.link_lost_at) * 1000:.0f} ms")
+                await client.start_notify(main.POSE_CHAR_UUID, self.pose.on_notify)
+                self.link_lost_at = None
+                self.client = client
+                return
+            except Exception as e:
+                print(f"{self.name}: connection failed: {e}, retrying in {delay:.1f} seconds...")
+                await asyncio.sleep(delay)
+                delay = min(delay * 2, main.RECONNECT_DELAY)
+
+    async def keep_connected(self):
+        while True:
+            if not self.connected:
+                if self.client is not None:
+                    self.on_disconnect(self.client)
+                await self.connect()
+            await asyncio.sleep(0.05)
+
+    async def command(self, pan, tilt):
+        pan = max(min(pan, 90), -90)
+        tilt = max(min(tilt, 90), -90)
+        try:
+            await self.client.write_gatt_char(main.POSITION_CHAR_UUID, f"{pan:.2f},{tilt:.2f}".encode())
+        except Exception as e:
+            print(f"{self.name}: error sending data: {e}")
+
+    def close(self):
+        self.camera.close()
+
+def default_batch(heads):
+    """One frame per core: more cameras than cores are taken in turns"""
+    return max(1, min(heads, os.cpu_count() or 1))
+
+async def scan():
+    devices = await BleakScanner.discover(timeout=5.0)
+    robots = [d for d in devices if d.name == main.DEVICE_NAME]
+    for device in robots:
+        print(f"{device.address}  {device.name}")
+    if not robots:
+        print("No robots found")
+
+async def run(heads, batch, show):
+    loop = asyncio.get_running_loop()
+    tasks = [asyncio.create_task(head.keep_connected()) for head in heads]
+    interval = 1.0 / main.TARGET_FPS
+    next_turn = 0  # Where the next round starts when cameras outnumber the batch
+    frames = 0
+    batches = 0
+    inference = 0.0
+    stats_start = time.monotonic()
+    try:
+        while True:
+            # Newest unseen frame of each connected head that is due, up to
+            # one batch; every camera runs at TARGET_FPS at most
+            started = time.monotonic()
+            ready = []
+            for i in range(len(heads)):
+                head = heads[(next_turn + i) % len(heads)]
+                sequence, frame, capture_time = head.camera.latest()
+                if (head.connected and frame is not None and sequence != head.processed and
+                        started - head.last_detection >= interval):
+                    ready.append((head, sequence, frame, capture_time))
+                    if len(ready) == batch:
+                        break
+            next_turn = (next_turn + len(ready)) % len(heads)
+            if not ready:
+                await asyncio.sleep(0.005)
+                continue
+
+            # Off the event loop so pose notifications keep arriving meanwhile
+            inferred = time.perf_counter()
+            results = await loop.run_in_executor(
+                None, lambda: main.model.predict(source=[frame for _, _, frame, _ in ready], verbose=False))
+            inference += time.perf_counter() - inferred
+            frames += len(ready)
+            batches += 1
+
+            now = time.monotonic()
+            commands = []
+            for (head, sequence, frame, capture_time), result in zip(ready, results):
+                head.processed = sequence
+                head.last_detection = started
+                height, width = frame.shape[:2]
+                norm_x, norm_y = main.find_eye_center([result], width, height)
+                pan, tilt = main.get_world_target(norm_x, norm_y, capture_time, now, head.pose, head.tracker)
+                if pan is not None and tilt is not None:
+                    commands.append(head.command(pan, tilt))
+                if show:
+                    cv2.imshow(head.name, result.plot())
+            await asyncio.gather(*commands)
+
+            if show:
+                key = cv2.waitKey(1) & 0xFF
+                if key == ord('q') or key == 27:  # 'q' or ESC key
+                    return
+
+            elapsed = now - stats_start
+            if elapsed >= STATS_INTERVAL:
+                print(f"{frames / elapsed:.1f} frames/s over {len(heads)} cameras, "
+                      f"{frames / max(batches, 1):.1f} frames per batch, "
+                      f"{inference / max(batches, 1) * 1000:.0f} ms per batch")
+                frames = batches = 0
+                inference = 0.0
+                stats_start = now
+    finally:
+        for task in tasks:
+            task.cancel()
+        for head in heads:
+            if head.client is not None:
+                try:
+                    await head.client.disconnect()
+                except Exception:
+                    pass
+
+def parse_args():
+    parser = argparse.ArgumentParser(description="Track with several camera robots from one process")
+    parser.add_argument("--head", nargs=2, action="append", default=[], metavar=("CAMERA", "ADDRESS"),
+                        help="camera index and the BLE address of the robot it is mounted on")
+    parser.add_argument("--batch", type=int, help="frames per inference call (default: cameras, at most one per core)")
+    parser.add_argument("--show", action="store_true", help="display each camera with its detections")
+    parser.add_argument("--scan", action="store_true", help="list the robots in range and exit")
+    args = parser.parse_args()
+    if not args.scan and not args.head:
+        parser.error("give at least one --head, or --scan to find the robots")
+    if args.batch is not None and args.batch < 1:
+        parser.error("--batch must be at least 1")
+    return args
+
+if __name__ == "__main__":
+    args = parse_args()
+    if args.scan:
+        asyncio.run(scan())
+    else:
+        # One pool of inference threads over all the cores, shared by the batch
+        torch.set_num_threads(os.cpu_count() or 1)
+        heads = [Head(int(camera), address) for camera, address in args.head]
+        batch = args.batch or default_batch(len(heads))
+        print(f"{len(heads)} cameras, {batch} frames per inference call, {torch.get_num_threads()} threads")
+        try:
+            asyncio.run(run(heads, batch, args.show))
+        finally:
+            for head in heads:
+                head.close()
+            cv2.destroyAllWindows()
@@ -0,0 +1,115 @@
+import argparse
+import asyncio
+import binascii
+import random
+import struct
+import zlib
+from bleak import BleakClient, BleakScanner
+
+# Uploads a firmware image over the bulk transfer service (see include/bulk.h)
+# to one or more robots at once. Each device verifies the image, switches
+# partitions and restarts; a build that fails to boot rolls back by itself.
+# Build the image with `pio run` and pass .pio/build/<env>/firmware.bin.
+
+DEVICE_NAME = "CameraRobot"
+BULK_CONTROL_CHAR_UUID = "beb5483e-36e1-4688-b7f5-ea07361b26af"
+BULK_DATA_CHAR_UUID = "beb5483e-36e1-4688-b7f5-ea07361b26b0"
+SCAN_TIMEOUT = 5.0  # seconds to look for devices with --all
+ACK_TIMEOUT = 2.0  # seconds without an ack before resuming the transfer
+START_TIMEOUT = 30.0  # erasing the update partition can take a while
+MAX_RESUMES = 20
+
+class Transfer:
+    def __init__(self, name):
+        self.name = name
+        self.replies = asyncio.Queue()
+
+    def on_notify(self, _, data):
+        self.replies.put_nowait(data.decode().split(","))
+
+    async def reply(self, timeout):
+        return await asyncio.wait_for(self.replies.get(), timeout)
+
+    async def start(self, client, kind, image):
+        command = f"start,{kind},{len(image)},{zlib.crc32(image):08x}"
+        await client.write_gatt_char(BULK_CONTROL_CHAR_UUID, command.encode(), response=True)
+        while True:
+            fields = await self.reply(START_TIMEOUT)
+            if fields[0] == "ready":
+                return int(fields[1]), int(fields[2]), int(fields[3])
+            if fields[0] == "error":
+                raise RuntimeError(f"{self.name}: device refused transfer ({fields[1]})")
+
+    async def send(self, client, kind, image, loss):
+        chunk, window, offset = await self.start(client, kind, image)
+        acked = offset
+        resumes = 0
+        while True:
+            # Keep the window full; every write is without response
+            while offset < len(image) and offset - acked < window * chunk:
+                payload = image[offset:offset + chunk]
+                packet = struct.pack("<IH", offset, binascii.crc_hqx(payload, 0xFFFF)) + payload
+                if random.random() >= loss:  # --loss drops chunks to exercise recovery
+                    await client.write_gatt_char(BULK_DATA_CHAR_UUID, packet, response=False)
+                offset += len(payload)
+
+            try:
+                fields = await self.reply(ACK_TIMEOUT)
+            except asyncio.TimeoutError:
+                # Tail chunks lost, or the acks were: ask where the device is
+                resumes += 1
+                if resumes > MAX_RESUMES:
+                    raise RuntimeError(f"{self.name}: transfer stalled")
+                chunk, window, offset = await self.start(client, kind, image)
+                acked = offset
+                continue
+
+            if fields[0] == "ack":
+                acked = max(acked, int(fields[1]))
+                print(f"{self.name}: {100 * acked // len(image)}%", end="\r")
+            elif fields[0] == "nak":
+                acked = offset = int(fields[1])
+            elif fields[0] == "done":
+                return
+            elif fields[0] == "error":
+                raise RuntimeError(f"{self.name}: transfer failed ({fields[1]})")
+
+async def update(device, image, loss):
+    name = getattr(device, "address", device)
+    transfer = Transfer(name)
+    async with BleakClient(device) as client:
+        await client.start_notify(BULK_CONTROL_CHAR_UUID, transfer.on_notify)
+        start = asyncio.get_running_loop().time()
+        await transfer.send(client, "ota", image, loss)
+        elapsed = asyncio.get_running_loop().time() - start
+        print(f"{name}: {len(image)} bytes in {elapsed:.1f} s, device restarting")
+
+async def run(args):
+    with open(args.firmware, "rb") as f:
+        image = f.read()
+
+    devices = list(args.address or [])
+    if args.all or not devices:
+        found = await BleakScanner.discover(timeout=SCAN_TIMEOUT)
+        devices += [d for d in found if d.name == DEVICE_NAME]
+        if not args.all:
+            devices = devices[:1]
+    if not devices:
+        raise RuntimeError("Robot not found over BLE")
+
+    results = await asyncio.gather(*(update(d, image, args.loss) for d in devices), return_exceptions=True)
+    failed = [r for r in results if isinstance(r, Exception)]
+    for error in failed:
+        print(f"Failed: {error}")
+    print(f"Updated {len(devices) - len(failed)} of {len(devices)} devices")
+
+def main():
+    parser = argparse.ArgumentParser(description="Update CameraRobot firmware over BLE")
+    parser.add_argument("firmware", help="firmware.bin from the PlatformIO build")
+    parser.add_argument("--address", action="append", help="Update this BLE address, may be repeated")
+    parser.add_argument("--all", action="store_true", help="Update every robot in range in parallel")
+    parser.add_argument("--loss", type=float, default=0.0, help="Fraction of chunks to drop deliberately")
+    asyncio.run(run(parser.parse_args()))
+
+if __name__ == "__main__":
+    main()
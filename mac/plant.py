@@ -0,0 +1,120 @@
+import math
+
+# Simulated pan/tilt head for offline replays: a port of MotionAxis
+# (src/motion.cpp) with the firmware's gear ratios and default limits. Each
+# axis runs at the firmware's 1 kHz motion tick and reports whole steps, as
+# the pose notification does. Angles are in degrees with tilt positive down.
+
+STEPS_PER_REV = 200
+MICROSTEPS = 16
+GEAR_RATIO_TILT = 60.0 / 18.0  # Motor 1
+GEAR_RATIO_PAN = 170.0 / 18.0  # Motor 2
+STEPS_PER_DEGREE_TILT = STEPS_PER_REV * MICROSTEPS * GEAR_RATIO_TILT / 360.0
+STEPS_PER_DEGREE_PAN = STEPS_PER_REV * MICROSTEPS * GEAR_RATIO_PAN / 360.0
+DEFAULT_MAX_SPEED = 90  # Degrees per second
+DEFAULT_ACCELERATION = 180  # Degrees per second squared
+DEFAULT_JERK = 1800  # Degrees per second cubed, 0 for unlimited
+MAX_STEP_RATE = 20000  # Step pulses per second
+MOTION_UPDATE_INTERVAL = 0.001  # Seconds
+SETTLE_DISTANCE = 0.5  # Steps
+
+class MotionAxis:
+    """Jerk-limited trajectory generator in steps, replanned every tick"""
+
+    def __init__(self, velocity, acceleration, jerk):
+        self.velocity_limit = velocity
+        self.acceleration_limit = acceleration
+        self.jerk = jerk
+        self.position = 0.0
+        self.velocity = 0.0
+        self.acceleration = 0.0
+        self.target = 0
+        self.braking = False
+
+    def move_to(self, target):
+        self.target = target
+        self.braking = False
+
+    def stopping_distance(self, v, a):
+        max_accel = self.acceleration_limit
+        jerk = self.jerk
+        if jerk <= 0:
+            return v * v / (2 * max_accel)
+        distance = 0.0
+        if a > 0:
+            t = a / jerk
+            distance = v * t + 0.5 * a * t * t - jerk * t ** 3 / 6
+            v += a * a / (2 * jerk)
+        elif a < 0:
+            t = -a / jerk
+            v += a * a / (2 * jerk)
+            distance = -(v * t - jerk * t ** 3 / 6)
+        if v >= max_accel * max_accel / jerk:
+            distance += 0.5 * v * (v / max_accel + max_accel / jerk)
+        else:
+            distance += v * math.sqrt(v / jerk)
+        return distance
+
+    def update(self, dt):
+        error = self.target - self.position
+        direction = 1.0 if error >= 0 else -1.0
+        if abs(error) <= SETTLE_DISTANCE and abs(self.velocity) * dt <= SETTLE_DISTANCE:
+            self.position = float(self.target)
+            self.velocity = 0.0
+            self.acceleration = 0.0
+            self.braking = False
+            return
+
+        speed = self.velocity * direction
+        if speed <= 0:
+            self.braking = False
+        elif self.stopping_distance(speed, self.acceleration * direction) >= abs(error) - speed * dt:
+            self.braking = True
+        desired = 0.0 if self.braking else direction * self.velocity_limit
+
+        dv = desired - self.velocity
+        if self.jerk > 0:
+            wanted = min(math.sqrt(2 * self.jerk * abs(dv)), self.acceleration_limit)
+            if dv < 0:
+                wanted = -wanted
+            max_change = self.jerk * dt
+            accel = self.acceleration + max(-max_change, min(wanted - self.acceleration, max_change))
+        else:
+            accel = max(-self.acceleration_limit, min(dv / dt, self.acceleration_limit))
+
+        velocity = self.velocity + accel * dt
+        if (dv >= 0 and velocity > desired) or (dv <= 0 and velocity < desired):
+            velocity = desired
+            accel = (velocity - self.velocity) / dt
+
+        self.position += 0.5 * (self.velocity + velocity) * dt
+        self.velocity = velocity
+        self.acceleration = accel
+
+class Plant:
+    """Both axes driven by position commands, as the position characteristic does"""
+
+    def __init__(self, max_speed=DEFAULT_MAX_SPEED, acceleration=DEFAULT_ACCELERATION, jerk=DEFAULT_JERK):
+        self.axes = []
+        for steps_per_degree in (STEPS_PER_DEGREE_PAN, STEPS_PER_DEGREE_TILT):
+            velocity = min(max_speed, MAX_STEP_RATE / steps_per_degree)
+            self.axes.append((MotionAxis(velocity * steps_per_degree, acceleration * steps_per_degree,
+                                         jerk * steps_per_degree), steps_per_degree))
+        self.time = 0.0
+        self.commands = 0
+
+    def command(self, pan, tilt):
+        for (axis, steps_per_degree), degrees in zip(self.axes, (pan, tilt)):
+            axis.move_to(round(degrees * steps_per_degree))
+        self.commands += 1
+
+    def advance(self, until):
+        """Run motion ticks up to time until (seconds)"""
+        while self.time + MOTION_UPDATE_INTERVAL <= until:
+            for axis, _ in self.axes:
+                axis.update(MOTION_UPDATE_INTERVAL)
+            self.time += MOTION_UPDATE_INTERVAL
+
+    def pose(self):
+        """Pan and tilt in degrees from the whole step count"""
+        return tuple(round(axis.position) / steps_per_degree for axis, steps_per_degree in self.axes)
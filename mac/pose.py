@@ -0,0 +1,115 @@
+import math
+import time
+from collections import deque
+
+# Head pose on the host clock. The firmware notifies "micros,pan,tilt" on the
+# pose characteristic (POSE_CHAR_UUID in src/main.cpp); each report is mapped
+# onto time.monotonic() so a camera frame can be matched with where the head
+# was pointing when it was captured, and a detection turned into a bearing
+# that stays put however the head moves afterwards.
+
+POSE_HISTORY = 256  # Reports kept, about 5 s at the 20 ms pose rate
+CLOCK_CREEP = 20e-6  # Offset drift allowance per report, seconds
+MAX_EXTRAPOLATION = 0.1  # Furthest a pose is predicted past the newest report, seconds
+RESTART_SLACK = 1.0  # Clock mismatch after a reconnect that means the device restarted, seconds
+
+class ClockSync:
+    """Maps device micros() onto the host clock, the reverse of ClockSync in the firmware"""
+
+    def __init__(self):
+        self.reset()
+
+    def reset(self):
+        self.offset = None
+        self.last_micros = None
+        self.wraps = 0
+
+    def to_host(self, device_micros, now):
+        # micros() wraps every 71 minutes
+        if self.last_micros is not None and device_micros < self.last_micros - 2**31:
+            self.wraps += 1
+        self.last_micros = device_micros
+        device_time = (device_micros + self.wraps * 2**32) / 1e6
+
+        # The smallest delay seen is closest to the true offset; creep up so
+        # clock drift cannot strand the estimate
+        offset = now - device_time
+        if self.offset is None or offset < self.offset:
+            self.offset = offset
+        else:
+            self.offset += min(offset - self.offset, CLOCK_CREEP)
+        return device_time + self.offset
+
+    def continues(self, device_micros, now):
+        """Whether device_micros fits the current offset, i.e. the device kept running"""
+        if self.offset is None:
+            return True
+        wraps = self.wraps + (1 if device_micros < self.last_micros - 2**31 else 0)
+        device_time = (device_micros + wraps * 2**32) / 1e6
+        return abs(now - device_time - self.offset) < RESTART_SLACK
+
+class PoseHistory:
+    def __init__(self):
+        self.clock = ClockSync()
+        self.poses = deque(maxlen=POSE_HISTORY)  # (host time, pan, tilt)
+        self.resuming = False
+
+    def reset(self):
+        """Forget everything, e.g. when the device may have restarted"""
+        self.clock.reset()
+        self.poses.clear()
+        self.resuming = False
+
+    def resume(self):
+        """After a reconnect: keep the clock and history unless the first
+        report shows the device restarted meanwhile"""
+        self.resuming = True
+
+    def on_notify(self, _, data):
+        fields = data.decode().split(",")
+        self.add(int(fields[0]), float(fields[1]), float(fields[2]), time.monotonic())
+
+    def add(self, device_micros, pan, tilt, now):
+        if self.resuming:
+            self.resuming = False
+            if not self.clock.continues(device_micros, now):
+                self.reset()
+        self.poses.append((self.clock.to_host(device_micros, now), pan, tilt))
+
+    def latest(self):
+        return self.poses[-1][1:] if self.poses else None
+
+    def at(self, t):
+        """Pan and tilt at host time t, or None before the first report"""
+        if not self.poses:
+            return None
+        newest = self.poses[-1]
+        if t >= newest[0]:
+            # Newer than any report: carry on at the latest rate for a little while
+            if len(self.poses) < 2:
+                return newest[1:]
+            previous = self.poses[-2]
+            span = newest[0] - previous[0]
+            ahead = min(t - newest[0], MAX_EXTRAPOLATION)
+            if span <= 0:
+                return newest[1:]
+            return (newest[1] + (newest[1] - previous[1]) * ahead / span,
+                    newest[2] + (newest[2] - previous[2]) * ahead / span)
+
+        # Walk back to the pair around t
+        later = newest
+        for earlier in reversed(self.poses):
+            if earlier[0] <= t:
+                span = later[0] - earlier[0]
+                fraction = (t - earlier[0]) / span if span > 0 else 0.0
+                return (earlier[1] + (later[1] - earlier[1]) * fraction,
+                        earlier[2] + (later[2] - earlier[2]) * fraction)
+            later = earlier
+        return self.poses[0][1:]  # Older than the history; the oldest report is closest
+
+def image_to_bearing(norm_x, norm_y, pose, fov_h, fov_v):
+    """World-frame pan and tilt of a normalised image point seen from pose (degrees)"""
+    pan, tilt = pose
+    pan += math.degrees(math.atan(norm_x * math.tan(math.radians(fov_h / 2))))
+    tilt += math.degrees(math.atan(norm_y * math.tan(math.radians(fov_v / 2))))
+    return pan, tilt
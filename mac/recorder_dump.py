@@ -0,0 +1,139 @@
+import argparse
+import asyncio
+import csv
+import struct
+from bleak import BleakClient, BleakScanner
+
+# Downloads the firmware flight recorder (see include/recorder.h) and converts
+# it to CSV, or Parquet when pandas and pyarrow are installed.
+
+DEVICE_NAME = "CameraRobot"
+RECORDER_CHAR_UUID = "5b818d26-7c11-4f24-b87f-4f8a8cc974ee"
+RECORD_FORMAT = "<IBBHii"
+RECORD_SIZE = struct.calcsize(RECORD_FORMAT)
+END_OF_DOWNLOAD = 0xFFFFFFFF
+CHUNK_TIMEOUT = 5.0  # seconds without data before resuming the download
+
+RECORD_TYPES = ["command", "plan", "sample", "driver", "trigger", "load", "encoder"]
+COMMANDS = ["position", "jog", "zero"]
+PLANS = ["position", "jog"]
+TRIGGERS = ["manual", "driver_fault", "stall", "calibration", "step_loss"]
+COLUMNS = ["time_us", "type", "axis", "kind", "pan", "tilt", "target", "velocity", "max_speed",
+           "position", "speed", "drv_status", "load", "current_scale", "encoder"]
+
+def as_float(bits):
+    return struct.unpack("<f", struct.pack("<i", bits))[0]
+
+def name(table, index):
+    return table[index] if index < len(table) else str(index)
+
+def decode_record(record):
+    time_us, rtype, axis, flags, a, b = record
+    row = {"time_us": time_us, "type": name(RECORD_TYPES, rtype), "axis": axis}
+    if rtype == 0:
+        row.update(kind=name(COMMANDS, flags), pan=as_float(a), tilt=as_float(b))
+    elif rtype == 1:
+        row["kind"] = name(PLANS, flags)
+        if flags == 0:
+            row["target"] = a
+        else:
+            row["velocity"] = as_float(a)
+        row["max_speed"] = as_float(b)
+    elif rtype == 2:
+        row.update(position=a, speed=as_float(b))
+    elif rtype == 3:
+        row.update(drv_status=a & 0xFFFFFFFF, load=flags, current_scale=b)
+    elif rtype == 4:
+        row["kind"] = name(TRIGGERS, flags)
+    elif rtype == 5:
+        row["load"] = flags
+    elif rtype == 6:
+        row.update(encoder=a, position=b)
+    return row
+
+def parse_records(data):
+    usable = len(data) - len(data) % RECORD_SIZE
+    return [decode_record(r) for r in struct.iter_unpack(RECORD_FORMAT, data[:usable])]
+
+async def download(address=None):
+    if address:
+        device = address
+    else:
+        device = await BleakScanner.find_device_by_filter(lambda d, ad: d.name == DEVICE_NAME)
+        if not device:
+            raise RuntimeError("Robot not found over BLE")
+
+    chunks = {}
+    total = None
+    updated = asyncio.Event()
+
+    def on_notify(_, data):
+        nonlocal total
+        index = struct.unpack_from("<I", data)[0]
+        if index == END_OF_DOWNLOAD:
+            total = struct.unpack_from("<I", data, 4)[0]
+        else:
+            chunks[index] = bytes(data[4:])
+        updated.set()
+
+    async with BleakClient(device) as client:
+        await client.start_notify(RECORDER_CHAR_UUID, on_notify)
+        print((await client.read_gatt_char(RECORDER_CHAR_UUID)).decode())
+        await client.write_gatt_char(RECORDER_CHAR_UUID, b"dump", response=True)
+
+        while True:
+            updated.clear()
+            try:
+                await asyncio.wait_for(updated.wait(), CHUNK_TIMEOUT)
+            except asyncio.TimeoutError:
+                pass
+            else:
+                if total is None:
+                    continue
+
+            # Done, or stalled / ended with gaps: resume from the first missing chunk
+            received = sum(len(c) for c in chunks.values()) // RECORD_SIZE
+            if total is not None and received >= total:
+                break
+            missing = next(i for i in range(len(chunks) + 1) if i not in chunks)
+            print(f"Resuming download at chunk {missing} ({received} records so far)")
+            total = None
+            await client.write_gatt_char(RECORDER_CHAR_UUID, f"dump,{missing}".encode(), response=True)
+
+        await client.stop_notify(RECORDER_CHAR_UUID)
+
+    return b"".join(chunks[i] for i in sorted(chunks))
+
+def write_output(rows, path):
+    if path.endswith(".parquet"):
+        import pandas as pd
+        pd.DataFrame(rows, columns=COLUMNS).to_parquet(path, index=False)
+        return
+    with open(path, "w", newline="") as f:
+        writer = csv.DictWriter(f, fieldnames=COLUMNS)
+        writer.writeheader()
+        writer.writerows(rows)
+
+def main():
+    parser = argparse.ArgumentParser(description="Download and convert the CameraRobot flight recorder")
+    parser.add_argument("output", help="Output file, .csv or .parquet")
+    parser.add_argument("--address", help="Connect to this BLE address instead of scanning")
+    parser.add_argument("--raw", help="Also save the raw download to this file")
+    parser.add_argument("--input", help="Convert a previously saved raw download instead of connecting")
+    args = parser.parse_args()
+
+    if args.input:
+        with open(args.input, "rb") as f:
+            data = f.read()
+    else:
+        data = asyncio.run(download(args.address))
+        if args.raw:
+            with open(args.raw, "wb") as f:
+                f.write(data)
+
+    rows = parse_records(data)
+    write_output(rows, args.output)
+    print(f"Wrote {len(rows)} records to {args.output}")
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,281 @@
+import json
+import math
+import time
+from collections import deque
+
+import cv2
+import numpy as np
+
+from plant import Plant
+
+# Offline tracking benchmark. Recorded video stands in for the scene: a
+# virtual camera looks at a window of each frame that follows the simulated
+# head, so the tracker's own motion changes what it sees, as it does live.
+# Frames are taken at the tracker's frame rate in video time and processed
+# as fast as the host allows; all timing inside the simulation is video time,
+# so a replay gives the same result on any machine apart from the
+# throughput figures.
+
+POSE_INTERVAL = 0.02  # Firmware pose notification period, seconds
+POSE_DELAY = 0.01  # Notification to host
+WRITE_DELAY = 0.015  # Position write to the motion tick
+INFERENCE_TIME = 0.04  # Simulated detection time; the real time is reported separately
+ACQUIRE_ERROR = 2.0  # Centring error in degrees counted as acquired
+LOST_FRAMES = 5  # Frames without a detection before the subject counts as lost
+OVERSHOOT_DEADBAND = 0.5  # Degrees past centre ignored as noise
+
+STAGES = ("decode", "view", "inference", "track", "plant")
+
+def view_fov(scene_fov, crop):
+    """Field of view of a window covering crop of the scene frame (degrees)"""
+    return math.degrees(2 * math.atan(crop * math.tan(math.radians(scene_fov / 2))))
+
+class VirtualCamera:
+    """Window onto a scene frame, centred where the head points (pinhole model)"""
+
+    def __init__(self, scene_fov_h, scene_fov_v, crop):
+        self.tan_h = math.tan(math.radians(scene_fov_h / 2))
+        self.tan_v = math.tan(math.radians(scene_fov_v / 2))
+        self.crop = crop
+
+    def view(self, frame, pan, tilt):
+        height, width = frame.shape[:2]
+        view_width = int(width * self.crop)
+        view_height = int(height * self.crop)
+        cx = width / 2 * (1 + math.tan(math.radians(pan)) / self.tan_h)
+        cy = height / 2 * (1 + math.tan(math.radians(tilt)) / self.tan_v)
+        shift = np.float32([[1, 0, view_width / 2 - cx], [0, 1, view_height / 2 - cy]])
+        # Beyond the recorded scene the view is black, so the subject is lost
+        return cv2.warpAffine(frame, shift, (view_width, view_height), borderMode=cv2.BORDER_CONSTANT)
+
+class Metrics:
+    def __init__(self, fov_h, fov_v):
+        self.tan_h = math.tan(math.radians(fov_h / 2))
+        self.tan_v = math.tan(math.radians(fov_v / 2))
+        self.errors = []
+        self.frames = 0
+        self.missed = 0
+        self.acquire_times = []
+        self.overshoots = []
+        self.commands = 0
+        self.duration = 0.0
+        self.reset()
+
+    def reset(self):
+        """Start of a video: nothing seen yet"""
+        self.seen = False
+        self.misses = LOST_FRAMES
+        self.acquiring_since = None
+        self.last_sign = [0, 0]
+        self.crossed = [False, False]  # Error changed sign; peak is the swing past centre
+        self.peak = [0.0, 0.0]
+
+    def finish(self):
+        """End of a video: count any swing past centre still in progress"""
+        for axis in range(2):
+            if self.crossed[axis]:
+                self.overshoots.append(self.peak[axis])
+
+    def add(self, t, norm_x, norm_y):
+        self.frames += 1
+        if norm_x is None:
+            if self.seen:
+                self.missed += 1
+            self.misses += 1
+            if self.misses >= LOST_FRAMES:
+                self.acquiring_since = None
+            return
+
+        if self.misses >= LOST_FRAMES:
+            self.acquiring_since = t  # Found again (or for the first time)
+            self.finish()
+            self.last_sign = [0, 0]
+            self.crossed = [False, False]
+        self.seen = True
+        self.misses = 0
+
+        error = (math.degrees(math.atan(norm_x * self.tan_h)), math.degrees(math.atan(norm_y * self.tan_v)))
+        magnitude = math.hypot(*error)
+        self.errors.append(magnitude)
+        if self.acquiring_since is not None and magnitude < ACQUIRE_ERROR:
+            self.acquire_times.append(t - self.acquiring_since)
+            self.acquiring_since = None
+
+        # Overshoot: the furthest the head swings past the subject when the
+        # error changes sign without settling first, per axis. A subject that
+        # jumps while the head is centred does not count.
+        for axis, e in enumerate(error):
+            sign = 0 if abs(e) < OVERSHOOT_DEADBAND else (1 if e > 0 else -1)
+            if sign == 0:
+                if self.crossed[axis]:
+                    self.overshoots.append(self.peak[axis])
+                self.crossed[axis] = False
+                self.last_sign[axis] = 0
+                continue
+            if sign != self.last_sign[axis]:
+                if self.crossed[axis]:
+                    self.overshoots.append(self.peak[axis])
+                self.crossed[axis] = self.last_sign[axis] != 0
+                self.peak[axis] = 0.0
+                self.last_sign[axis] = sign
+            if self.crossed[axis]:
+                self.peak[axis] = max(self.peak[axis], abs(e))
+
+    def summary(self):
+        errors = np.array(self.errors) if self.errors else np.zeros(1)
+        return {
+            "frames": self.frames,
+            "detected": len(self.errors),
+            "lost_percent": 100.0 * self.missed / max(self.frames, 1),
+            "error_mean": float(errors.mean()),
+            "error_median": float(np.median(errors)),
+            "error_p95": float(np.percentile(errors, 95)),
+            "overshoot_max": max(self.overshoots, default=0.0),
+            "overshoot_mean": float(np.mean(self.overshoots)) if self.overshoots else 0.0,
+            "acquisitions": len(self.acquire_times),
+            "acquire_mean": float(np.mean(self.acquire_times)) if self.acquire_times else None,
+            "acquire_max": max(self.acquire_times, default=None),
+            "command_rate": self.commands / self.duration if self.duration > 0 else 0.0,
+        }
+
+class Simulation:
+    """The simulated head and the BLE link to it, in video time"""
+
+    def __init__(self, pose_history):
+        self.plant = Plant()
+        self.pose = pose_history
+        self.next_pose = 0.0
+        self.pending = deque()  # (arrival time, pan, tilt)
+        self.reports = deque()  # Pose notifications in flight, (sample time, pan, tilt)
+
+    def command(self, at, pan, tilt):
+        self.pending.append((at + WRITE_DELAY, pan, tilt))
+
+    def advance(self, until):
+        """Run the head up to until, delivering commands and pose reports on the way"""
+        while True:
+            step = until
+            if self.pending:
+                step = min(step, self.pending[0][0])
+            step = min(step, self.next_pose)
+            self.plant.advance(step)
+            if self.pending and self.pending[0][0] <= step:
+                _, pan, tilt = self.pending.popleft()
+                self.plant.command(pan, tilt)
+            if self.next_pose <= step:
+                self.reports.append((self.next_pose, *self.plant.pose()))
+                self.next_pose += POSE_INTERVAL
+            while self.reports and self.reports[0][0] + POSE_DELAY <= step:
+                sampled, pan, tilt = self.reports.popleft()
+                self.pose.add(int(sampled * 1e6) & 0xFFFFFFFF, pan, tilt, sampled + POSE_DELAY)
+            if step >= until:
+                return
+
+def replay(path, args, model, detect, track, metrics, pose_history):
+    """Run the tracker over one video; returns the per-stage time totals and the video length"""
+    capture = cv2.VideoCapture(path)
+    if not capture.isOpened():
+        raise RuntimeError(f"Cannot open {path}")
+    fps = capture.get(cv2.CAP_PROP_FPS) or 30.0
+    camera = VirtualCamera(args.scene_fov[0], args.scene_fov[1], args.crop)
+    sim = Simulation(pose_history)
+    stages = dict.fromkeys(STAGES, 0.0)
+    interval = 1.0 / args.fps
+    next_frame = 0.0
+    index = 0
+    t = 0.0
+    while True:
+        started = time.perf_counter()
+        if not capture.grab():
+            break
+        t = index / fps
+        index += 1
+        if t + 1e-9 < next_frame:
+            stages["decode"] += time.perf_counter() - started
+            continue
+        next_frame += interval
+        _, frame = capture.retrieve()
+        stages["decode"] += time.perf_counter() - started
+
+        started = time.perf_counter()
+        sim.advance(t)
+        stages["plant"] += time.perf_counter() - started
+
+        started = time.perf_counter()
+        view = camera.view(frame, *sim.plant.pose())
+        stages["view"] += time.perf_counter() - started
+
+        started = time.perf_counter()
+        results = model.predict(source=view, verbose=False)
+        stages["inference"] += time.perf_counter() - started
+
+        # The tracker decides once the frame has arrived and been through
+        # detection; the head moves on meanwhile
+        decided = t + args.latency + INFERENCE_TIME
+        started = time.perf_counter()
+        sim.advance(decided)
+        stages["plant"] += time.perf_counter() - started
+
+        started = time.perf_counter()
+        height, width = view.shape[:2]
+        norm_x, norm_y = detect(results, width, height)
+        metrics.add(t, norm_x, norm_y)
+        pan, tilt = track(results, width, height, t, decided)
+        if pan is not None and tilt is not None:
+            sim.command(decided, max(min(pan, 90), -90), max(min(tilt, 90), -90))
+        stages["track"] += time.perf_counter() - started
+
+        if args.show:
+            cv2.imshow("Replay", view)
+            if cv2.waitKey(1) & 0xFF in (ord("q"), 27):
+                break
+
+    capture.release()
+    metrics.finish()
+    metrics.commands += sim.plant.commands
+    metrics.duration += t
+    return stages, t
+
+def run(args, model, detect, track, reset, pose_history):
+    fov_h = view_fov(args.scene_fov[0], args.crop)
+    fov_v = view_fov(args.scene_fov[1], args.crop)
+    metrics = Metrics(fov_h, fov_v)
+    totals = dict.fromkeys(STAGES, 0.0)
+    video_time = 0.0
+    processed = 0
+    wall_start = time.perf_counter()
+    for path in args.replay:
+        reset()
+        metrics.reset()
+        frames_before = metrics.frames
+        stages, length = replay(path, args, model, detect, track, metrics, pose_history)
+        for stage, seconds in stages.items():
+            totals[stage] += seconds
+        video_time += length
+        processed += metrics.frames - frames_before
+        print(f"{path}: {metrics.frames - frames_before} frames, {length:.1f} s")
+    wall = time.perf_counter() - wall_start
+
+    summary = metrics.summary()
+    print(f"\nView {fov_h:.1f} x {fov_v:.1f} deg, {args.fps} fps, latency {args.latency * 1000:.0f} ms")
+    print(f"Centring error   mean {summary['error_mean']:.2f}  median {summary['error_median']:.2f}  "
+          f"p95 {summary['error_p95']:.2f} deg")
+    print(f"Overshoot        mean {summary['overshoot_mean']:.2f}  max {summary['overshoot_max']:.2f} deg")
+    if summary["acquisitions"]:
+        print(f"Time to acquire  mean {summary['acquire_mean']:.2f}  max {summary['acquire_max']:.2f} s "
+              f"({summary['acquisitions']} acquisitions)")
+    else:
+        print("Time to acquire  never acquired")
+    print(f"Subject lost     {summary['lost_percent']:.1f}% of frames")
+    print(f"Command rate     {summary['command_rate']:.1f} /s")
+    print(f"\nThroughput: {processed / wall:.1f} frames/s, {video_time / wall:.1f}x real time")
+    for stage in STAGES:
+        per_frame = totals[stage] / max(processed, 1)
+        rate = 1.0 / per_frame if per_frame > 0 else float("inf")
+        print(f"  {stage:<10} {per_frame * 1000:8.2f} ms/frame {rate:10.1f} frames/s")
+
+    if args.json:
+        summary["stages_ms"] = {stage: totals[stage] / max(processed, 1) * 1000 for stage in STAGES}
+        summary["frames_per_second"] = processed / wall
+        with open(args.json, "w") as f:
+            json.dump(summary, f, indent=2)
@@ -0,0 +1,79 @@
+import argparse
+import csv
+import numpy as np
+
+# Estimates an axis resonance from a calibration capture and suggests input
+# shaper settings. Run a calibration first ("calibrate,pan" on the shaper
+# characteristic), download it with recorder_dump.py to CSV and pass the file
+# here. The StallGuard load after the calibration trigger rings at the
+# mechanical resonance; the FFT peak gives the frequency and the decay of
+# successive peaks gives the damping ratio.
+
+AXES = {"tilt": 1, "pan": 2}
+RESAMPLE_RATE = 200.0  # Hz, matches the firmware load sampling interval
+MIN_FREQUENCY = 1.0  # Hz, ignore slow drift below this
+MAX_FREQUENCY = 60.0  # Hz
+
+def load_capture(path, axis):
+    trigger_time = None
+    times, loads = [], []
+    with open(path, newline="") as f:
+        for row in csv.DictReader(f):
+            if row["type"] == "trigger" and row["kind"] == "calibration":
+                trigger_time = int(row["time_us"])
+            elif row["type"] == "load" and int(row["axis"]) == axis:
+                times.append(int(row["time_us"]))
+                loads.append(float(row["load"]))
+    if trigger_time is None:
+        raise RuntimeError("No calibration trigger in capture")
+    times = np.array(times)
+    keep = times >= trigger_time
+    if keep.sum() < 32:
+        raise RuntimeError("Too few load samples after the calibration trigger")
+    return (times[keep] - trigger_time) / 1e6, np.array(loads)[keep]
+
+def estimate(t, load):
+    # Resample to a uniform grid; the firmware samples from a FreeRTOS task so
+    # the spacing jitters by a tick
+    grid = np.arange(t[0], t[-1], 1.0 / RESAMPLE_RATE)
+    signal = np.interp(grid, t, load)
+    signal -= signal.mean()
+
+    spectrum = np.abs(np.fft.rfft(signal * np.hanning(len(signal))))
+    freqs = np.fft.rfftfreq(len(signal), 1.0 / RESAMPLE_RATE)
+    band = (freqs >= MIN_FREQUENCY) & (freqs <= MAX_FREQUENCY)
+    peak = np.argmax(np.where(band, spectrum, 0))
+    # Parabolic interpolation between bins
+    if 0 < peak < len(spectrum) - 1:
+        a, b, c = spectrum[peak - 1:peak + 2]
+        offset = 0.5 * (a - c) / (a - 2 * b + c)
+    else:
+        offset = 0.0
+    frequency = (peak + offset) * RESAMPLE_RATE / len(signal)
+
+    # Logarithmic decrement over the positive peaks, one per period
+    period = int(round(RESAMPLE_RATE / frequency))
+    peaks = [signal[i:i + period].max() for i in range(0, len(signal) - period, period)]
+    peaks = [p for p in peaks if p > 0]
+    damping = 0.05
+    if len(peaks) >= 3:
+        delta = np.log(peaks[0] / peaks[-1]) / (len(peaks) - 1)
+        if delta > 0:
+            damping = delta / np.sqrt(4 * np.pi ** 2 + delta ** 2)
+    return frequency, min(damping, 0.5)
+
+def main():
+    parser = argparse.ArgumentParser(description="Suggest input shaper settings from a calibration capture")
+    parser.add_argument("capture", help="CSV written by recorder_dump.py")
+    parser.add_argument("axis", choices=AXES.keys())
+    parser.add_argument("--shaper", default="zvd", choices=["zv", "zvd", "ei"],
+                        help="zv is fastest, zvd and ei tolerate frequency error better")
+    args = parser.parse_args()
+
+    t, load = load_capture(args.capture, AXES[args.axis])
+    frequency, damping = estimate(t, load)
+    print(f"Resonance {frequency:.2f} Hz, damping ratio {damping:.3f}")
+    print(f"Write to the shaper characteristic: {args.axis},{args.shaper},{frequency:.2f},{damping:.3f}")
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,122 @@
+import argparse
+import csv
+import math
+
+import numpy as np
+
+from kalman import SubjectTracker, MEASUREMENT_NOISE, PROCESS_NOISE
+from pose import image_to_bearing
+
+# Tunes the subject tracker (kalman.py) on detection traces recorded with
+# main.py --trace, live or from a replay. After each detection the tracker
+# predicts the bearing one horizon later, as the live tracker does for its
+# command, and the prediction is checked against where the subject turned
+# out to be: the later detections interpolated to that time. The detection
+# noise is in every score alike, so compare the numbers, not their absolute
+# size.
+# Traces recorded without the pose characteristic (image mode) are taken as
+# from a fixed camera.
+
+HORIZON = 0.105  # Capture to command taking effect: camera, detection and BLE write, seconds
+MAX_GAP = 0.5  # Longest gap between detections interpolated across for the truth, seconds
+PROCESS_NOISES = (25, 50, 100, 200, 400, 800, 1600, 3200)
+MEASUREMENT_NOISES = (0.25, 0.5, 1.0, 2.0)
+
+def load_trace(path):
+    """Detections as (capture time, (pan, tilt) bearing)"""
+    detections = []
+    with open(path, newline="") as f:
+        for row in csv.DictReader(f):
+            if not row["norm_x"]:
+                continue
+            head = (float(row["pan"]), float(row["tilt"])) if row["pan"] else (0.0, 0.0)
+            bearing = image_to_bearing(float(row["norm_x"]), float(row["norm_y"]), head,
+                                       float(row["fov_h"]), float(row["fov_v"]))
+            detections.append((float(row["time"]), bearing))
+    return detections
+
+class LegacySmoother:
+    """The filter the tracker used before: a 5-frame moving average, then a
+    quarter of the remaining distance per frame"""
+
+    def __init__(self):
+        self.history = []
+        self.output = None
+
+    def update(self, t, measurement):
+        self.history = (self.history + [measurement])[-5:]
+        average = np.mean(self.history, axis=0)
+        if self.output is None:
+            self.output = np.zeros(2)
+        self.output = self.output + 0.25 * (average - self.output)
+
+    def predict(self, t):
+        return None if self.output is None else tuple(self.output)
+
+def score(detections, make, horizon):
+    """RMS prediction error and RMS frame-to-frame change of the target (degrees)"""
+    estimator = make()
+    errors = []
+    targets = []
+    later = 0
+    for t, bearing in detections:
+        estimator.update(t, bearing)
+        predicted = estimator.predict(t + horizon)
+        if predicted is None:
+            continue
+        targets.append(predicted)
+
+        # Truth at t + horizon from the detections either side
+        while later < len(detections) and detections[later][0] < t + horizon:
+            later += 1
+        if later == 0 or later == len(detections):
+            continue
+        (t0, b0), (t1, b1) = detections[later - 1], detections[later]
+        if t1 - t0 > MAX_GAP:
+            continue
+        f = (t + horizon - t0) / (t1 - t0)
+        truth = (b0[0] + f * (b1[0] - b0[0]), b0[1] + f * (b1[1] - b0[1]))
+        errors.append(math.hypot(predicted[0] - truth[0], predicted[1] - truth[1]))
+    if not errors:
+        return float("inf"), 0.0
+    steps = np.diff(np.array(targets), axis=0)
+    jitter = float(np.sqrt((steps ** 2).sum(axis=1).mean())) if len(steps) else 0.0
+    return float(np.sqrt(np.mean(np.square(errors)))), jitter
+
+def main():
+    parser = argparse.ArgumentParser(description="Tune the subject tracker on recorded detection traces")
+    parser.add_argument("traces", nargs="+", help="CSV files from main.py --trace")
+    parser.add_argument("--horizon", type=float, default=HORIZON, help="prediction horizon in seconds")
+    args = parser.parse_args()
+
+    traces = [load_trace(path) for path in args.traces]
+    detections = sum(len(trace) for trace in traces)
+    if detections < 20:
+        parser.error("too few detections to tune on")
+    print(f"{detections} detections in {len(traces)} traces, horizon {args.horizon * 1000:.0f} ms\n")
+
+    def evaluate(make):
+        results = [score(trace, make, args.horizon) for trace in traces]
+        weights = [len(trace) for trace in traces]
+        error = math.sqrt(np.average([r[0] ** 2 for r in results], weights=weights))
+        jitter = math.sqrt(np.average([r[1] ** 2 for r in results], weights=weights))
+        return error, jitter
+
+    error, jitter = evaluate(LegacySmoother)
+    print(f"{'legacy smoother':<24} error {error:6.2f}  jitter {jitter:6.2f}")
+    error, jitter = evaluate(SubjectTracker)
+    print(f"{'current settings':<24} error {error:6.2f}  jitter {jitter:6.2f}  "
+          f"(q {PROCESS_NOISE:g}, r {MEASUREMENT_NOISE:g})\n")
+
+    grid = []
+    for q in PROCESS_NOISES:
+        for r in MEASUREMENT_NOISES:
+            error, jitter = evaluate(lambda: SubjectTracker(q, r))
+            grid.append((error, jitter, q, r))
+    grid.sort()
+    print("Best settings by prediction error:")
+    for error, jitter, q, r in grid[:5]:
+        print(f"  PROCESS_NOISE = {q:<6g} MEASUREMENT_NOISE = {r:<5g} error {error:6.2f}  jitter {jitter:6.2f}")
+
+if __name__ == "__main__":
+    main()
@@ -1,3 +1,4 @@
+import 'dart:async';
 import 'package:flutter/material.dart';
 import 'package:flutter_blue_plus/flutter_blue_plus.dart';
 import 'dart:convert';
@@ -18,9 +19,18 @@ class _CameraRobotScreenState extends State<CameraRobotScreen> {
   BluetoothCharacteristic? _positionCharacteristic;
   BluetoothCharacteristic? _zeroCharacteristic;
   BluetoothCharacteristic? _statusCharacteristic;
+  BluetoothCharacteristic? _controlCharacteristic;
   bool _isConnected = false;
   DateTime _lastPositionUpdate = DateTime.now();
 
+  // Reconnect state: the device object keeps the robot's address, so a
+  // dropped link is re-established directly, without scanning
+  StreamSubscription<BluetoothConnectionState>? _connectionSubscription;
+  DateTime? _linkLostAt;
+  bool _reconnecting = false;
+  bool _leaving = false;
+  static const Duration _controlLease = Duration(seconds: 3); // CONTROL_LEASE in the firmware
+
   // Touch interface state
   final double _maxAngle = 45.0; // Maximum pan/tilt angle in degrees
   Offset? _lastTouchPosition;
@@ -52,12 +62,14 @@ class _CameraRobotScreenState extends State<CameraRobotScreen> {
             } else if (characteristic.uuid.toString() ==
                 "beb5483e-36e1-4688-b7f5-ea07361b26aa") {
               _zeroCharacteristic = characteristic;
+            } else if (characteristic.uuid.toString() ==
+                "beb5483e-36e1-4688-b7f5-ea07361b26b4") {
+              _controlCharacteristic = characteristic;
             } else if (characteristic.uuid.toString() ==
                 "5b818d26-7c11-4f24-b87f-4f8a8cc974eb") {
               _statusCharacteristic = characteristic;
-              await characteristic.setNotifyValue(true);
               characteristic.value.listen((value) {
-                if (value.isNotEmpty) {
+                if (value.isNotEmpty && mounted) {
                   setState(() => _status = utf8.decode(value));
                 }
               });
@@ -65,13 +77,71 @@ class _CameraRobotScreenState extends State<CameraRobotScreen> {
           }
         }
       }
+      await _resync();
 
+      _connectionSubscription = widget.device.connectionState.listen((state) {
+        if (state == BluetoothConnectionState.disconnected && _isConnected && !_leaving) {
+          _linkLostAt = DateTime.now();
+          setState(() {
+            _isConnected = false;
+            _status = "Link lost, reconnecting...";
+          });
+          _reconnect();
+        }
+      });
       setState(() => _isConnected = true);
     } catch (e) {
       setState(() => _status = "Error: ${e.toString()}");
     }
   }
 
+  // Per-connection setup, on the first connection and after every reconnect
+  Future<void> _resync() async {
+    // Take priority over an automatic tracker on the same robot; the robot
+    // also remembers the role across a quick reconnect
+    await _controlCharacteristic?.write(utf8.encode("claim,operator"));
+    await _statusCharacteristic?.setNotifyValue(true);
+  }
+
+  Future<void> _reconnect() async {
+    if (_reconnecting) return;
+    _reconnecting = true;
+    var delay = const Duration(milliseconds: 100);
+    while (!_leaving) {
+      try {
+        await widget.device.connect(timeout: const Duration(seconds: 5));
+        // The characteristics found on the first connection are kept; the
+        // platform still wants discovery on a new link, but answers it from
+        // its own GATT cache
+        await widget.device.discoverServices();
+        await _resync();
+        final elapsed = DateTime.now().difference(_linkLostAt!).inMilliseconds;
+        // Resend the target only if the operator was steering when the link
+        // dropped; otherwise leave the robot to the tracker. Nothing is
+        // re-zeroed: the robot kept its position.
+        final wasSteering =
+            _linkLostAt!.difference(_lastPositionUpdate) < _controlLease;
+        setState(() {
+          _isConnected = true;
+          _status = "Reconnected in $elapsed ms";
+        });
+        if (wasSteering) {
+          _pendingPan = _position2;
+          _pendingTilt = _position1;
+          _hasPendingUpdate = true;
+          _sendPositionUpdate();
+        }
+        break;
+      } catch (e) {
+        if (!mounted) break;
+        setState(() => _status = "Reconnecting... (${e.toString()})");
+        await Future.delayed(delay);
+        if (delay < const Duration(seconds: 2)) delay *= 2;
+      }
+    }
+    _reconnecting = false;
+  }
+
   void _setPositions(double pan, double tilt) {
     // Always update the pending positions with the latest values
     _pendingPan = pan.clamp(-_maxAngle, _maxAngle);
@@ -419,6 +489,8 @@ class _CameraRobotScreenState extends State<CameraRobotScreen> {
   @override
   void dispose() {
     _setPositions(0, 0); // Return to zero when leaving screen
+    _leaving = true;
+    _connectionSubscription?.cancel();
     widget.device.disconnect();
     super.dispose();
   }
@@ -0,0 +1,105 @@
+#include <math.h>
+#include "autotune.h"
+
+#define MIN_BASELINE_LOAD 20  // Below this StallGuard isn't giving usable readings
+#define RAMP_TRAVEL_FRACTION 0.8f  // Most a trial spends ramping up and down, the rest cruises
+
+AutoTuner::AutoTuner(const TuneConfig& config)
+    : _config(config), _phase(TUNE_DONE), _trialVelocity(0), _trialAcceleration(0),
+      _baseline(0), _velocityPass(0), _accelerationPass(0), _fail(0), _refinements(0),
+      _samples(0), _loadSum(0), _minLoad(0xFFFF) {
+}
+
+void AutoTuner::start() {
+    _phase = TUNE_BASELINE;
+    _trialVelocity = _config.startVelocity;
+    _trialAcceleration = _config.startAcceleration;
+    _velocityPass = _config.startVelocity;
+    _accelerationPass = _config.startAcceleration;
+    _fail = 0;
+    _refinements = 0;
+    _samples = 0;
+    _loadSum = 0;
+    _minLoad = 0xFFFF;
+}
+
+void AutoTuner::addSample(uint16_t load) {
+    _samples++;
+    _loadSum += load;
+    if (load < _minLoad) {
+        _minLoad = load;
+    }
+}
+
+void AutoTuner::finishTrial() {
+    if (_phase == TUNE_BASELINE) {
+        _baseline = _samples ? (float)_loadSum / _samples : 0;
+        if (_baseline < MIN_BASELINE_LOAD) {
+            _phase = TUNE_FAILED;
+            return;
+        }
+        _phase = TUNE_ACCELERATION;
+    } else if (_phase == TUNE_VELOCITY || _phase == TUNE_ACCELERATION) {
+        // A trial that never reached its tested state proves nothing, treat it as a failure
+        bool stalled = _samples == 0 || _minLoad < _baseline * _config.stallFraction;
+        float tested = _phase == TUNE_VELOCITY ? _trialVelocity : _trialAcceleration;
+        float& pass = _phase == TUNE_VELOCITY ? _velocityPass : _accelerationPass;
+        if (stalled) {
+            _fail = tested;
+        } else {
+            pass = tested;
+        }
+        if (_fail > 0) {
+            _refinements++;
+        }
+    }
+
+    _samples = 0;
+    _loadSum = 0;
+    _minLoad = 0xFFFF;
+    nextTrial();
+}
+
+// Fastest speed a trial move ramping at this acceleration reaches with some cruise left
+float AutoTuner::reachableVelocity(float acceleration) const {
+    float reachable = sqrtf(RAMP_TRAVEL_FRACTION * acceleration * _config.travel);
+    return reachable < _config.maxVelocity ? reachable : _config.maxVelocity;
+}
+
+void AutoTuner::nextTrial() {
+    if (_phase == TUNE_ACCELERATION) {
+        float next = _fail > 0 ? 0.5f * (_accelerationPass + _fail) : _accelerationPass * _config.growth;
+        if (next > _config.maxAcceleration) {
+            next = _config.maxAcceleration;
+        }
+        if (_refinements > _config.refineSteps || next <= _accelerationPass) {
+            // Acceleration found; now push the speed, ramping at a rate we know is safe
+            _phase = TUNE_VELOCITY;
+            _fail = 0;
+            _refinements = 0;
+            _trialAcceleration = acceleration();
+        } else {
+            // Ramp for rampTime, but never slower than the baseline
+            float ramp = next * _config.rampTime;
+            _trialAcceleration = next;
+            _trialVelocity = reachableVelocity(next);
+            if (ramp < _trialVelocity) {
+                _trialVelocity = ramp > _config.startVelocity ? ramp : _config.startVelocity;
+            }
+            return;
+        }
+    }
+
+    if (_phase == TUNE_VELOCITY) {
+        float next = _fail > 0 ? 0.5f * (_velocityPass + _fail) : _velocityPass * _config.growth;
+        float reachable = reachableVelocity(_trialAcceleration);
+        if (next > reachable) {
+            next = reachable;
+        }
+        if (_refinements > _config.refineSteps || next <= _velocityPass) {
+            _phase = TUNE_DONE;
+        } else {
+            _trialVelocity = next;
+        }
+    }
+}
@@ -0,0 +1,384 @@
+#ifdef BENCH_ENABLED
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include "bench.h"
+#include "command.h"
+#include "motion.h"
+#include "servo.h"
+#include "shaper.h"
+#include "vision.h"
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#include <esp_heap_caps.h>
+#include "recorder.h"
+#else
+#include <atomic>
+#include <chrono>
+#endif
+
+// Tilt axis geometry and tuning, as in main.cpp
+#define STEPS_PER_DEGREE (200 * 16 * (60.0 / 18.0) / 360.0)
+#define MOTION_TICK 0.001f  // Seconds per motion update
+#define POSITION_GAIN 50.0f
+#define SERVO_MEASURE_TICKS 33  // Motion ticks per camera frame
+#define INPUT_COUNT 16  // Inputs cycled through so nothing is constant-folded
+
+// Iterations per run. Motion cases run 4 s of ticks, two full moves, so
+// every run covers the same phases of the profile.
+#define PARSE_ITERATIONS 1000
+#define ARITHMETIC_ITERATIONS 10000
+#define TICK_ITERATIONS 4000
+#define HANDOFF_ITERATIONS 10000
+#define FRAME_ITERATIONS 4  // Whole frames through a vision kernel
+
+// Vision scene: a skin-toned face on a shaded background at the QVGA
+// capture size the Sense camera delivers
+#define CAPTURE_WIDTH (2 * VISION_WIDTH)
+#define CAPTURE_HEIGHT (2 * VISION_HEIGHT)
+#define CAPTURE_BYTES (CAPTURE_WIDTH * CAPTURE_HEIGHT * 2)
+#define FACE_RADIUS 16
+
+#ifdef ARDUINO
+typedef uint32_t BenchTicks;
+
+static inline BenchTicks benchTicks() {
+    return ESP.getCycleCount();
+}
+
+static double ticksToNanoseconds(double ticks) {
+    return ticks * 1000.0 / ESP.getCpuFreqMHz();
+}
+
+static double ticksToCycles(double ticks) {
+    return ticks;
+}
+
+#define BENCH_PRINT(...) Serial.printf(__VA_ARGS__)
+#define BENCH_TARGET "device"
+#define BENCH_MHZ ESP.getCpuFreqMHz()
+
+static portMUX_TYPE benchMux = portMUX_INITIALIZER_UNLOCKED;
+#define BENCH_LOCK() portENTER_CRITICAL(&benchMux)
+#define BENCH_UNLOCK() portEXIT_CRITICAL(&benchMux)
+#else
+typedef uint64_t BenchTicks;
+
+static inline BenchTicks benchTicks() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static double ticksToNanoseconds(double ticks) {
+    return ticks;
+}
+
+static double ticksToCycles(double) {
+    return 0;
+}
+
+#define BENCH_PRINT(...) printf(__VA_ARGS__)
+#define BENCH_TARGET "host"
+#define BENCH_MHZ 0
+
+// Stands in for the portMUX spinlock the callbacks and motion loop share
+static std::atomic_flag benchLock = ATOMIC_FLAG_INIT;
+#define BENCH_LOCK() while (benchLock.test_and_set(std::memory_order_acquire)) {}
+#define BENCH_UNLOCK() benchLock.clear(std::memory_order_release)
+#endif
+
+// Make the compiler assume a value is used, or unknown, without emitting code
+template <typename T>
+static inline void benchKeep(const T& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+template <typename T>
+static inline T benchOpaque(T value) {
+    asm volatile("" : "+r,m"(value) : : "memory");
+    return value;
+}
+
+template <typename Body>
+static void benchCase(const char* name, uint32_t iterations, Body body) {
+    // Every run does the same work, the same iterations over the same
+    // inputs, after untimed runs have warmed the caches and branch predictors.
+    // Interrupts and cache misses only ever add time, so the median of the
+    // runs is far steadier than any single one.
+    double perOp[BENCH_RUNS];
+    for (int run = -BENCH_WARMUP_RUNS; run < BENCH_RUNS; run++) {
+        BenchTicks start = benchTicks();
+        for (uint32_t i = 0; i < iterations; i++) {
+            body(i);
+        }
+        BenchTicks elapsed = benchTicks() - start;
+        if (run >= 0) {
+            perOp[run] = (double)elapsed / iterations;
+        }
+    }
+    std::sort(perOp, perOp + BENCH_RUNS);
+    double median = perOp[BENCH_RUNS / 2];
+    double spread = 100.0 * (perOp[BENCH_RUNS * 3 / 4] - perOp[BENCH_RUNS / 4]) / median;
+    BENCH_PRINT("bench,%s,%.1f,%.1f,%.1f\n", name, ticksToNanoseconds(median), ticksToCycles(median), spread);
+}
+
+static const char* positionCommands[INPUT_COUNT] = {
+    "12.5,-30.25", "0,0", "-179.9,45", "90.125,-12.5", "3.75,8.5", "-45,60.5", "120.5,-7.25", "1,2",
+    "-0.5,0.25", "33.3,-33.3", "150,-60", "-90.75,15.5", "7,-7", "64.5,22.25", "-120,30", "10.1,-10.1"
+};
+
+static const char* jogCommands[INPUT_COUNT] = {
+    "12.5,-30.25,250", "0,0", "-45.5,20,100", "90,-15.25", "3.75,8.5,500", "-60,0", "15,-15,250", "1,2",
+    "-0.5,0.25,50", "33.3,-33.3", "45,-60,1000", "-90.75,15.5", "7,-7,250", "64.5,22.25", "-20,30,200", "10.1,-10.1"
+};
+
+static const char* limitsCommands[2] = {
+    "90.0,180.0,1800.0,90.0,180.0,1800.0",
+    "45.5,90.25,0,60,120.5,900"
+};
+
+static float degreeInputs[INPUT_COUNT];
+static long stepInputs[INPUT_COUNT];
+
+// The pending-limits handoff from LimitsCallbacks to updateMotion
+static AxisLimits pendingLimits;
+static volatile bool limitsPending;
+
+static uint8_t* capture;
+static VisionFrame* visionFrame;
+static uint8_t* visionMask;
+
+// Sensor noise, so the masks have the ragged edges real frames do
+static uint8_t benchNoisy(uint32_t& seed, int value) {
+    seed = seed * 1664525u + 1013904223u;
+    value += (int)((seed >> 16) % 17) - 8;
+    return value < 0 ? 0 : value > 255 ? 255 : value;
+}
+
+static void renderScene() {
+    uint32_t seed = 12345;
+    for (int y = 0; y < CAPTURE_HEIGHT; y++) {
+        for (int x = 0; x < CAPTURE_WIDTH; x += 2) {
+            int dx = x + 1 - CAPTURE_WIDTH / 3;
+            int dy = y - CAPTURE_HEIGHT / 2;
+            bool face = dx * dx + dy * dy <= FACE_RADIUS * FACE_RADIUS;
+            int luma = face ? 160 : 60 + x * 140 / CAPTURE_WIDTH;
+            uint8_t* pair = capture + (y * CAPTURE_WIDTH + x) * 2;
+            pair[0] = benchNoisy(seed, luma);
+            pair[1] = benchNoisy(seed, face ? 100 : 128);
+            pair[2] = benchNoisy(seed, luma);
+            pair[3] = benchNoisy(seed, face ? 150 : 115);
+        }
+    }
+}
+
+void benchRun() {
+    for (int i = 0; i < INPUT_COUNT; i++) {
+        degreeInputs[i] = -170.0f + 21.37f * i;
+        stepInputs[i] = (long)(degreeInputs[i] * STEPS_PER_DEGREE);
+    }
+    BENCH_PRINT("bench,begin,%s,%u\n", BENCH_TARGET, (unsigned)BENCH_MHZ);
+
+    // Command parsing: the atof path the position command used to take,
+    // then the parsers the callbacks use now
+    benchCase("parse_position_atof", PARSE_ITERATIONS, [](uint32_t i) {
+        const char* text = benchOpaque(positionCommands[i % INPUT_COUNT]);
+        const char* comma = strchr(text, ',');
+        float pan = atof(text);
+        float tilt = atof(comma + 1);
+        benchKeep(pan);
+        benchKeep(tilt);
+    });
+    benchCase("parse_position", PARSE_ITERATIONS, [](uint32_t i) {
+        float pan, tilt;
+        bool valid = parsePosition(benchOpaque(positionCommands[i % INPUT_COUNT]), pan, tilt);
+        benchKeep(valid);
+        benchKeep(pan);
+        benchKeep(tilt);
+    });
+    benchCase("parse_jog", PARSE_ITERATIONS, [](uint32_t i) {
+        float pan, tilt;
+        long timeout = 0;
+        int fields = parseJog(benchOpaque(jogCommands[i % INPUT_COUNT]), pan, tilt, timeout);
+        benchKeep(fields);
+        benchKeep(pan);
+        benchKeep(tilt);
+        benchKeep(timeout);
+    });
+    benchCase("parse_limits", PARSE_ITERATIONS, [](uint32_t i) {
+        float fields[6];
+        bool valid = parseLimits(benchOpaque(limitsCommands[i % 2]), fields);
+        benchKeep(valid);
+        benchKeep(fields);
+    });
+
+    // Degree/step conversion as the position command and status update do it
+    benchCase("degrees_to_steps", ARITHMETIC_ITERATIONS, [](uint32_t i) {
+        long steps = benchOpaque(degreeInputs[i % INPUT_COUNT]) * STEPS_PER_DEGREE;
+        benchKeep(steps);
+    });
+    benchCase("steps_to_degrees", ARITHMETIC_ITERATIONS, [](uint32_t i) {
+        long degrees = benchOpaque(stepInputs[i % INPUT_COUNT]) / STEPS_PER_DEGREE;
+        benchKeep(degrees);
+    });
+
+    benchCase("format_status", PARSE_ITERATIONS, [](uint32_t i) {
+        char status[48];
+        formatStatus(status, sizeof(status), benchOpaque(stepInputs[i % INPUT_COUNT]) / 100, (long)(i % 360));
+        benchKeep(status);
+    });
+
+    // Motion pipeline, one call per 1 kHz tick
+    static MotionAxis motion({
+        (float)(90 * STEPS_PER_DEGREE), (float)(180 * STEPS_PER_DEGREE), (float)(1800 * STEPS_PER_DEGREE)
+    });
+    benchCase("motion_move", TICK_ITERATIONS, [](uint32_t i) {
+        if (i == 0) {
+            motion.setPosition(-60 * STEPS_PER_DEGREE);
+        }
+        if (!motion.isMoving()) {
+            motion.moveTo(motion.target() > 0 ? (long)(-60 * STEPS_PER_DEGREE) : (long)(60 * STEPS_PER_DEGREE));
+        }
+        motion.update(MOTION_TICK);
+        benchKeep(motion.position());
+    });
+    benchCase("motion_velocity", TICK_ITERATIONS, [](uint32_t i) {
+        if (i == 0) {
+            motion.setPosition(0);
+        }
+        if (i % 1000 == 0) {
+            motion.setVelocity((i / 1000) % 2 ? 30 * STEPS_PER_DEGREE : -30 * STEPS_PER_DEGREE);
+        }
+        motion.update(MOTION_TICK);
+        benchKeep(motion.position());
+    });
+
+    static InputShaper shaper;
+    shaper.configure(SHAPER_ZVD, 8.0f, 0.05f, MOTION_TICK);
+    shaper.reset(0);
+    benchCase("shaper_zvd", TICK_ITERATIONS, [](uint32_t i) {
+        shaper.update(benchOpaque(degreeInputs[i % INPUT_COUNT]) * STEPS_PER_DEGREE, 1000.0f);
+        benchKeep(shaper.position());
+        benchKeep(shaper.velocity());
+    });
+
+    // Step interval as AccelStepper::setSpeed derives it from the shaped
+    // velocity and the position correction in updateMotion
+    benchCase("step_interval", ARITHMETIC_ITERATIONS, [](uint32_t i) {
+        float velocity = benchOpaque(degreeInputs[i % INPUT_COUNT]) * 10.0f;
+        double correction = (benchOpaque(stepInputs[i % INPUT_COUNT]) % 7) * POSITION_GAIN;
+        float speed = velocity + correction;
+        unsigned long interval = speed == 0.0f ? 0 : fabs(1000000.0 / speed);
+        benchKeep(interval);
+    });
+
+    static VisualServo servo({ 6.0f, 2.0f, (float)(5 * STEPS_PER_DEGREE), 0.5f, 0.0f });
+    benchCase("servo_tick", TICK_ITERATIONS, [](uint32_t i) {
+        // Time keeps running across runs so the history stays in order
+        static uint32_t now = 0;
+        now += 1000;
+        long position = (long)(1000 * sinf(i * 0.001f));
+        servo.record(position, now);
+        if (i % SERVO_MEASURE_TICKS == 0) {
+            servo.measure(benchOpaque(degreeInputs[i % INPUT_COUNT]), now - 30000);
+        }
+        benchKeep(servo.update(position, 0, now, MOTION_TICK, 20000));
+    });
+
+    // Callback to motion loop handoffs: the lock-protected pending struct,
+    // written by one side and taken by the other
+    benchCase("handoff_pending", HANDOFF_ITERATIONS, [](uint32_t i) {
+        AxisLimits limits = { benchOpaque(degreeInputs[i % INPUT_COUNT]), 2.0f, 3.0f };
+        BENCH_LOCK();
+        pendingLimits = limits;
+        limitsPending = true;
+        BENCH_UNLOCK();
+
+        if (limitsPending) {
+            BENCH_LOCK();
+            AxisLimits taken = pendingLimits;
+            limitsPending = false;
+            BENCH_UNLOCK();
+            benchKeep(taken);
+        }
+    });
+
+    // Vision kernels, scalar reference against the four-bytes-per-word
+    // variant, one frame per iteration
+#ifdef ARDUINO
+    // Where camera.cpp keeps them: the capture in PSRAM like the camera's
+    // frame buffers, the working planes in internal RAM
+    capture = (uint8_t*)ps_malloc(CAPTURE_BYTES);
+    visionFrame = (VisionFrame*)heap_caps_malloc(sizeof(VisionFrame), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    visionMask = (uint8_t*)heap_caps_malloc(VISION_PIXELS, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+#else
+    static uint8_t captureBuffer[CAPTURE_BYTES];
+    static VisionFrame frameBuffer;
+    static uint8_t maskBuffer[VISION_PIXELS];
+    capture = captureBuffer;
+    visionFrame = &frameBuffer;
+    visionMask = maskBuffer;
+#endif
+    if (capture != NULL && visionFrame != NULL && visionMask != NULL) {
+        renderScene();
+        benchCase("vision_downscale_scalar", FRAME_ITERATIONS, [](uint32_t) {
+            visionDownscaleScalar(benchOpaque(capture), CAPTURE_WIDTH, CAPTURE_HEIGHT, *visionFrame);
+            benchKeep(visionFrame->y[0]);
+        });
+        benchCase("vision_downscale_fast", FRAME_ITERATIONS, [](uint32_t) {
+            visionDownscaleFast(benchOpaque(capture), CAPTURE_WIDTH, CAPTURE_HEIGHT, *visionFrame);
+            benchKeep(visionFrame->y[0]);
+        });
+        benchCase("vision_mask_scalar", FRAME_ITERATIONS, [](uint32_t) {
+            visionSkinMaskScalar(*benchOpaque(visionFrame), visionMask);
+            benchKeep(visionMask[0]);
+        });
+        benchCase("vision_mask_fast", FRAME_ITERATIONS, [](uint32_t) {
+            visionSkinMaskFast(*benchOpaque(visionFrame), visionMask);
+            benchKeep(visionMask[0]);
+        });
+        benchCase("vision_centroid", FRAME_ITERATIONS, [](uint32_t) {
+            VisionTarget target;
+            visionCentroid(benchOpaque(visionMask), target);
+            benchKeep(target);
+        });
+    }
+#ifdef ARDUINO
+    free(capture);
+    free(visionFrame);
+    free(visionMask);
+
+    // The FreeRTOS queue feeding the bulk transfer task and the recorder ring
+    // written from the motion loop only exist on the device
+    static QueueHandle_t queue = xQueueCreate(4, 32);
+    benchCase("handoff_queue", HANDOFF_ITERATIONS, [](uint32_t i) {
+        uint8_t item[32];
+        item[0] = i;
+        xQueueSend(queue, item, 0);
+        xQueueReceive(queue, item, 0);
+        benchKeep(item);
+    });
+    vQueueDelete(queue);
+
+    benchCase("recorder_record", HANDOFF_ITERATIONS, [](uint32_t i) {
+        recorderRecord(REC_COMMAND, 0, 0, i, 0);
+    });
+#endif
+
+    BENCH_PRINT("bench,end\n");
+}
+
+// Unit test builds bring their own main()
+#if !defined(ARDUINO) && !defined(PIO_UNIT_TESTING)
+int main() {
+    benchRun();
+    return 0;
+}
+#endif
+
+#endif
@@ -0,0 +1,153 @@
+#include <Arduino.h>
+#include <BLEDevice.h>
+#include "bulk.h"
+#include "centrals.h"
+#include "log.h"
+
+#define BULK_QUEUE_DEPTH (BULK_WINDOW + 4)  // A full window plus control commands
+#define BULK_COMMAND_SIZE 64
+#define BULK_TASK_STACK 4096
+#define BULK_TASK_PRIORITY 1
+
+static const char* kindNames[] = { "ota" };
+#define BULK_KIND_COUNT (sizeof(kindNames) / sizeof(kindNames[0]))
+
+enum BulkPacketType : uint8_t {
+    PACKET_CONTROL,
+    PACKET_DATA
+};
+
+struct BulkPacket {
+    uint8_t type;
+    uint16_t connId;
+    uint16_t length;
+    uint8_t data[BULK_CHUNK_HEADER + BULK_MAX_CHUNK];
+};
+
+static QueueHandle_t queue = NULL;
+static BLECharacteristic* controlCharacteristic = NULL;
+static BulkSink* sinks[BULK_KIND_COUNT] = { NULL };
+static BulkReceiver receiver;
+static BulkPacket incoming;  // Write callbacks all run in the BLE task
+static uint32_t droppedPackets = 0;
+static uint16_t hostConnId = CONTROL_NONE;  // Sender of the last control command
+
+// Replies go only to the host running the transfer
+static void notify(const char* text) {
+    centralsSend(hostConnId, controlCharacteristic, (const uint8_t*)text, strlen(text));
+}
+
+static void handleControl(char* command, uint16_t connId) {
+    hostConnId = connId;
+    char reply[48];
+    if (strncmp(command, "start,", 6) == 0) {
+        char* kindName = strtok(command + 6, ",");
+        char* size = strtok(NULL, ",");
+        char* crc = strtok(NULL, ",");
+        int kind = -1;
+        for (size_t i = 0; kindName != NULL && i < BULK_KIND_COUNT; i++) {
+            if (strcmp(kindName, kindNames[i]) == 0) {
+                kind = i;
+            }
+        }
+        if (kind < 0 || sinks[kind] == NULL || size == NULL || crc == NULL) {
+            notify("error,start");
+            return;
+        }
+        if (!receiver.start(sinks[kind], kind, strtoul(size, NULL, 10), strtoul(crc, NULL, 16))) {
+            notify("error,begin");
+            return;
+        }
+        // ATT writes carry at most MTU - 3 bytes
+        size_t chunk = min((size_t)centralsMtu(connId) - 3 - BULK_CHUNK_HEADER, (size_t)BULK_MAX_CHUNK);
+        LOG_INFO(LOG_CAT_BLE, MSG_BULK_START, (uint32_t)kind, receiver.size(), receiver.received(), (uint32_t)chunk);
+        snprintf(reply, sizeof(reply), "ready,%u,%u,%lu", (unsigned)chunk, BULK_WINDOW,
+                 (unsigned long)receiver.received());
+        notify(reply);
+    } else if (strcmp(command, "abort") == 0) {
+        receiver.abort();
+        notify("aborted");
+    }
+}
+
+static void handleData(const uint8_t* data, size_t length) {
+    uint8_t kind = receiver.kind();
+    char reply[24];
+    switch (receiver.receive(data, length)) {
+    case BulkReceiver::BULK_ACK:
+        snprintf(reply, sizeof(reply), "ack,%lu", (unsigned long)receiver.received());
+        notify(reply);
+        break;
+    case BulkReceiver::BULK_NAK:
+        snprintf(reply, sizeof(reply), "nak,%lu", (unsigned long)receiver.received());
+        notify(reply);
+        break;
+    case BulkReceiver::BULK_DONE:
+        LOG_INFO(LOG_CAT_BLE, MSG_BULK_DONE, (uint32_t)kind, receiver.received());
+        notify("done");
+        sinks[kind]->completed();
+        break;
+    case BulkReceiver::BULK_FAILED:
+        LOG_ERROR(LOG_CAT_BLE, MSG_BULK_FAILED, (uint32_t)kind, receiver.received());
+        notify("error,data");
+        break;
+    case BulkReceiver::BULK_NONE:
+        break;
+    }
+}
+
+static void bulkTask(void* parameter) {
+    static BulkPacket packet;
+    for (;;) {
+        xQueueReceive(queue, &packet, portMAX_DELAY);
+        if (packet.type == PACKET_CONTROL) {
+            handleControl((char*)packet.data, packet.connId);
+        } else {
+            handleData(packet.data, packet.length);
+        }
+    }
+}
+
+void bulkInit(BLECharacteristic* control) {
+    controlCharacteristic = control;
+    queue = xQueueCreate(BULK_QUEUE_DEPTH, sizeof(BulkPacket));
+    xTaskCreatePinnedToCore(bulkTask, "bulkTask", BULK_TASK_STACK, NULL, BULK_TASK_PRIORITY, NULL, tskNO_AFFINITY);
+}
+
+void bulkRegisterSink(uint8_t kind, BulkSink* sink) {
+    if (kind < BULK_KIND_COUNT) {
+        sinks[kind] = sink;
+    }
+}
+
+void bulkControl(const char* command, uint16_t connId) {
+    incoming.type = PACKET_CONTROL;
+    incoming.connId = connId;
+    strncpy((char*)incoming.data, command, BULK_COMMAND_SIZE - 1);
+    incoming.data[BULK_COMMAND_SIZE - 1] = '\0';
+    incoming.length = strlen((char*)incoming.data);
+    // Control commands are rare and must not be lost
+    xQueueSend(queue, &incoming, portMAX_DELAY);
+}
+
+void bulkData(const uint8_t* data, size_t length) {
+    if (length > sizeof(incoming.data)) {
+        return;
+    }
+    incoming.type = PACKET_DATA;
+    incoming.length = length;
+    memcpy(incoming.data, data, length);
+    // A full queue behaves like a lost packet: the gap is nak'ed and resent
+    if (xQueueSend(queue, &incoming, 0) != pdTRUE) {
+        droppedPackets++;
+    }
+}
+
+int bulkFormatStatus(char* buffer, size_t size) {
+    if (!receiver.active()) {
+        return snprintf(buffer, size, "idle dropped=%lu", (unsigned long)droppedPackets);
+    }
+    return snprintf(buffer, size, "receiving kind=%s received=%lu size=%lu dropped=%lu",
+                    kindNames[receiver.kind()], (unsigned long)receiver.received(),
+                    (unsigned long)receiver.size(), (unsigned long)droppedPackets);
+}
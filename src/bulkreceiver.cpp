@@ -0,0 +1,100 @@
+#include <string.h>
+#include "bulk.h"
+
+uint16_t bulkCrc16(const uint8_t* data, size_t length) {
+    uint16_t crc = 0xFFFF;
+    for (size_t i = 0; i < length; i++) {
+        crc ^= (uint16_t)data[i] << 8;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+uint32_t bulkCrc32(uint32_t crc, const uint8_t* data, size_t length) {
+    crc = ~crc;
+    for (size_t i = 0; i < length; i++) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = crc & 1 ? (crc >> 1) ^ 0xEDB88320u : crc >> 1;
+        }
+    }
+    return ~crc;
+}
+
+BulkReceiver::BulkReceiver()
+    : _sink(NULL), _kind(0), _size(0), _expectedCrc(0), _crc(0), _received(0), _sinceAck(0), _nakSent(false) {
+}
+
+bool BulkReceiver::start(BulkSink* sink, uint8_t kind, uint32_t size, uint32_t crc) {
+    if (_sink != NULL && _sink == sink && _kind == kind && _size == size && _expectedCrc == crc) {
+        _sinceAck = 0;
+        _nakSent = false;
+        return true;
+    }
+    abort();
+    if (size == 0 || !sink->begin(size)) {
+        return false;
+    }
+    _sink = sink;
+    _kind = kind;
+    _size = size;
+    _expectedCrc = crc;
+    _crc = 0;
+    _received = 0;
+    _sinceAck = 0;
+    _nakSent = false;
+    return true;
+}
+
+BulkReceiver::Result BulkReceiver::receive(const uint8_t* packet, size_t length) {
+    if (_sink == NULL || length <= BULK_CHUNK_HEADER) {
+        return BULK_NONE;
+    }
+    uint32_t offset;
+    uint16_t crc;
+    memcpy(&offset, packet, sizeof(offset));
+    memcpy(&crc, packet + sizeof(offset), sizeof(crc));
+    const uint8_t* payload = packet + BULK_CHUNK_HEADER;
+    size_t payloadLength = length - BULK_CHUNK_HEADER;
+
+    // Anything but the next chunk, intact, means the host has to go back
+    if (offset != _received || payloadLength > _size - _received || bulkCrc16(payload, payloadLength) != crc) {
+        if (_nakSent) {
+            return BULK_NONE;
+        }
+        _nakSent = true;
+        return BULK_NAK;
+    }
+    _nakSent = false;
+
+    if (!_sink->write(payload, payloadLength)) {
+        abort();
+        return BULK_FAILED;
+    }
+    _crc = bulkCrc32(_crc, payload, payloadLength);
+    _received += payloadLength;
+
+    if (_received == _size) {
+        BulkSink* sink = _sink;
+        _sink = NULL;
+        if (_crc != _expectedCrc) {
+            sink->abort();
+            return BULK_FAILED;
+        }
+        return sink->finish() ? BULK_DONE : BULK_FAILED;
+    }
+    if (++_sinceAck >= BULK_ACK_INTERVAL) {
+        _sinceAck = 0;
+        return BULK_ACK;
+    }
+    return BULK_NONE;
+}
+
+void BulkReceiver::abort() {
+    if (_sink != NULL) {
+        _sink->abort();
+        _sink = NULL;
+    }
+}
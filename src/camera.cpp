@@ -0,0 +1,183 @@
+#ifdef VISION_ENABLED
+
+#include <Arduino.h>
+#include <esp_camera.h>
+#include "camera.h"
+#include "log.h"
+
+// XIAO ESP32-S3 Sense camera connector
+#define CAMERA_PIN_XCLK 10
+#define CAMERA_PIN_SIOD 40
+#define CAMERA_PIN_SIOC 39
+#define CAMERA_PIN_D7 48
+#define CAMERA_PIN_D6 11
+#define CAMERA_PIN_D5 12
+#define CAMERA_PIN_D4 14
+#define CAMERA_PIN_D3 16
+#define CAMERA_PIN_D2 18
+#define CAMERA_PIN_D1 17
+#define CAMERA_PIN_D0 15
+#define CAMERA_PIN_VSYNC 38
+#define CAMERA_PIN_HREF 47
+#define CAMERA_PIN_PCLK 13
+#define CAMERA_XCLK_FREQUENCY 20000000
+#define CAMERA_TASK_STACK 4096
+#define CAMERA_TASK_PRIORITY 1
+#define CAMERA_TASK_CORE 0  // Away from loop() and its step pulses on core 1
+
+struct KernelTimes {
+    uint32_t downscale;
+    uint32_t mask;
+    uint32_t centroid;
+};
+
+static VisionFrame* frame = NULL;
+static uint8_t* mask = NULL;
+static CameraTargetCallback targetCallback = NULL;
+static volatile bool benchRequested = false;
+static uint32_t frameCount = 0;
+static uint32_t detectionCount = 0;
+static float frameRate = 0;
+static KernelTimes lastTimes = { 0, 0, 0 };
+static KernelTimes benchScalar = { 0, 0, 0 };
+static KernelTimes benchFast = { 0, 0, 0 };
+static int benchMatch = -1;  // -1 until a bench has run
+
+// Both kernel paths on the same frame, timed, and compared byte for byte
+static void runBench(const camera_fb_t* fb) {
+    VisionFrame* reference = (VisionFrame*)ps_malloc(sizeof(VisionFrame));
+    uint8_t* referenceMask = (uint8_t*)ps_malloc(VISION_PIXELS);
+    if (reference == NULL || referenceMask == NULL) {
+        free(reference);
+        free(referenceMask);
+        return;
+    }
+    VisionTarget target;
+    uint32_t start = micros();
+    visionDownscaleScalar(fb->buf, fb->width, fb->height, *reference);
+    benchScalar.downscale = micros() - start;
+    start = micros();
+    visionSkinMaskScalar(*reference, referenceMask);
+    benchScalar.mask = micros() - start;
+    start = micros();
+    visionCentroid(referenceMask, target);
+    benchScalar.centroid = micros() - start;
+
+    start = micros();
+    visionDownscaleFast(fb->buf, fb->width, fb->height, *frame);
+    benchFast.downscale = micros() - start;
+    start = micros();
+    visionSkinMaskFast(*frame, mask);
+    benchFast.mask = micros() - start;
+    benchFast.centroid = benchScalar.centroid;  // Shared kernel
+
+    benchMatch = memcmp(reference, frame, sizeof(VisionFrame)) == 0 &&
+                 memcmp(referenceMask, mask, VISION_PIXELS) == 0;
+    free(reference);
+    free(referenceMask);
+    LOG_INFO(LOG_CAT_SYSTEM, MSG_VISION_BENCH, benchScalar.downscale + benchScalar.mask,
+             benchFast.downscale + benchFast.mask, (uint32_t)benchMatch);
+}
+
+static void cameraTask(void* parameter) {
+    uint32_t lastFrame = micros();
+    for (;;) {
+        camera_fb_t* fb = esp_camera_fb_get();
+        if (fb == NULL) {
+            vTaskDelay(pdMS_TO_TICKS(10));
+            continue;
+        }
+        uint32_t captureTime = micros();
+        if (benchRequested) {
+            benchRequested = false;
+            runBench(fb);
+        }
+
+        VisionTarget target;
+        uint32_t start = micros();
+        visionDownscaleFast(fb->buf, fb->width, fb->height, *frame);
+        esp_camera_fb_return(fb);
+        lastTimes.downscale = micros() - start;
+        start = micros();
+        visionSkinMaskFast(*frame, mask);
+        lastTimes.mask = micros() - start;
+        start = micros();
+        visionCentroid(mask, target);
+        lastTimes.centroid = micros() - start;
+
+        frameCount++;
+        detectionCount += target.found;
+        frameRate = 0.9f * frameRate + 0.1f * 1000000.0f / (captureTime - lastFrame);
+        lastFrame = captureTime;
+        targetCallback(target, captureTime);
+    }
+}
+
+bool cameraInit() {
+    camera_config_t config = {};
+    config.pin_pwdn = -1;
+    config.pin_reset = -1;
+    config.pin_xclk = CAMERA_PIN_XCLK;
+    config.pin_sccb_sda = CAMERA_PIN_SIOD;
+    config.pin_sccb_scl = CAMERA_PIN_SIOC;
+    config.pin_d7 = CAMERA_PIN_D7;
+    config.pin_d6 = CAMERA_PIN_D6;
+    config.pin_d5 = CAMERA_PIN_D5;
+    config.pin_d4 = CAMERA_PIN_D4;
+    config.pin_d3 = CAMERA_PIN_D3;
+    config.pin_d2 = CAMERA_PIN_D2;
+    config.pin_d1 = CAMERA_PIN_D1;
+    config.pin_d0 = CAMERA_PIN_D0;
+    config.pin_vsync = CAMERA_PIN_VSYNC;
+    config.pin_href = CAMERA_PIN_HREF;
+    config.pin_pclk = CAMERA_PIN_PCLK;
+    config.xclk_freq_hz = CAMERA_XCLK_FREQUENCY;
+    config.ledc_timer = LEDC_TIMER_0;
+    config.ledc_channel = LEDC_CHANNEL_0;
+    config.pixel_format = PIXFORMAT_YUV422;
+    config.frame_size = FRAMESIZE_QVGA;  // Twice the working resolution
+    config.fb_count = 2;
+    config.fb_location = CAMERA_FB_IN_PSRAM;
+    config.grab_mode = CAMERA_GRAB_LATEST;
+
+    esp_err_t err = esp_camera_init(&config);
+    if (err != ESP_OK) {
+        LOG_WARN(LOG_CAT_SYSTEM, MSG_CAMERA_FAILED, (uint32_t)err);
+        return false;
+    }
+
+    // The kernels are memory bound, so keep their buffers out of PSRAM
+    frame = (VisionFrame*)heap_caps_malloc(sizeof(VisionFrame), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    mask = (uint8_t*)heap_caps_malloc(VISION_PIXELS, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (frame == NULL || mask == NULL) {
+        LOG_WARN(LOG_CAT_SYSTEM, MSG_CAMERA_FAILED, (uint32_t)ESP_ERR_NO_MEM);
+        esp_camera_deinit();
+        return false;
+    }
+    return true;
+}
+
+void cameraStart(CameraTargetCallback callback) {
+    targetCallback = callback;
+    xTaskCreatePinnedToCore(cameraTask, "cameraTask", CAMERA_TASK_STACK, NULL,
+                            CAMERA_TASK_PRIORITY, NULL, CAMERA_TASK_CORE);
+}
+
+void cameraRequestBench() {
+    benchRequested = true;
+}
+
+int cameraFormatStats(char* buffer, size_t size) {
+    int length = snprintf(buffer, size, "fps=%.1f frames=%lu detections=%lu us=%lu/%lu/%lu",
+                          frameRate, (unsigned long)frameCount, (unsigned long)detectionCount,
+                          (unsigned long)lastTimes.downscale, (unsigned long)lastTimes.mask,
+                          (unsigned long)lastTimes.centroid);
+    if (benchMatch >= 0 && length < (int)size) {
+        length += snprintf(buffer + length, size - length, " bench=%lu/%lu,%lu/%lu match=%d",
+                           (unsigned long)benchScalar.downscale, (unsigned long)benchFast.downscale,
+                           (unsigned long)benchScalar.mask, (unsigned long)benchFast.mask, benchMatch);
+    }
+    return length;
+}
+
+#endif
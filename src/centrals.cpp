@@ -0,0 +1,319 @@
+#include <Arduino.h>
+#include <BLEServer.h>
+#include <BLE2902.h>
+#include "centrals.h"
+
+#define DEFAULT_MTU 23  // ATT MTU before the client negotiates a larger one
+#define CHANNEL_VALUE_SIZE 128  // Longest telemetry record, the diagnostics line
+#define SEND_TIMEOUT 1000  // Milliseconds to wait for the stack to send one directed notification
+
+struct Central {
+    bool connected;
+    bool used;  // Slot has held a client; its settings wait for a reconnect
+    uint16_t connId;
+    uint8_t address[6];
+    uint32_t disconnectedAt;
+    uint8_t priority;
+    uint16_t mtu;
+    bool congested;
+    uint8_t subscriptions;  // Bit per TelemetryChannel
+    uint16_t interval[CHANNEL_COUNT];  // Per-client rate limit, milliseconds
+    uint32_t lastSent[CHANNEL_COUNT];
+    uint32_t lastCommand;
+    uint32_t sent;
+    uint32_t skipped;  // Notifications dropped for congestion
+    uint32_t denied;  // Motion commands refused by arbitration
+};
+
+static Central centrals[MAX_CENTRALS];
+static uint16_t owner = CONTROL_NONE;
+static BLECharacteristic* channels[CHANNEL_COUNT];
+static BLEDescriptor* descriptors[CHANNEL_COUNT];
+static char values[CHANNEL_COUNT][CHANNEL_VALUE_SIZE];  // Last value notified, served to reads
+static esp_gatt_if_t gattsIf = 0;
+static portMUX_TYPE centralsMux = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t reconnects = 0;
+static uint32_t lastReconnect = 0;
+static uint32_t maxReconnect = 0;
+
+// centralsSend: one directed notification in flight, confirmed by the stack
+static SemaphoreHandle_t sendLock = NULL;
+static SemaphoreHandle_t sendDone = NULL;
+static volatile uint16_t sendConnId = CONTROL_NONE;
+static volatile uint16_t sendHandle = 0;
+
+static Central* findCentral(uint16_t connId) {
+    for (int i = 0; i < MAX_CENTRALS; i++) {
+        if (centrals[i].connected && centrals[i].connId == connId) {
+            return &centrals[i];
+        }
+    }
+    return NULL;
+}
+
+// Runs in the Bluedroid task after the library has handled each GATT event
+static void gattsEvent(esp_gatts_cb_event_t event, esp_gatt_if_t gatts, esp_ble_gatts_cb_param_t* param) {
+    gattsIf = gatts;
+    portENTER_CRITICAL(&centralsMux);
+    if (event == ESP_GATTS_MTU_EVT) {
+        Central* central = findCentral(param->mtu.conn_id);
+        if (central != NULL) {
+            central->mtu = param->mtu.mtu;
+        }
+    } else if (event == ESP_GATTS_CONGEST_EVT) {
+        Central* central = findCentral(param->congest.conn_id);
+        if (central != NULL) {
+            central->congested = param->congest.congested;
+        }
+    } else if (event == ESP_GATTS_WRITE_EVT && !param->write.is_prep && param->write.len == 2) {
+        // A client configuration descriptor: remember the subscription for this connection only
+        Central* central = findCentral(param->write.conn_id);
+        for (int channel = 0; channel < CHANNEL_COUNT && central != NULL; channel++) {
+            if (descriptors[channel] != NULL && descriptors[channel]->getHandle() == param->write.handle) {
+                if (param->write.value[0] & 1) {
+                    central->subscriptions |= 1 << channel;
+                } else {
+                    central->subscriptions &= ~(1 << channel);
+                }
+            }
+        }
+    }
+    portEXIT_CRITICAL(&centralsMux);
+
+    // The stack has sent the notification centralsSend is waiting on
+    if (event == ESP_GATTS_CONF_EVT && param->conf.conn_id == sendConnId && param->conf.handle == sendHandle) {
+        sendConnId = CONTROL_NONE;
+        xSemaphoreGive(sendDone);
+    }
+}
+
+void centralsInit() {
+    sendLock = xSemaphoreCreateMutex();
+    sendDone = xSemaphoreCreateBinary();
+    BLEDevice::setCustomGattsHandler(gattsEvent);
+}
+
+void centralsRegister(TelemetryChannel channel, BLECharacteristic* characteristic) {
+    channels[channel] = characteristic;
+    descriptors[channel] = characteristic->getDescriptorByUUID(BLEUUID((uint16_t)0x2902));
+}
+
+uint32_t centralsConnected(uint16_t connId, const uint8_t* address) {
+    uint32_t now = millis();
+    uint32_t away = RECONNECT_NONE;
+    portENTER_CRITICAL(&centralsMux);
+    // The same client back soon keeps its slot; otherwise take an empty
+    // slot, or the one whose client left longest ago
+    Central* slot = NULL;
+    for (int i = 0; i < MAX_CENTRALS; i++) {
+        Central& central = centrals[i];
+        if (central.connected) {
+            continue;
+        }
+        if (central.used && memcmp(central.address, address, sizeof(central.address)) == 0 &&
+            now - central.disconnectedAt < RECONNECT_MEMORY) {
+            slot = &central;
+            away = now - central.disconnectedAt;
+            break;
+        }
+        if (slot == NULL || !central.used ||
+            (slot->used && now - central.disconnectedAt > now - slot->disconnectedAt)) {
+            slot = &central;
+        }
+    }
+    if (slot != NULL) {
+        if (away == RECONNECT_NONE) {
+            memset(slot, 0, sizeof(Central));
+            memcpy(slot->address, address, sizeof(slot->address));
+        } else {
+            // Priority and rate limits carry over; the link state does not
+            slot->congested = false;
+            slot->subscriptions = 0;
+            memset(slot->lastSent, 0, sizeof(slot->lastSent));
+            slot->lastCommand = 0;
+            reconnects++;
+            lastReconnect = away;
+            maxReconnect = max(maxReconnect, away);
+        }
+        slot->connected = true;
+        slot->used = true;
+        slot->connId = connId;
+        slot->mtu = DEFAULT_MTU;
+    }
+    portEXIT_CRITICAL(&centralsMux);
+    return away;
+}
+
+bool centralsDisconnected(uint16_t connId) {
+    portENTER_CRITICAL(&centralsMux);
+    Central* central = findCentral(connId);
+    if (central != NULL) {
+        central->connected = false;
+        central->disconnectedAt = millis();
+    }
+    bool owned = owner == connId;
+    if (owned) {
+        owner = CONTROL_NONE;
+    }
+    portEXIT_CRITICAL(&centralsMux);
+    return owned;
+}
+
+uint8_t centralsCount() {
+    uint8_t count = 0;
+    for (int i = 0; i < MAX_CENTRALS; i++) {
+        count += centrals[i].connected;
+    }
+    return count;
+}
+
+bool controlAcquire(uint16_t connId) {
+    uint32_t now = millis();
+    portENTER_CRITICAL(&centralsMux);
+    Central* central = findCentral(connId);
+    Central* current = findCentral(owner);
+    bool allowed = central == NULL || current == NULL || current == central ||
+                   central->priority > current->priority || now - current->lastCommand >= CONTROL_LEASE;
+    if (central != NULL) {
+        if (allowed) {
+            owner = connId;
+            central->lastCommand = now;
+        } else {
+            central->denied++;
+        }
+    }
+    portEXIT_CRITICAL(&centralsMux);
+    return allowed;
+}
+
+uint16_t controlOwner() {
+    return owner;
+}
+
+void centralsSetPriority(uint16_t connId, ControlPriority priority) {
+    portENTER_CRITICAL(&centralsMux);
+    Central* central = findCentral(connId);
+    if (central != NULL) {
+        central->priority = priority;
+    }
+    portEXIT_CRITICAL(&centralsMux);
+}
+
+void centralsRelease(uint16_t connId) {
+    portENTER_CRITICAL(&centralsMux);
+    if (owner == connId) {
+        owner = CONTROL_NONE;
+    }
+    portEXIT_CRITICAL(&centralsMux);
+}
+
+void centralsSetRate(uint16_t connId, TelemetryChannel channel, uint16_t interval) {
+    portENTER_CRITICAL(&centralsMux);
+    Central* central = findCentral(connId);
+    if (central != NULL) {
+        central->interval[channel] = interval;
+    }
+    portEXIT_CRITICAL(&centralsMux);
+}
+
+uint16_t centralsMtu(uint16_t connId) {
+    Central* central = findCentral(connId);
+    return central != NULL ? central->mtu : DEFAULT_MTU;
+}
+
+void centralsNotify(TelemetryChannel channel, const char* value) {
+    BLECharacteristic* characteristic = channels[channel];
+    if (characteristic == NULL) {
+        return;
+    }
+
+    // Keep our own copy rather than setValue(), which copies into a heap
+    // std::string inside the BLE library on every call
+    uint16_t targets[MAX_CENTRALS];
+    uint16_t lengths[MAX_CENTRALS];
+    int count = 0;
+    size_t length = min(strlen(value), (size_t)(CHANNEL_VALUE_SIZE - 1));
+    uint32_t now = millis();
+    portENTER_CRITICAL(&centralsMux);
+    memcpy(values[channel], value, length);
+    values[channel][length] = '\0';
+
+    // Pick the due subscribers under the lock, send outside it
+    for (int i = 0; i < MAX_CENTRALS; i++) {
+        Central& central = centrals[i];
+        if (!central.connected || !(central.subscriptions & (1 << channel)) ||
+            now - central.lastSent[channel] < central.interval[channel]) {
+            continue;
+        }
+        if (central.congested) {
+            central.skipped++;
+            continue;
+        }
+        central.lastSent[channel] = now;
+        central.sent++;
+        targets[count] = central.connId;
+        lengths[count] = min(length, (size_t)(central.mtu - 3));
+        count++;
+    }
+    portEXIT_CRITICAL(&centralsMux);
+
+    for (int i = 0; i < count; i++) {
+        esp_ble_gatts_send_indicate(gattsIf, targets[i], characteristic->getHandle(), lengths[i],
+                                    (uint8_t*)value, false);
+    }
+}
+
+bool centralsSend(uint16_t connId, BLECharacteristic* characteristic, const uint8_t* data, size_t length,
+                  bool wait) {
+    if (wait) {
+        xSemaphoreTake(sendLock, portMAX_DELAY);
+    }
+    portENTER_CRITICAL(&centralsMux);
+    Central* central = findCentral(connId);
+    uint16_t mtu = central != NULL ? central->mtu : 0;
+    portEXIT_CRITICAL(&centralsMux);
+    if (mtu == 0) {
+        if (wait) {
+            xSemaphoreGive(sendLock);
+        }
+        return false;
+    }
+
+    uint16_t handle = characteristic->getHandle();
+    if (wait) {
+        xSemaphoreTake(sendDone, 0);  // Drop a late confirmation of a send that timed out
+        sendHandle = handle;
+        sendConnId = connId;
+    }
+    bool sent = esp_ble_gatts_send_indicate(gattsIf, connId, handle, min(length, (size_t)(mtu - 3)),
+                                            (uint8_t*)data, false) == ESP_OK;
+    if (wait) {
+        sent = sent && xSemaphoreTake(sendDone, pdMS_TO_TICKS(SEND_TIMEOUT)) == pdTRUE;
+        sendConnId = CONTROL_NONE;
+        xSemaphoreGive(sendLock);
+    }
+    return sent;
+}
+
+void TelemetryCallbacks::onRead(BLECharacteristic* pCharacteristic) {
+    char value[CHANNEL_VALUE_SIZE];
+    portENTER_CRITICAL(&centralsMux);
+    memcpy(value, values[_channel], sizeof(value));
+    portEXIT_CRITICAL(&centralsMux);
+    pCharacteristic->setValue(value);
+}
+
+int centralsFormat(char* buffer, size_t size) {
+    int length = snprintf(buffer, size, "%d,%lu,%lu,%lu", owner == CONTROL_NONE ? -1 : owner,
+                          (unsigned long)reconnects, (unsigned long)lastReconnect, (unsigned long)maxReconnect);
+    for (int i = 0; i < MAX_CENTRALS && length < (int)size; i++) {
+        const Central& central = centrals[i];
+        if (central.connected) {
+            length += snprintf(buffer + length, size - length, ";%u,%u,%u,%u,%lu,%lu,%lu",
+                               central.connId, central.priority, central.mtu, central.subscriptions,
+                               (unsigned long)central.sent, (unsigned long)central.skipped,
+                               (unsigned long)central.denied);
+        }
+    }
+    return length;
+}
@@ -0,0 +1,49 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "command.h"
+
+bool parsePosition(const char* text, float& pan, float& tilt) {
+    const char* comma = strchr(text, ',');
+    if (comma == NULL) {
+        return false;
+    }
+    pan = strtof(text, NULL);
+    tilt = strtof(comma + 1, NULL);
+    return true;
+}
+
+int parseJog(const char* text, float& pan, float& tilt, long& timeout) {
+    char* end;
+    pan = strtof(text, &end);
+    if (*end != ',') {
+        return 0;
+    }
+    tilt = strtof(end + 1, &end);
+    if (*end != ',') {
+        return 2;
+    }
+    timeout = strtol(end + 1, NULL, 10);
+    return 3;
+}
+
+bool parseLimits(const char* text, float fields[6]) {
+    const char* cursor = text;
+    for (int i = 0; i < 6; i++) {
+        char* end;
+        fields[i] = strtof(cursor, &end);
+        // strtof takes "inf" and "nan", which would poison the planner
+        bool valid = end != cursor && (*end == (i < 5 ? ',' : '\0')) && isfinite(fields[i]);
+        bool positive = i % 3 == 2 ? fields[i] >= 0 : fields[i] > 0;
+        if (!valid || !positive) {
+            return false;
+        }
+        cursor = end + 1;
+    }
+    return true;
+}
+
+int formatStatus(char* buffer, size_t size, long position1, long position2) {
+    return snprintf(buffer, size, "Pos1: %ld° Pos2: %ld°", position1, position2);
+}
@@ -0,0 +1,61 @@
+#include "encoder.h"
+
+#define AS5600_STATUS 0x0B
+#define AS5600_RAW_ANGLE 0x0C
+#define AS5600_MAGNET_DETECTED 0x20
+#define AS5600_MAGNET_WEAK 0x10
+#define AS5600_MAGNET_STRONG 0x08
+
+ShaftEncoder::ShaftEncoder(TwoWire& wire)
+    : _wire(wire), _present(false), _valid(false), _raw(0), _turns(0), _errors(0) {
+}
+
+bool ShaftEncoder::begin(int sda, int scl, uint32_t frequency) {
+    _wire.begin(sda, scl, frequency);
+    uint8_t status;
+    if (!readRegister(AS5600_STATUS, &status, 1)) {
+        return false;
+    }
+    if (!(status & AS5600_MAGNET_DETECTED) || (status & (AS5600_MAGNET_WEAK | AS5600_MAGNET_STRONG))) {
+        return false;
+    }
+    _valid = false;
+    _turns = 0;
+    _present = read();
+    return _present;
+}
+
+bool ShaftEncoder::read() {
+    uint8_t data[2];
+    if (!readRegister(AS5600_RAW_ANGLE, data, sizeof(data))) {
+        _errors++;
+        return false;
+    }
+    uint16_t raw = ((data[0] & 0x0F) << 8) | data[1];
+    if (_valid) {
+        int delta = (int)raw - (int)_raw;
+        if (delta > AS5600_COUNTS / 2) {
+            _turns--;
+        } else if (delta < -AS5600_COUNTS / 2) {
+            _turns++;
+        }
+    }
+    _raw = raw;
+    _valid = true;
+    return true;
+}
+
+bool ShaftEncoder::readRegister(uint8_t reg, uint8_t* data, size_t length) {
+    _wire.beginTransmission(AS5600_ADDRESS);
+    _wire.write(reg);
+    if (_wire.endTransmission(false) != 0) {
+        return false;
+    }
+    if (_wire.requestFrom((uint8_t)AS5600_ADDRESS, (uint8_t)length) != length) {
+        return false;
+    }
+    for (size_t i = 0; i < length; i++) {
+        data[i] = _wire.read();
+    }
+    return true;
+}
@@ -0,0 +1,127 @@
+#include <Arduino.h>
+#include <atomic>
+#include "log.h"
+
+#define LOG_BUFFER_MASK (LOG_BUFFER_SLOTS - 1)
+#define LOG_TASK_STACK 3072
+#define LOG_TASK_PRIORITY 1  // Just above idle
+#define LOG_TASK_PERIOD 10   // Idle poll period in milliseconds
+
+volatile uint8_t logLevel = LOG_LEVEL_DEBUG;
+volatile uint32_t logCategoryMask = 0xFFFFFFFFu;
+
+// Bounded multi-producer, single-consumer queue. Each slot carries a sequence
+// number telling producers and the drain task whose turn it is.
+struct LogSlot {
+    std::atomic<uint32_t> sequence;
+    LogEntry entry;
+};
+
+static LogSlot slots[LOG_BUFFER_SLOTS];
+static std::atomic<uint32_t> writeIndex(0);
+static uint32_t readIndex = 0;  // Only touched by the drain task
+static std::atomic<uint32_t> droppedCount(0);
+
+static bool logPush(const LogEntry& entry) {
+    uint32_t pos = writeIndex.load(std::memory_order_relaxed);
+    LogSlot* slot;
+    for (;;) {
+        slot = &slots[pos & LOG_BUFFER_MASK];
+        uint32_t sequence = slot->sequence.load(std::memory_order_acquire);
+        int32_t diff = (int32_t)(sequence - pos);
+        if (diff == 0) {
+            if (writeIndex.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return false;  // Full
+        } else {
+            pos = writeIndex.load(std::memory_order_relaxed);
+        }
+    }
+    slot->entry = entry;
+    slot->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+static bool logPop(LogEntry& entry) {
+    LogSlot& slot = slots[readIndex & LOG_BUFFER_MASK];
+    uint32_t sequence = slot.sequence.load(std::memory_order_acquire);
+    if ((int32_t)(sequence - (readIndex + 1)) < 0) {
+        return false;  // Empty
+    }
+    entry = slot.entry;
+    slot.sequence.store(readIndex + LOG_BUFFER_SLOTS, std::memory_order_release);
+    readIndex++;
+    return true;
+}
+
+// Frame layout, little-endian: sync (2), timestamp (4), id (2), level (1),
+// category (1), argc (1), args (4 each)
+static void logEmit(const LogEntry& entry) {
+    uint8_t frame[11 + LOG_MAX_ARGS * 4];
+    frame[0] = LOG_FRAME_SYNC_1;
+    frame[1] = LOG_FRAME_SYNC_2;
+    memcpy(&frame[2], &entry.timestamp, 4);
+    memcpy(&frame[6], &entry.id, 2);
+    frame[8] = entry.level;
+    frame[9] = entry.category;
+    frame[10] = entry.argc;
+    memcpy(&frame[11], entry.args, entry.argc * 4);
+    Serial.write(frame, 11 + entry.argc * 4);
+}
+
+static void logTask(void* parameter) {
+    uint32_t reportedDrops = 0;
+    LogEntry entry;
+    for (;;) {
+        while (logPop(entry)) {
+            logEmit(entry);
+        }
+
+        // Report drops from here so the report itself cannot be dropped
+        uint32_t dropped = droppedCount.load(std::memory_order_relaxed);
+        if (dropped != reportedDrops) {
+            entry.timestamp = micros();
+            entry.id = MSG_LOG_DROPPED;
+            entry.level = LOG_LEVEL_WARN;
+            entry.category = LOG_CAT_SYSTEM;
+            entry.argc = 1;
+            entry.args[0] = dropped - reportedDrops;
+            logEmit(entry);
+            reportedDrops = dropped;
+        }
+
+        vTaskDelay(pdMS_TO_TICKS(LOG_TASK_PERIOD));
+    }
+}
+
+void logInit() {
+    for (uint32_t i = 0; i < LOG_BUFFER_SLOTS; i++) {
+        slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    writeIndex.store(0, std::memory_order_release);
+    xTaskCreatePinnedToCore(logTask, "logTask", LOG_TASK_STACK, NULL, LOG_TASK_PRIORITY, NULL, tskNO_AFFINITY);
+}
+
+void logWrite(uint8_t level, uint8_t category, uint16_t id, const uint32_t* args, uint8_t argc) {
+    if (level < logLevel || !((logCategoryMask >> category) & 1u)) {
+        return;
+    }
+
+    LogEntry entry;
+    entry.timestamp = micros();
+    entry.id = id;
+    entry.level = level;
+    entry.category = category;
+    entry.argc = argc;
+    memcpy(entry.args, args, argc * sizeof(uint32_t));
+
+    if (!logPush(entry)) {
+        droppedCount.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+uint32_t logDropped() {
+    return droppedCount.load(std::memory_order_relaxed);
+}
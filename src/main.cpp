@@ -5,6 +5,23 @@
 #include <BLEUtils.h>
 #include <BLE2902.h>
 #include <AccelStepper.h>
+#include <Preferences.h>
+#include "motion.h"
+#include "memstats.h"
+#include "log.h"
+#include "recorder.h"
+#include "autotune.h"
+#include "shaper.h"
+#include "encoder.h"
+#include "bulk.h"
+#include "ota.h"
+#include "camera.h"
+#include "servo.h"
+#include "command.h"
+#include "bench.h"
+#include "power.h"
+#include "centrals.h"
+#include "scan.h"
 
 // Pin Definitions for Motor 1 (using UART1)
 #define EN_PIN_1     1    // Enable pin (GPIO1)
@@ -20,6 +37,18 @@
 #define RX_PIN_2     44   // UART0 RX pin (GPIO44)
 #define TX_PIN_2     43   // UART0 TX pin (GPIO43)
 
+// Optional AS5600 encoders on the output shafts, one I2C bus each. The
+// Sense camera uses these pins, so VISION_ENABLED builds run open-loop.
+#define ENCODER_SDA_1 9
+#define ENCODER_SCL_1 10
+#define ENCODER_SDA_2 11
+#define ENCODER_SCL_2 12
+
+// Camera shutter release for grid scans, active high into an optocoupler or
+// transistor across the remote port. GPIO42 is a back pad; on the Sense board
+// it drives the microphone, which this firmware does not use.
+#define SHUTTER_PIN 42
+
 #define R_SENSE    0.11f // R_sense resistor value in ohms
 #define DRIVER_ADDRESS 0b00   // TMC2209 Driver address according to MS1 and MS2
 
@@ -30,14 +59,108 @@
 #define GEAR_RATIO_2 (170.0/18.0) // 18:170 reduction for motor 2 (9.44:1)
 #define TOTAL_STEPS_PER_REV_1 (STEPS_PER_REV * MICROSTEPS * GEAR_RATIO_1)
 #define TOTAL_STEPS_PER_REV_2 (STEPS_PER_REV * MICROSTEPS * GEAR_RATIO_2)
+#define STEPS_PER_DEGREE_1 (TOTAL_STEPS_PER_REV_1 / 360.0)
+#define STEPS_PER_DEGREE_2 (TOTAL_STEPS_PER_REV_2 / 360.0)
 #define DEFAULT_MAX_SPEED 90  // Default maximum speed in degrees per second
-#define DEFAULT_ACCELERATION 5000  // Default acceleration in steps per second squared
+#define DEFAULT_ACCELERATION 180  // Default acceleration in degrees per second squared
+#define DEFAULT_JERK 1800  // Default jerk in degrees per second cubed, 0 for unlimited
+#define MAX_STEP_RATE 20000  // Hard cap on step pulses per second
+#define POSITION_GAIN 50.0f  // Pulls the step count onto the planned position, per second
+#define DEFAULT_JOG_TIMEOUT 250  // Deadman window for jog commands in milliseconds
+#define MAX_JOG_TIMEOUT 5000  // Longest deadman window a client may request
+#define MOTION_UPDATE_INTERVAL 1000  // Trajectory update period in microseconds
+#define COMMAND_BUFFER_SIZE 64  // Longest text command accepted from a characteristic
+#define DIAG_LOG_INTERVAL 10000  // Memory diagnostics log period in milliseconds
+#define POSE_INTERVAL 20  // Timestamped pose notification period in milliseconds
+#define DRIVER_POLL_INTERVAL 100  // Driver status poll period in milliseconds
+#define DRIVER_FAULT_MASK 0x3E  // DRV_STATUS over-temperature and short-circuit bits
+#define DRIVER_STANDSTILL 0x80000000  // DRV_STATUS stst, no step pulses for a while
+#define STALL_LOAD 20  // SG_RESULT at or below this while stepping is a stall; 0 is full load
+#define STALL_POLLS 3  // Consecutive stalled status polls before freezing the recorder
+#define BLE_MTU 517  // Largest ATT MTU offered to clients
+#define ADV_FAST_MIN 0x20  // Advertising interval after boot or a dropout, 0.625 ms units (20 ms)
+#define ADV_FAST_MAX 0x30  // 30 ms
+#define ADV_SLOW_MIN 0xF4  // Advertising interval once nobody has come back (152.5 ms)
+#define ADV_SLOW_MAX 0x150  // 210 ms
+#define ADV_FAST_WINDOW 30000  // Milliseconds of fast advertising before slowing down
+#define DISCONNECT_GRACE ADV_FAST_WINDOW  // Outputs stay on this long for the last client to come back
+#define MOTOR_CURRENT 800  // RMS run current in mA
+#define MOTOR_HOLD_MULTIPLIER 0.5f  // Standstill current relative to the run current while active
+
+// Idle policy for battery rigs: once the head has rested for the hold time the
+// standstill current drops or the drivers switch off, and loop() blocks so the
+// CPU can sleep until the next command
+#define IDLE_HOLD_TIME 10000  // Default rest before the idle policy applies, in milliseconds
+#define IDLE_HOLD_PERCENT 30  // Default idle hold current as a percentage of the run current
+#define IDLE_POLL_INTERVAL 100  // Longest loop() block while idle, the status update period
+#define ENCODER_IDLE_POLL_INTERVAL 20  // Encoder read period while idle in milliseconds
+
+// Closed-loop correction from the shaft encoders
+#define ENCODER_I2C_FREQUENCY 400000
+#define ENCODER_POLL_INTERVAL 2  // Encoder read period in milliseconds
+#define ENCODER_DIRECTION_1 1  // -1 if the tilt magnet turns against the motor
+#define ENCODER_DIRECTION_2 1  // -1 if the pan magnet turns against the motor
+#define ENCODER_TOLERANCE 0.5  // Position error in degrees treated as step loss
+#define ENCODER_LOSS_SAMPLES 3  // Consecutive readings over tolerance before correcting
+#define ENCODER_HOME_READS 8  // Readings compared when homing at power-up
+#define ENCODER_HOME_SPREAD 4  // Largest spread in counts for a trusted homing
+
+// Auto-tune: trials sweep out from the current position and back, so clear
+// TUNE_TRAVEL degrees of range on the tuned axis first
+#define TUNE_TRAVEL 90  // Degrees swept out and back per trial
+#define TUNE_START_SPEED 30  // Baseline trial speed in degrees per second
+#define TUNE_MAX_SPEED 360  // Highest speed tried, degrees per second
+#define TUNE_MAX_ACCELERATION 5000  // Highest acceleration tried, degrees per second squared
+#define TUNE_GROWTH 1.5f  // Step factor until the first stall
+#define TUNE_REFINE_STEPS 3  // Bisection steps after the first stall
+#define TUNE_STALL_FRACTION 0.3f  // StallGuard load below 30% of the baseline is a stall
+#define TUNE_MARGIN 0.7f  // Stored limits are 70% of the highest passing values
+#define TUNE_RAMP_TIME 0.1f  // Acceleration trial ramp in seconds, about 20 StallGuard readings
+#define LOAD_SAMPLE_INTERVAL 5  // StallGuard poll period while tuning or calibrating in milliseconds
+
+// Resonance calibration: a hard step on one axis, then hold still while the
+// flight recorder captures the StallGuard response for mac/resonance.py
+#define CALIBRATION_STEP 5  // Step size in degrees
+#define CALIBRATION_ACCEL_FACTOR 2  // Step acceleration relative to the axis limit
+#define CALIBRATION_HOLD 2000  // Time spent recording the ringing in milliseconds
+
+// Grid scans for panoramas: move to a tile, wait for the head to settle,
+// fire the shutter and hold still for the exposure
+#define SCAN_SETTLE_WINDOW 150  // Default time the head must hold still before a frame, in milliseconds
+#define SCAN_SETTLE_TOLERANCE 0.1  // Encoder movement in degrees still counted as still, about one count
+#define SCAN_SETTLE_TIMEOUT 2000  // Longest settling wait before the frame is taken anyway
+#define SCAN_SHUTTER_PULSE 50  // Default shutter pulse length in milliseconds
+#define SCAN_EXPOSURE 100  // Default hold after the pulse for the exposure, in milliseconds
+
+// Visual servo on image-space error from the host or the on-board camera
+#define SERVO_FOV_H 54.0f  // Default horizontal field of view in degrees (Sense camera at QVGA)
+#define SERVO_FOV_V 41.0f  // Default vertical field of view in degrees
+#define SERVO_KP 6.0f  // Proportional gain at large errors, per second
+#define SERVO_KP_NEAR 2.0f  // Proportional gain close to the target, per second
+#define SERVO_SCHEDULE_ERROR 5.0f  // Error in degrees from which the full gain applies
+#define SERVO_KI 0.5f  // Integral gain, per second squared
+#define SERVO_KD 0.0f  // Damping on target minus axis velocity
 
 // BLE UUIDs
 #define SERVICE_UUID "4fafc201-1fb5-459e-8fcc-c5c9c331914b"
 #define POSITION_CHAR_UUID "beb5483e-36e1-4688-b7f5-ea07361b26a8"  // Combined pan/tilt
 #define ZERO_CHAR_UUID "beb5483e-36e1-4688-b7f5-ea07361b26aa"
 #define STATUS_CHAR_UUID "5b818d26-7c11-4f24-b87f-4f8a8cc974eb"
+#define JOG_CHAR_UUID "beb5483e-36e1-4688-b7f5-ea07361b26ab"  // Pan/tilt velocity
+#define LIMITS_CHAR_UUID "beb5483e-36e1-4688-b7f5-ea07361b26ac"  // Per-axis velocity/acceleration/jerk
+#define TUNE_CHAR_UUID "beb5483e-36e1-4688-b7f5-ea07361b26ad"  // Auto-tune control and result
+#define SHAPER_CHAR_UUID "beb5483e-36e1-4688-b7f5-ea07361b26ae"  // Input shaper config and calibration
+#define BULK_CONTROL_CHAR_UUID "beb5483e-36e1-4688-b7f5-ea07361b26af"  // Bulk transfer control and acks
+#define BULK_DATA_CHAR_UUID "beb5483e-36e1-4688-b7f5-ea07361b26b0"  // Bulk transfer chunks
+#define VISION_CHAR_UUID "beb5483e-36e1-4688-b7f5-ea07361b26b1"  // On-board tracking control and stats
+#define SERVO_CHAR_UUID "beb5483e-36e1-4688-b7f5-ea07361b26b2"  // Image-space error and servo gains
+#define POWER_CHAR_UUID "beb5483e-36e1-4688-b7f5-ea07361b26b3"  // Idle policy and power telemetry
+#define DIAG_CHAR_UUID "5b818d26-7c11-4f24-b87f-4f8a8cc974ec"  // Memory diagnostics
+#define LOG_CHAR_UUID "5b818d26-7c11-4f24-b87f-4f8a8cc974ed"  // Runtime log filter
+#define RECORDER_CHAR_UUID "5b818d26-7c11-4f24-b87f-4f8a8cc974ee"  // Flight recorder control and download
+#define POSE_CHAR_UUID "5b818d26-7c11-4f24-b87f-4f8a8cc974ef"  // Timestamped pan/tilt for host-side tracking
+#define CONTROL_CHAR_UUID "beb5483e-36e1-4688-b7f5-ea07361b26b4"  // Control arbitration and per-client telemetry rates
+#define SCAN_CHAR_UUID "beb5483e-36e1-4688-b7f5-ea07361b26b5"  // Grid scan control and progress
 
 // Create TMC2209 UART instances
 HardwareSerial SerialTMC1(1);  // Use UART1 for motor 1
@@ -51,8 +174,24 @@ BLEService* pService = NULL;
 BLECharacteristic* pPositionCharacteristic = NULL;
 BLECharacteristic* pZeroCharacteristic = NULL;
 BLECharacteristic* pStatusCharacteristic = NULL;
+BLECharacteristic* pJogCharacteristic = NULL;
+BLECharacteristic* pLimitsCharacteristic = NULL;
+BLECharacteristic* pTuneCharacteristic = NULL;
+BLECharacteristic* pShaperCharacteristic = NULL;
+BLECharacteristic* pBulkControlCharacteristic = NULL;
+BLECharacteristic* pBulkDataCharacteristic = NULL;
+BLECharacteristic* pVisionCharacteristic = NULL;
+BLECharacteristic* pServoCharacteristic = NULL;
+BLECharacteristic* pPowerCharacteristic = NULL;
+BLECharacteristic* pPoseCharacteristic = NULL;
+BLECharacteristic* pDiagCharacteristic = NULL;
+BLECharacteristic* pLogCharacteristic = NULL;
+BLECharacteristic* pRecorderCharacteristic = NULL;
+BLECharacteristic* pControlCharacteristic = NULL;
+BLECharacteristic* pScanCharacteristic = NULL;
 bool deviceConnected = false;
-bool oldDeviceConnected = false;
+volatile uint32_t advertisingFastSince = 0;
+volatile bool advertisingFast = false;
 
 // Position tracking
 long targetPosition1 = 0;
@@ -60,133 +199,1219 @@ long targetPosition2 = 0;
 long currentPosition1 = 0;
 long currentPosition2 = 0;
 
-// Speed and acceleration tracking
-float maxSpeed1 = DEFAULT_MAX_SPEED * (TOTAL_STEPS_PER_REV_1 / 360.0);
-float maxSpeed2 = DEFAULT_MAX_SPEED * (TOTAL_STEPS_PER_REV_2 / 360.0);
-float acceleration1 = DEFAULT_ACCELERATION;
-float acceleration2 = DEFAULT_ACCELERATION;
+// Commands from the BLE callbacks, applied from loop() on the next motion tick
+volatile bool positionPending = false;
+volatile bool zeroPending = false;
+volatile bool haltPending = false;
+volatile bool stopPending = false;  // Decelerate to rest, e.g. when the controlling client leaves
+volatile bool haltAwaited = false;  // Halt once the grace period after the last client left runs out
+volatile uint32_t lastClientLeft = 0;  // millis()
 
-// Motor objects
+// Control mode: absolute position targets, continuous velocity (jog) or
+// visual servoing on image-space error from the host or on-board camera
+enum ControlMode { MODE_POSITION, MODE_JOG, MODE_TRACK };
+volatile ControlMode controlMode = MODE_POSITION;
+volatile float jogVelocity1 = 0;
+volatile float jogVelocity2 = 0;
+volatile unsigned long lastJogCommand = 0;
+volatile unsigned long jogTimeout = DEFAULT_JOG_TIMEOUT;
+
+// Kinematic limits in steps; the limits characteristic swaps both axes in together
+AxisLimits pendingLimits1;
+AxisLimits pendingLimits2;
+volatile bool limitsPending = false;
+portMUX_TYPE limitsMux = portMUX_INITIALIZER_UNLOCKED;
+
+// Auto-tune state; tuneRequest is 1 (tilt) or 2 (pan) from the BLE callback,
+// tuneAxis the axis being tuned, 0 when idle
+volatile uint8_t tuneRequest = 0;
+volatile bool tuneCancel = false;
+volatile uint8_t tuneAxis = 0;
+
+// Fast StallGuard sampling for auto-tune and resonance calibration
+volatile uint8_t loadSampleAxis = 0;  // 0 when not sampling
+volatile uint16_t driverLoad[3] = { 0 };  // Latest SG_RESULT per axis
+volatile uint32_t driverLoadCount[3] = { 0 };
+
+// Input shaping; new settings are applied once the axis is at rest
+struct ShaperSettings {
+    ShaperType type;
+    float frequency;
+    float damping;
+};
+ShaperSettings pendingShaper[3];
+volatile bool shaperPending[3] = { false };
+portMUX_TYPE shaperMux = portMUX_INITIALIZER_UNLOCKED;
+volatile uint8_t calibrateRequest = 0;
+uint8_t calibrateAxis = 0;
+InputShaper shaper1;
+InputShaper shaper2;
+Preferences preferences;
+
+// Settings to store; the motion tick only flags them and the settings task
+// writes NVS, which can block for milliseconds on a flash erase
+enum SettingsSave : uint8_t {
+    SAVE_SHAPER_TILT = 1 << 0,
+    SAVE_SHAPER_PAN = 1 << 1,
+    SAVE_LIMITS_TILT = 1 << 2,
+    SAVE_LIMITS_PAN = 1 << 3,
+    SAVE_ENCODER_ZERO = 1 << 4,
+    SAVE_IDLE_CONFIG = 1 << 5,  // Also applies its light sleep setting
+};
+volatile uint8_t settingsToSave = 0;
+ShaperSettings shaperToSave[3];
+float tunedToSave[3][2];  // Velocity and acceleration in degrees
+uint16_t encoderZeroToSave[3];
+portMUX_TYPE settingsMux = portMUX_INITIALIZER_UNLOCKED;
+TaskHandle_t settingsTaskHandle = NULL;
+
+// Shaft encoders. encoderOrigin is the count at the zero position; the
+// encoder task flags a correction in steps for loop() to apply.
+ShaftEncoder encoder1(Wire);
+ShaftEncoder encoder2(Wire1);
+bool encoderActive[3] = { false };
+volatile long encoderOrigin[3] = { 0 };
+volatile long encoderCounts[3] = { 0 };
+volatile long encoderMeasured[3] = { 0 };  // Shaft position in steps at the last reading
+volatile long encoderCorrection[3] = { 0 };
+volatile bool encoderCorrectionPending[3] = { false };
+uint32_t stepLossCount[3] = { 0 };
+bool motorsEnabled = true;
+
+// Idle policy; the power characteristic swaps the settings in together
+enum IdleMode : uint8_t { IDLE_HOLD, IDLE_REDUCE, IDLE_DISABLE };
+const char* idleModeNames[] = { "hold", "reduce", "disable" };
+struct IdleConfig {
+    uint8_t mode;
+    uint32_t holdTime;  // milliseconds
+    uint8_t holdPercent;
+    bool lightSleep;
+};
+IdleConfig idleConfig = { IDLE_REDUCE, IDLE_HOLD_TIME, IDLE_HOLD_PERCENT, true };
+IdleConfig pendingIdleConfig;
+volatile bool idleConfigPending = false;
+portMUX_TYPE idleConfigMux = portMUX_INITIALIZER_UNLOCKED;
+volatile bool idle = false;  // Idle policy applied, loop() blocks between ticks
+volatile bool atRest = true;  // Nothing moving, tracking, tuning or scanning as of the last tick
+unsigned long lastActive = 0;
+volatile float driverHoldMultiplier = MOTOR_HOLD_MULTIPLIER;  // Applied by the driver task
+volatile uint8_t driverCurrentScale[3] = { 0 };  // CS_ACTUAL from the last status poll
+PowerStats powerStats = {};
+
+// Grid scan; the scan characteristic hands over a plan and the motion tick
+// runs it. Timings in milliseconds.
+struct ScanTiming {
+    uint16_t settleWindow;
+    uint16_t pulse;
+    uint16_t exposure;
+};
+ScanTiming scanTiming = { SCAN_SETTLE_WINDOW, SCAN_SHUTTER_PULSE, SCAN_EXPOSURE };
+ScanConfig pendingScanConfig;
+ScanTiming pendingScanTiming;
+volatile bool scanRequest = false;
+volatile bool scanCancel = false;
+volatile bool scanTimingPending = false;
+portMUX_TYPE scanMux = portMUX_INITIALIZER_UNLOCKED;
+volatile bool scanning = false;
+ScanPlan scanPlan;
+volatile uint16_t scanIndex = 0;  // Tile being taken
+
+// Latest image-space error, normalised to -1..1 with x right and y down, and
+// the local time its frame was captured
+struct ImageError {
+    float x;
+    float y;
+    uint32_t captureTime;
+    uint32_t sequence;
+};
+ImageError imageError = { 0, 0, 0, 0 };
+portMUX_TYPE imageErrorMux = portMUX_INITIALIZER_UNLOCKED;
+volatile bool cameraTracking = false;  // The on-board camera feeds the servo
+ClockSync hostClock;
+
+// Servo gains and field of view; the servo characteristic swaps them in together
+struct ServoConfig {
+    float kp;
+    float kpNear;
+    float scheduleError;  // degrees
+    float ki;
+    float kd;
+    float fovH;  // degrees
+    float fovV;
+};
+ServoConfig servoConfig = { SERVO_KP, SERVO_KP_NEAR, SERVO_SCHEDULE_ERROR, SERVO_KI, SERVO_KD, SERVO_FOV_H, SERVO_FOV_V };
+ServoConfig pendingServoConfig;
+volatile bool servoConfigPending = false;
+portMUX_TYPE servoConfigMux = portMUX_INITIALIZER_UNLOCKED;
+
+// Motor objects; AccelStepper only generates the step pulses
 AccelStepper stepper1(AccelStepper::DRIVER, STEP_PIN_1, DIR_PIN_1);
 AccelStepper stepper2(AccelStepper::DRIVER, STEP_PIN_2, DIR_PIN_2);
 
+// Visual servo per axis
+VisualServo servo1({ SERVO_KP, SERVO_KP_NEAR, (float)(SERVO_SCHEDULE_ERROR * STEPS_PER_DEGREE_1), SERVO_KI, SERVO_KD });
+VisualServo servo2({ SERVO_KP, SERVO_KP_NEAR, (float)(SERVO_SCHEDULE_ERROR * STEPS_PER_DEGREE_2), SERVO_KI, SERVO_KD });
+
+// Trajectory generators
+MotionAxis motion1({
+    (float)(DEFAULT_MAX_SPEED * STEPS_PER_DEGREE_1),
+    (float)(DEFAULT_ACCELERATION * STEPS_PER_DEGREE_1),
+    (float)(DEFAULT_JERK * STEPS_PER_DEGREE_1)
+});
+MotionAxis motion2({
+    (float)(DEFAULT_MAX_SPEED * STEPS_PER_DEGREE_2),
+    (float)(DEFAULT_ACCELERATION * STEPS_PER_DEGREE_2),
+    (float)(DEFAULT_JERK * STEPS_PER_DEGREE_2)
+});
+
+// Copy a characteristic value into a NUL-terminated buffer without going
+// through getValue(), which returns a heap-allocated std::string
+size_t readCommand(BLECharacteristic* pCharacteristic, char* buffer, size_t size) {
+    size_t length = min(pCharacteristic->getLength(), size - 1);
+    memcpy(buffer, pCharacteristic->getData(), length);
+    buffer[length] = '\0';
+    powerWake();  // Every command ends an idle wait
+    return length;
+}
+
 // BLE callbacks
+// Motion commands and every write that changes settings go through control
+// arbitration; a refused command is dropped
+bool commandAllowed(uint16_t connId) {
+    if (controlAcquire(connId)) {
+        return true;
+    }
+    LOG_WARN(LOG_CAT_BLE, MSG_CONTROL_DENIED, connId, controlOwner());
+    return false;
+}
+
+// Advertise quickly right after boot or a dropout so a client that lost the
+// link finds the robot again at once, then back off to save power
+void startAdvertising(bool fast) {
+    BLEAdvertising* pAdvertising = BLEDevice::getAdvertising();
+    pAdvertising->stop();
+    pAdvertising->setMinInterval(fast ? ADV_FAST_MIN : ADV_SLOW_MIN);
+    pAdvertising->setMaxInterval(fast ? ADV_FAST_MAX : ADV_SLOW_MAX);
+    advertisingFastSince = millis();
+    advertisingFast = fast;
+    BLEDevice::startAdvertising();
+}
+
 class ServerCallbacks: public BLEServerCallbacks {
-    void onConnect(BLEServer* pServer) {
+    void onConnect(BLEServer* pServer, esp_ble_gatts_cb_param_t* param) {
+        uint32_t away = centralsConnected(param->connect.conn_id, param->connect.remote_bda);
         deviceConnected = true;
-        Serial.println("Device connected");
+        haltAwaited = false;
+        LOG_INFO(LOG_CAT_BLE, MSG_CONNECTED, param->connect.conn_id, centralsCount());
+        if (away != RECONNECT_NONE) {
+            LOG_INFO(LOG_CAT_BLE, MSG_RECONNECTED, param->connect.conn_id, away);
+        }
+        // Keep advertising so another client can join
+        if (centralsCount() < MAX_CENTRALS) {
+            BLEDevice::startAdvertising();
+        }
     }
 
-    void onDisconnect(BLEServer* pServer) {
-        deviceConnected = false;
-        Serial.println("Device disconnected");
-        // Stop motors when disconnected
-        stepper1.stop();
-        stepper2.stop();
-        stepper1.disableOutputs();
-        stepper2.disableOutputs();
+    void onDisconnect(BLEServer* pServer, esp_ble_gatts_cb_param_t* param) {
+        bool owner = centralsDisconnected(param->disconnect.conn_id);
+        deviceConnected = centralsCount() > 0;
+        LOG_INFO(LOG_CAT_BLE, MSG_DISCONNECTED, param->disconnect.conn_id, centralsCount());
+        if (!deviceConnected) {
+            // Last client gone: come to rest, holding position for a while
+            // in case it is only a dropout, then switch the outputs off
+            controlMode = MODE_POSITION;
+            positionPending = false;
+            cameraTracking = false;
+            stopPending = true;
+            lastClientLeft = millis();
+            haltAwaited = true;
+        } else if (owner) {
+            // The remaining clients did not ask for this motion; bring it to rest
+            controlMode = MODE_POSITION;
+            positionPending = false;
+            cameraTracking = false;
+            stopPending = true;
+        }
+        // Straight from here rather than from loop(), so the client that
+        // dropped can reconnect as soon as it notices
+        startAdvertising(true);
     }
 };
 
-class PositionCallbacks: public BLECharacteristicCallbacks {
+class PositionCallbacks: public CommandCallbacks {
     void onWrite(BLECharacteristic* pCharacteristic) {
-        std::string value = pCharacteristic->getValue();
-        if (value.length() > 0) {
-            Serial.print("Received position command: ");
-            Serial.println(value.c_str());
-            
+        AllocScope allocScope(ALLOC_BLE_CALLBACK);
+        char value[COMMAND_BUFFER_SIZE];
+        if (readCommand(pCharacteristic, value, sizeof(value)) > 0) {
             // Parse the combined pan/tilt message
-            size_t commaPos = value.find(',');
-            if (commaPos != std::string::npos) {
-                std::string panStr = value.substr(0, commaPos);
-                std::string tiltStr = value.substr(commaPos + 1);
-                
-                float panDegrees = atof(panStr.c_str());
-                float tiltDegrees = atof(tiltStr.c_str());
-                
-                Serial.print("Parsed pan: ");
-                Serial.print(panDegrees);
-                Serial.print(" tilt: ");
-                Serial.println(tiltDegrees);
-                
+            float panDegrees, tiltDegrees;
+            if (parsePosition(value, panDegrees, tiltDegrees)) {
+                if (!commandAllowed(_connId)) {
+                    return;
+                }
                 // Convert degrees to steps for each motor
-                targetPosition1 = tiltDegrees * (TOTAL_STEPS_PER_REV_1 / 360.0);
-                targetPosition2 = panDegrees * (TOTAL_STEPS_PER_REV_2 / 360.0);
+                targetPosition1 = tiltDegrees * STEPS_PER_DEGREE_1;
+                targetPosition2 = panDegrees * STEPS_PER_DEGREE_2;
                 
-                Serial.print("Target steps - Motor 1: ");
-                Serial.print(targetPosition1);
-                Serial.print(" Motor 2: ");
-                Serial.println(targetPosition2);
+                LOG_DEBUG(LOG_CAT_MOTION, MSG_POSITION_CMD, panDegrees, tiltDegrees, targetPosition1, targetPosition2);
+                recorderRecord(REC_COMMAND, 0, CMD_POSITION, recorderFloat(panDegrees), recorderFloat(tiltDegrees));
                 
-                stepper1.moveTo(targetPosition1);
-                stepper2.moveTo(targetPosition2);
-                stepper1.enableOutputs();
-                stepper2.enableOutputs();
+                controlMode = MODE_POSITION;
+                positionPending = true;
             } else {
-                Serial.println("Invalid position format");
+                LOG_WARN(LOG_CAT_BLE, MSG_POSITION_INVALID);
             }
         }
     }
 };
 
-class ZeroCallbacks: public BLECharacteristicCallbacks {
+class ZeroCallbacks: public CommandCallbacks {
     void onWrite(BLECharacteristic* pCharacteristic) {
-        std::string value = pCharacteristic->getValue();
-        if (value == "zero") {
+        AllocScope allocScope(ALLOC_BLE_CALLBACK);
+        char value[COMMAND_BUFFER_SIZE];
+        readCommand(pCharacteristic, value, sizeof(value));
+        if (strcmp(value, "zero") == 0 && commandAllowed(_connId)) {
             // Set current position as zero for both motors
-            stepper1.setCurrentPosition(0);
-            stepper2.setCurrentPosition(0);
-            currentPosition1 = 0;
-            currentPosition2 = 0;
-            targetPosition1 = 0;
-            targetPosition2 = 0;
+            controlMode = MODE_POSITION;
+            positionPending = false;
+            zeroPending = true;
             
             // Update status
-            String status = "Zero position set";
-            pStatusCharacteristic->setValue(status.c_str());
-            pStatusCharacteristic->notify();
+            LOG_INFO(LOG_CAT_MOTION, MSG_ZERO);
+            recorderRecord(REC_COMMAND, 0, CMD_ZERO, 0, 0);
+            centralsNotify(CHANNEL_STATUS, "Zero position set");
             
-            // Ensure motors are enabled after zeroing
-            stepper1.enableOutputs();
-            stepper2.enableOutputs();
         }
     }
 };
 
-class SpeedCallbacks1: public BLECharacteristicCallbacks {
+class JogCallbacks: public CommandCallbacks {
+    void onWrite(BLECharacteristic* pCharacteristic) {
+        AllocScope allocScope(ALLOC_BLE_CALLBACK);
+        char value[COMMAND_BUFFER_SIZE];
+        if (readCommand(pCharacteristic, value, sizeof(value)) > 0) {
+            // Parse "pan,tilt[,timeout]" with velocities in degrees per second
+            // and an optional deadman timeout in milliseconds
+            float panVelocity, tiltVelocity;
+            long timeout;
+            int fields = parseJog(value, panVelocity, tiltVelocity, timeout);
+            if (fields == 0) {
+                LOG_WARN(LOG_CAT_BLE, MSG_JOG_INVALID);
+                return;
+            }
+            if (!commandAllowed(_connId)) {
+                return;
+            }
+            recorderRecord(REC_COMMAND, 0, CMD_JOG, recorderFloat(panVelocity), recorderFloat(tiltVelocity));
+            if (fields == 3) {
+                jogTimeout = constrain(timeout, 1L, (long)MAX_JOG_TIMEOUT);
+            }
+
+            // Convert degrees/sec to steps/sec; MotionAxis applies the speed limit
+            jogVelocity1 = tiltVelocity * STEPS_PER_DEGREE_1;
+            jogVelocity2 = panVelocity * STEPS_PER_DEGREE_2;
+
+            lastJogCommand = millis();
+            controlMode = MODE_JOG;
+        }
+    }
+};
+
+class DiagCallbacks: public BLECharacteristicCallbacks {
+    void onRead(BLECharacteristic* pCharacteristic) {
+        // Serve a fresh sample rather than the last periodic one
+        MemStats stats;
+        char record[128];
+        memstatsSample(stats);
+        memstatsFormat(record, sizeof(record), stats);
+        pCharacteristic->setValue(record);
+    }
+};
+
+class LogCallbacks: public CommandCallbacks {
+    void onWrite(BLECharacteristic* pCharacteristic) {
+        char value[COMMAND_BUFFER_SIZE];
+        if (readCommand(pCharacteristic, value, sizeof(value)) > 0 && commandAllowed(_connId)) {
+            // Parse "level[,categories]" where categories is a bit mask of LogCategory
+            char* end;
+            logLevel = min(strtoul(value, &end, 10), (unsigned long)LOG_LEVEL_ERROR);
+            if (*end == ',') {
+                logCategoryMask = strtoul(end + 1, NULL, 0);
+            }
+            LOG(LOG_LEVEL_ERROR, LOG_CAT_SYSTEM, MSG_LOG_CONFIG, logLevel, logCategoryMask);
+        }
+    }
+};
+
+class RecorderCallbacks: public CommandCallbacks {
+    void onRead(BLECharacteristic* pCharacteristic) {
+        char info[128];
+        recorderFormatInfo(info, sizeof(info));
+        pCharacteristic->setValue(info);
+    }
+
+    void onWrite(BLECharacteristic* pCharacteristic) {
+        char value[COMMAND_BUFFER_SIZE];
+        readCommand(pCharacteristic, value, sizeof(value));
+        if (strcmp(value, "freeze") == 0) {
+            if (commandAllowed(_connId)) {
+                recorderTrigger(TRIGGER_MANUAL);
+            }
+        } else if (strcmp(value, "arm") == 0) {
+            if (commandAllowed(_connId)) {
+                recorderArm();
+            }
+        } else if (strncmp(value, "dump", 4) == 0) {
+            // "dump[,chunk]" resumes an interrupted download from a chunk index
+            uint32_t fromChunk = value[4] == ',' ? strtoul(value + 5, NULL, 10) : 0;
+            recorderStartDownload(pCharacteristic, _connId, fromChunk);
+        }
+    }
+};
+
+class LimitsCallbacks: public CommandCallbacks {
+    void onRead(BLECharacteristic* pCharacteristic) {
+        AxisLimits tilt = motion1.limits();
+        AxisLimits pan = motion2.limits();
+        char value[COMMAND_BUFFER_SIZE * 2];
+        snprintf(value, sizeof(value), "%.1f,%.1f,%.1f,%.1f,%.1f,%.1f",
+                 pan.velocity / STEPS_PER_DEGREE_2, pan.acceleration / STEPS_PER_DEGREE_2, pan.jerk / STEPS_PER_DEGREE_2,
+                 tilt.velocity / STEPS_PER_DEGREE_1, tilt.acceleration / STEPS_PER_DEGREE_1, tilt.jerk / STEPS_PER_DEGREE_1);
+        pCharacteristic->setValue(value);
+    }
+
+    void onWrite(BLECharacteristic* pCharacteristic) {
+        AllocScope allocScope(ALLOC_BLE_CALLBACK);
+        char value[COMMAND_BUFFER_SIZE];
+        readCommand(pCharacteristic, value, sizeof(value));
+
+        // Parse "panVel,panAccel,panJerk,tiltVel,tiltAccel,tiltJerk" in degrees
+        // per second, per second squared and per second cubed (jerk 0 = unlimited)
+        float fields[6];
+        if (!parseLimits(value, fields)) {
+            LOG_WARN(LOG_CAT_BLE, MSG_LIMITS_INVALID);
+            return;
+        }
+        if (!commandAllowed(_connId)) {
+            return;
+        }
+
+        AxisLimits pan = {
+            (float)(min(fields[0], (float)(MAX_STEP_RATE / STEPS_PER_DEGREE_2)) * STEPS_PER_DEGREE_2),
+            (float)(fields[1] * STEPS_PER_DEGREE_2),
+            (float)(fields[2] * STEPS_PER_DEGREE_2)
+        };
+        AxisLimits tilt = {
+            (float)(min(fields[3], (float)(MAX_STEP_RATE / STEPS_PER_DEGREE_1)) * STEPS_PER_DEGREE_1),
+            (float)(fields[4] * STEPS_PER_DEGREE_1),
+            (float)(fields[5] * STEPS_PER_DEGREE_1)
+        };
+        portENTER_CRITICAL(&limitsMux);
+        pendingLimits1 = tilt;
+        pendingLimits2 = pan;
+        limitsPending = true;
+        portEXIT_CRITICAL(&limitsMux);
+        LOG_INFO(LOG_CAT_MOTION, MSG_LIMITS, fields[0], fields[1], fields[2], fields[3], fields[4], fields[5]);
+    }
+};
+
+class TuneCallbacks: public CommandCallbacks {
+    void onWrite(BLECharacteristic* pCharacteristic) {
+        // "tilt" or "pan" starts tuning that axis, "cancel" aborts it
+        char value[COMMAND_BUFFER_SIZE];
+        readCommand(pCharacteristic, value, sizeof(value));
+        if (strcmp(value, "cancel") != 0 && !commandAllowed(_connId)) {
+            return;
+        }
+        if (strcmp(value, "tilt") == 0) {
+            tuneRequest = 1;
+        } else if (strcmp(value, "pan") == 0) {
+            tuneRequest = 2;
+        } else if (strcmp(value, "cancel") == 0) {
+            tuneCancel = true;
+        }
+    }
+};
+
+const char* shaperNames[] = { "none", "zv", "zvd", "ei" };
+
+class ShaperCallbacks: public CommandCallbacks {
+    void onRead(BLECharacteristic* pCharacteristic) {
+        char value[96];
+        snprintf(value, sizeof(value), "pan,%s,%.2f,%.3f;tilt,%s,%.2f,%.3f",
+                 shaperNames[shaper2.type()], shaper2.frequency(), shaper2.damping(),
+                 shaperNames[shaper1.type()], shaper1.frequency(), shaper1.damping());
+        pCharacteristic->setValue(value);
+    }
+
     void onWrite(BLECharacteristic* pCharacteristic) {
-        std::string value = pCharacteristic->getValue();
-        if (value.length() > 0) {
-            float speed = atof(value.c_str());
-            // Limit speed to prevent skipping
-            speed = min(speed, 90.0f);  // Max 90 degrees per second
-            maxSpeed1 = speed * (TOTAL_STEPS_PER_REV_1 / 360.0);  // Convert degrees/sec to steps/sec
-            acceleration1 = maxSpeed1 * 2;  // Set acceleration proportional to max speed
-            stepper1.setMaxSpeed(maxSpeed1);
-            stepper1.setAcceleration(acceleration1);
+        // "axis,type[,frequency,damping]" configures a shaper, e.g. "pan,zvd,4.5,0.1";
+        // "calibrate,axis" runs the resonance calibration move
+        char value[COMMAND_BUFFER_SIZE];
+        readCommand(pCharacteristic, value, sizeof(value));
+        char* fields[4] = { NULL };
+        int count = 0;
+        for (char* token = strtok(value, ","); token != NULL && count < 4; token = strtok(NULL, ",")) {
+            fields[count++] = token;
+        }
+        if (count < 2) {
+            LOG_WARN(LOG_CAT_BLE, MSG_SHAPER_INVALID);
+            return;
+        }
+
+        bool calibrate = strcmp(fields[0], "calibrate") == 0;
+        const char* axisName = calibrate ? fields[1] : fields[0];
+        uint8_t axis = strcmp(axisName, "tilt") == 0 ? 1 : strcmp(axisName, "pan") == 0 ? 2 : 0;
+        if (axis == 0) {
+            LOG_WARN(LOG_CAT_BLE, MSG_SHAPER_INVALID);
+            return;
+        }
+        if (calibrate) {
+            if (commandAllowed(_connId)) {
+                // Arming waits for recorder writers to settle, so it happens
+                // here rather than in the motion tick
+                recorderArm();
+                calibrateRequest = axis;
+            }
+            return;
+        }
+
+        int type = -1;
+        for (int i = 0; i < 4; i++) {
+            if (strcmp(fields[1], shaperNames[i]) == 0) {
+                type = i;
+            }
+        }
+        if (type < 0 || (type != SHAPER_NONE && count < 4)) {
+            LOG_WARN(LOG_CAT_BLE, MSG_SHAPER_INVALID);
+            return;
         }
+        if (!commandAllowed(_connId)) {
+            return;
+        }
+        ShaperSettings settings = {
+            (ShaperType)type,
+            type != SHAPER_NONE ? strtof(fields[2], NULL) : 0,
+            type != SHAPER_NONE ? strtof(fields[3], NULL) : 0
+        };
+        portENTER_CRITICAL(&shaperMux);
+        pendingShaper[axis] = settings;
+        shaperPending[axis] = true;
+        portEXIT_CRITICAL(&shaperMux);
+    }
+};
+
+class BulkControlCallbacks: public CommandCallbacks {
+    void onRead(BLECharacteristic* pCharacteristic) {
+        char status[96];
+        bulkFormatStatus(status, sizeof(status));
+        pCharacteristic->setValue(status);
+    }
+
+    void onWrite(BLECharacteristic* pCharacteristic) {
+        char value[COMMAND_BUFFER_SIZE];
+        readCommand(pCharacteristic, value, sizeof(value));
+        if (!commandAllowed(_connId)) {
+            refuse(pCharacteristic, "error,control");
+            return;
+        }
+        // A firmware image only goes in with the head at rest, since the
+        // restart at the end would cut off whatever it was doing
+        if (strncmp(value, "start,", 6) == 0 && !atRest) {
+            LOG_WARN(LOG_CAT_BLE, MSG_OTA_BUSY);
+            refuse(pCharacteristic, "error,busy");
+            return;
+        }
+        bulkControl(value, _connId);
+    }
+
+    // Straight back to the writer only. This is the BLE task, which delivers
+    // the send confirmations, so it must not wait for one.
+    void refuse(BLECharacteristic* pCharacteristic, const char* reply) {
+        centralsSend(_connId, pCharacteristic, (const uint8_t*)reply, strlen(reply), false);
     }
 };
 
-class SpeedCallbacks2: public BLECharacteristicCallbacks {
+class BulkDataCallbacks: public CommandCallbacks {
     void onWrite(BLECharacteristic* pCharacteristic) {
-        std::string value = pCharacteristic->getValue();
-        if (value.length() > 0) {
-            float speed = atof(value.c_str());
-            // Limit speed to prevent skipping
-            speed = min(speed, 90.0f);  // Max 90 degrees per second
-            maxSpeed2 = speed * (TOTAL_STEPS_PER_REV_2 / 360.0);  // Convert degrees/sec to steps/sec
-            acceleration2 = maxSpeed2 * 2;  // Set acceleration proportional to max speed
-            stepper2.setMaxSpeed(maxSpeed2);
-            stepper2.setAcceleration(acceleration2);
+        if (commandAllowed(_connId)) {
+            bulkData(pCharacteristic->getData(), pCharacteristic->getLength());
         }
     }
 };
 
+class VisionCallbacks: public CommandCallbacks {
+    void onRead(BLECharacteristic* pCharacteristic) {
+        char stats[128] = "disabled";
+#ifdef VISION_ENABLED
+        cameraFormatStats(stats, sizeof(stats));
+#endif
+        pCharacteristic->setValue(stats);
+    }
+
+    void onWrite(BLECharacteristic* pCharacteristic) {
+        // "track" follows the on-board detection, "stop" holds position,
+        // "bench" times and cross-checks the scalar and fast kernels
+        char value[COMMAND_BUFFER_SIZE];
+        readCommand(pCharacteristic, value, sizeof(value));
+#ifdef VISION_ENABLED
+        if (strcmp(value, "track") == 0 && commandAllowed(_connId)) {
+            positionPending = false;
+            cameraTracking = true;
+            controlMode = MODE_TRACK;
+        } else if (strcmp(value, "stop") == 0 && cameraTracking && commandAllowed(_connId)) {
+            cameraTracking = false;
+            controlMode = MODE_POSITION;
+        } else if (strcmp(value, "bench") == 0) {
+            cameraRequestBench();
+        }
+#endif
+    }
+};
+
+// Hand a new image-space error to the motion tick
+void postImageError(float x, float y, uint32_t captureTime) {
+    portENTER_CRITICAL(&imageErrorMux);
+    imageError.x = x;
+    imageError.y = y;
+    imageError.captureTime = captureTime;
+    imageError.sequence++;
+    portEXIT_CRITICAL(&imageErrorMux);
+    powerWake();
+}
+
+class ServoCallbacks: public CommandCallbacks {
+    void onRead(BLECharacteristic* pCharacteristic) {
+        char value[96];
+        snprintf(value, sizeof(value), "%.2f,%.2f,%.2f,%.2f,%.2f,%.1f,%.1f",
+                 servoConfig.kp, servoConfig.kpNear, servoConfig.scheduleError,
+                 servoConfig.ki, servoConfig.kd, servoConfig.fovH, servoConfig.fovV);
+        pCharacteristic->setValue(value);
+    }
+
+    void onWrite(BLECharacteristic* pCharacteristic) {
+        // "x,y,t": normalised image error of the subject (-1..1, x right, y
+        // down) and the host capture time in milliseconds; sent every frame
+        // "gains,kp,kpNear,scheduleError,ki,kd" and "fov,horizontal,vertical"
+        // in degrees configure the servo; "stop" holds position
+        char value[COMMAND_BUFFER_SIZE];
+        readCommand(pCharacteristic, value, sizeof(value));
+        if (strncmp(value, "gains,", 6) == 0 || strncmp(value, "fov,", 4) == 0) {
+            bool gains = value[0] == 'g';
+            int count = gains ? 5 : 2;
+            float fields[5];
+            char* end = strchr(value, ',');
+            for (int i = 0; i < count; i++) {
+                if (*end != ',') {
+                    LOG_WARN(LOG_CAT_BLE, MSG_SERVO_INVALID);
+                    return;
+                }
+                fields[i] = strtof(end + 1, &end);
+            }
+            ServoConfig config = servoConfig;
+            if (gains) {
+                config.kp = fields[0];
+                config.kpNear = fields[1];
+                config.scheduleError = fields[2];
+                config.ki = fields[3];
+                config.kd = fields[4];
+            } else {
+                config.fovH = fields[0];
+                config.fovV = fields[1];
+            }
+            if (config.fovH <= 0 || config.fovH >= 180 || config.fovV <= 0 || config.fovV >= 180) {
+                LOG_WARN(LOG_CAT_BLE, MSG_SERVO_INVALID);
+                return;
+            }
+            if (!commandAllowed(_connId)) {
+                return;
+            }
+            portENTER_CRITICAL(&servoConfigMux);
+            pendingServoConfig = config;
+            servoConfigPending = true;
+            portEXIT_CRITICAL(&servoConfigMux);
+            return;
+        }
+        if (strcmp(value, "stop") == 0) {
+            if (controlMode == MODE_TRACK && commandAllowed(_connId)) {
+                controlMode = MODE_POSITION;
+            }
+            return;
+        }
+
+        char* end;
+        float x = strtof(value, &end);
+        if (*end != ',') {
+            LOG_WARN(LOG_CAT_BLE, MSG_SERVO_INVALID);
+            return;
+        }
+        float y = strtof(end + 1, &end);
+        if (*end != ',') {
+            LOG_WARN(LOG_CAT_BLE, MSG_SERVO_INVALID);
+            return;
+        }
+        uint32_t hostTime = strtoul(end + 1, NULL, 10);
+        if (!commandAllowed(_connId)) {
+            return;
+        }
+        postImageError(x, y, hostClock.toLocal(hostTime * 1000, micros()));
+        positionPending = false;
+        cameraTracking = false;
+        controlMode = MODE_TRACK;
+    }
+};
+
+// RMS coil current for a driver current scale (TMC2209 datasheet). TMCStepper
+// picks the high-sensitivity range when the run current would use less than
+// half the scale, as it does for MOTOR_CURRENT with this sense resistor.
+uint16_t motorCurrent(uint8_t axis) {
+    if (!motorsEnabled) {
+        return 0;
+    }
+    const float resistance = R_SENSE + 0.02f;
+    float fullScale = 32 * M_SQRT2 * MOTOR_CURRENT / 1000.0f * resistance / 0.325f < 16 ? 0.180f : 0.325f;
+    return (driverCurrentScale[axis] + 1) / 32.0f * fullScale / resistance / M_SQRT2 * 1000;
+}
+
+class PowerCallbacks: public CommandCallbacks {
+    void onRead(BLECharacteristic* pCharacteristic) {
+        // "mode,holdTime,holdPercent,sleep;state,tiltCurrent,panCurrent,idlePercent,wakes,lastWake,maxWake"
+        // with currents in mA and wake latencies in microseconds
+        char value[128];
+        snprintf(value, sizeof(value), "%s,%lu,%u,%u;%s,%u,%u,%u,%lu,%lu,%lu",
+                 idleModeNames[idleConfig.mode], (unsigned long)idleConfig.holdTime, idleConfig.holdPercent,
+                 powerStats.lightSleep, idle ? "idle" : "active", motorCurrent(1), motorCurrent(2),
+                 powerStats.idlePercent, (unsigned long)powerStats.wakes,
+                 (unsigned long)powerStats.lastWakeLatency, (unsigned long)powerStats.maxWakeLatency);
+        pCharacteristic->setValue(value);
+    }
+
+    void onWrite(BLECharacteristic* pCharacteristic) {
+        // "mode,holdTime[,holdPercent[,sleep]]": mode hold, reduce or disable,
+        // the rest time in milliseconds before it applies, the reduced hold
+        // current in percent and 1 to allow automatic light sleep
+        char value[COMMAND_BUFFER_SIZE];
+        readCommand(pCharacteristic, value, sizeof(value));
+        char* fields[4] = { NULL };
+        int count = 0;
+        for (char* token = strtok(value, ","); token != NULL && count < 4; token = strtok(NULL, ",")) {
+            fields[count++] = token;
+        }
+        int mode = -1;
+        for (int i = 0; i < 3 && count >= 2; i++) {
+            if (strcmp(fields[0], idleModeNames[i]) == 0) {
+                mode = i;
+            }
+        }
+        long holdTime = count >= 2 ? strtol(fields[1], NULL, 10) : 0;
+        long holdPercent = count >= 3 ? strtol(fields[2], NULL, 10) : idleConfig.holdPercent;
+        if (mode < 0 || holdTime <= 0 || holdPercent < 0 || holdPercent > 100) {
+            LOG_WARN(LOG_CAT_BLE, MSG_POWER_INVALID);
+            return;
+        }
+        if (!commandAllowed(_connId)) {
+            return;
+        }
+
+        portENTER_CRITICAL(&idleConfigMux);
+        pendingIdleConfig.mode = mode;
+        pendingIdleConfig.holdTime = holdTime;
+        pendingIdleConfig.holdPercent = holdPercent;
+        pendingIdleConfig.lightSleep = count >= 4 ? strtol(fields[3], NULL, 10) != 0 : idleConfig.lightSleep;
+        idleConfigPending = true;
+        portEXIT_CRITICAL(&idleConfigMux);
+    }
+};
+
+const char* priorityNames[] = { "default", "tracker", "operator" };
+const char* channelNames[] = { "status", "pose", "diag" };
+
+class ControlCallbacks: public CommandCallbacks {
+    void onRead(BLECharacteristic* pCharacteristic) {
+        char value[160];
+        centralsFormat(value, sizeof(value));
+        pCharacteristic->setValue(value);
+    }
+
+    void onWrite(BLECharacteristic* pCharacteristic) {
+        // "claim,role" with role default, tracker or operator sets this
+        // client's priority; "release" hands control back at once;
+        // "rate,channel,interval" limits status, pose or diag notifications
+        // to this client to one per interval milliseconds (0 = every one)
+        char value[COMMAND_BUFFER_SIZE];
+        readCommand(pCharacteristic, value, sizeof(value));
+        char* fields[3] = { NULL };
+        int count = 0;
+        for (char* token = strtok(value, ","); token != NULL && count < 3; token = strtok(NULL, ",")) {
+            fields[count++] = token;
+        }
+        if (count == 1 && strcmp(fields[0], "release") == 0) {
+            centralsRelease(_connId);
+            return;
+        }
+        if (count == 2 && strcmp(fields[0], "claim") == 0) {
+            for (int i = 0; i < 3; i++) {
+                if (strcmp(fields[1], priorityNames[i]) == 0) {
+                    centralsSetPriority(_connId, (ControlPriority)i);
+                    LOG_INFO(LOG_CAT_BLE, MSG_CONTROL_CLAIM, _connId, i);
+                    return;
+                }
+            }
+        }
+        if (count == 3 && strcmp(fields[0], "rate") == 0) {
+            for (int i = 0; i < CHANNEL_COUNT; i++) {
+                if (strcmp(fields[1], channelNames[i]) == 0) {
+                    centralsSetRate(_connId, (TelemetryChannel)i, constrain(strtol(fields[2], NULL, 10), 0L, 60000L));
+                    return;
+                }
+            }
+        }
+        LOG_WARN(LOG_CAT_BLE, MSG_CONTROL_INVALID);
+    }
+};
+
+const char* scanOrderNames[] = { "auto", "rows", "columns" };
+
+class ScanCallbacks: public CommandCallbacks {
+    void onRead(BLECharacteristic* pCharacteristic) {
+        // "state,tile,count,columns,rows,order,travel;settle,pulse,exposure"
+        // with the estimated travel time in seconds and timings in milliseconds
+        char value[128];
+        snprintf(value, sizeof(value), "%s,%u,%u,%u,%u,%s,%.1f;%u,%u,%u",
+                 scanning ? "scanning" : "idle", scanIndex, scanPlan.count(), scanPlan.columns(), scanPlan.rows(),
+                 scanPlan.rowMajor() ? "rows" : "columns", scanPlan.travelTime(),
+                 scanTiming.settleWindow, scanTiming.pulse, scanTiming.exposure);
+        pCharacteristic->setValue(value);
+    }
+
+    void onWrite(BLECharacteristic* pCharacteristic) {
+        // "grid,panFrom,panTo,tiltFrom,tiltTo,overlap,fovH,fovV[,order]" scans
+        // the field between the frame edges given, in degrees, with overlap a
+        // fraction of a frame and order auto, rows or columns;
+        // "timing,settle,pulse,exposure" in milliseconds; "cancel" stops
+        char value[COMMAND_BUFFER_SIZE];
+        readCommand(pCharacteristic, value, sizeof(value));
+        char* fields[9] = { NULL };
+        int count = 0;
+        for (char* token = strtok(value, ","); token != NULL && count < 9; token = strtok(NULL, ",")) {
+            fields[count++] = token;
+        }
+        if (count == 1 && strcmp(fields[0], "cancel") == 0) {
+            if (scanning && commandAllowed(_connId)) {
+                scanCancel = true;
+            }
+            return;
+        }
+        if (count == 4 && strcmp(fields[0], "timing") == 0) {
+            if (!commandAllowed(_connId)) {
+                return;
+            }
+            ScanTiming timing;
+            timing.settleWindow = constrain(strtol(fields[1], NULL, 10), 0L, 10000L);
+            timing.pulse = constrain(strtol(fields[2], NULL, 10), 1L, 10000L);
+            timing.exposure = constrain(strtol(fields[3], NULL, 10), 0L, 60000L);
+            portENTER_CRITICAL(&scanMux);
+            pendingScanTiming = timing;
+            scanTimingPending = true;
+            portEXIT_CRITICAL(&scanMux);
+            return;
+        }
+        if (count >= 8 && strcmp(fields[0], "grid") == 0) {
+            ScanConfig config;
+            config.panFrom = strtof(fields[1], NULL);
+            config.panTo = strtof(fields[2], NULL);
+            config.tiltFrom = strtof(fields[3], NULL);
+            config.tiltTo = strtof(fields[4], NULL);
+            config.overlap = strtof(fields[5], NULL);
+            config.fovH = strtof(fields[6], NULL);
+            config.fovV = strtof(fields[7], NULL);
+            int order = count == 9 ? -1 : SCAN_AUTO;
+            for (int i = 0; i < 3 && order < 0; i++) {
+                if (strcmp(fields[8], scanOrderNames[i]) == 0) {
+                    order = i;
+                }
+            }
+            if (order >= 0) {
+                if (!commandAllowed(_connId)) {
+                    return;
+                }
+                config.order = (ScanOrder)order;
+                positionPending = false;
+                cameraTracking = false;
+                controlMode = MODE_POSITION;
+                portENTER_CRITICAL(&scanMux);
+                pendingScanConfig = config;
+                scanRequest = true;
+                portEXIT_CRITICAL(&scanMux);
+                return;
+            }
+        }
+        LOG_WARN(LOG_CAT_BLE, MSG_SCAN_INVALID);
+    }
+};
+
+// Read one driver's status into the flight recorder and freeze it on a fault
+// or a stall
+void pollDriver(TMC2209Stepper& driver, uint8_t axis) {
+    static uint8_t stalledPolls[3] = { 0 };
+    uint32_t status = driver.DRV_STATUS();
+    uint16_t load = driver.SG_RESULT();
+    driverCurrentScale[axis] = (status >> 16) & 0x1F;
+    recorderRecord(REC_DRIVER, axis, load, status, (status >> 16) & 0x1F);
+    if (status & DRIVER_FAULT_MASK) {
+        LOG_ERROR(LOG_CAT_MOTION, MSG_DRIVER_FAULT, axis, status);
+        recorderTrigger(TRIGGER_DRIVER_FAULT);
+    }
+
+    // StallGuard only means something while stepping, and auto-tune stalls
+    // the axis on purpose
+    if ((status & DRIVER_STANDSTILL) || load > STALL_LOAD || loadSampleAxis != 0) {
+        stalledPolls[axis] = 0;
+    } else if (++stalledPolls[axis] == STALL_POLLS) {
+        LOG_WARN(LOG_CAT_MOTION, MSG_DRIVER_STALL, axis, load);
+        recorderTrigger(TRIGGER_STALL);
+    }
+}
+
+// Driver UART reads take around a millisecond each, so they run in their own
+// low-priority task instead of stalling step generation in loop()
+void driverStatusTask(void* parameter) {
+    unsigned long lastStatus = 0;
+    float holdMultiplier = MOTOR_HOLD_MULTIPLIER;
+    for (;;) {
+        // Standstill current for the idle policy; IHOLD only applies once
+        // the driver sees no steps, so motion never waits for this
+        if (driverHoldMultiplier != holdMultiplier) {
+            holdMultiplier = driverHoldMultiplier;
+            driver1.rms_current(MOTOR_CURRENT, holdMultiplier);
+            driver2.rms_current(MOTOR_CURRENT, holdMultiplier);
+        }
+
+        if (millis() - lastStatus >= DRIVER_POLL_INTERVAL) {
+            pollDriver(driver1, 1);
+            pollDriver(driver2, 2);
+            lastStatus = millis();
+        }
+
+        // Auto-tune and calibration need StallGuard readings much faster than the status poll
+        uint8_t axis = loadSampleAxis;
+        if (axis != 0) {
+            uint16_t load = (axis == 1 ? driver1 : driver2).SG_RESULT();
+            driverLoad[axis] = load;
+            driverLoadCount[axis] = driverLoadCount[axis] + 1;
+            recorderRecord(REC_LOAD, axis, load, 0, 0);
+            vTaskDelay(pdMS_TO_TICKS(LOAD_SAMPLE_INTERVAL));
+        } else {
+            vTaskDelay(pdMS_TO_TICKS(DRIVER_POLL_INTERVAL));
+        }
+    }
+}
+
+// Sample both axes into the flight recorder at a fixed rate
+void recordSamples() {
+    static unsigned long lastSample = 0;
+    unsigned long now = micros();
+    if (now - lastSample < RECORDER_SAMPLE_INTERVAL) {
+        return;
+    }
+    lastSample = now;
+    recorderRecord(REC_SAMPLE, 1, 0, stepper1.currentPosition(), recorderFloat(motion1.velocity()));
+    recorderRecord(REC_SAMPLE, 2, 0, stepper2.currentPosition(), recorderFloat(motion2.velocity()));
+}
+
+// Called from the camera task for every processed frame
+void onVisionTarget(const VisionTarget& target, uint32_t captureTime) {
+    if (cameraTracking && target.found) {
+        postImageError(target.x, target.y, captureTime);
+    }
+}
+
+// Steps per encoder count on each output shaft
+double encoderScale(uint8_t axis) {
+    return axis == 1 ? ENCODER_DIRECTION_1 * TOTAL_STEPS_PER_REV_1 / AS5600_COUNTS
+                     : ENCODER_DIRECTION_2 * TOTAL_STEPS_PER_REV_2 / AS5600_COUNTS;
+}
+
+// I2C reads block for around 100 us each, so the encoders are polled from
+// their own task. Each reading is compared with the step count at the time of
+// the read; a persistent difference is lost steps, handed to loop() to correct.
+void encoderTask(void* parameter) {
+    uint8_t overCount[3] = { 0 };
+    for (;;) {
+        for (uint8_t axis = 1; axis <= 2; axis++) {
+            if (!encoderActive[axis]) {
+                continue;
+            }
+            ShaftEncoder& encoder = axis == 1 ? encoder1 : encoder2;
+            AccelStepper& stepper = axis == 1 ? stepper1 : stepper2;
+            long before = stepper.currentPosition();
+            if (!encoder.read()) {
+                continue;
+            }
+            long steps = (before + stepper.currentPosition()) / 2;
+            long counts = encoder.counts();
+            encoderCounts[axis] = counts;
+            long measured = lround((counts - encoderOrigin[axis]) * encoderScale(axis));
+            encoderMeasured[axis] = measured;
+            recorderRecord(REC_ENCODER, axis, 0, measured, steps);
+
+            if (encoderCorrectionPending[axis]) {
+                continue;
+            }
+            double tolerance = ENCODER_TOLERANCE * (axis == 1 ? STEPS_PER_DEGREE_1 : STEPS_PER_DEGREE_2);
+            if (labs(measured - steps) > tolerance) {
+                if (++overCount[axis] >= ENCODER_LOSS_SAMPLES) {
+                    overCount[axis] = 0;
+                    encoderCorrection[axis] = measured - steps;
+                    encoderCorrectionPending[axis] = true;
+                }
+            } else {
+                overCount[axis] = 0;
+            }
+        }
+        vTaskDelay(pdMS_TO_TICKS(idle ? ENCODER_IDLE_POLL_INTERVAL : ENCODER_POLL_INTERVAL));
+    }
+}
+
+// Set the axis position from its encoder at power-up. The encoder is only
+// trusted if a burst of readings agree; with no stored zero the power-up
+// position becomes zero, as it is without an encoder.
+void homeFromEncoder(uint8_t axis, ShaftEncoder& encoder, AccelStepper& stepper, MotionAxis& motion,
+                     InputShaper& shaper, const char* name) {
+    if (!encoder.present()) {
+        LOG_WARN(LOG_CAT_MOTION, MSG_ENCODER_MISSING, axis);
+        return;
+    }
+    long lowest = encoder.counts();
+    long highest = lowest;
+    for (int i = 0; i < ENCODER_HOME_READS; i++) {
+        delay(1);
+        if (!encoder.read()) {
+            LOG_WARN(LOG_CAT_MOTION, MSG_ENCODER_UNSTABLE, axis, (uint32_t)encoder.errors());
+            return;
+        }
+        lowest = min(lowest, encoder.counts());
+        highest = max(highest, encoder.counts());
+    }
+    if (highest - lowest > ENCODER_HOME_SPREAD) {
+        LOG_WARN(LOG_CAT_MOTION, MSG_ENCODER_UNSTABLE, axis, (uint32_t)(highest - lowest));
+        return;
+    }
+
+    char key[16];
+    snprintf(key, sizeof(key), "%s_zero", name);
+    long counts = encoder.counts();
+    encoderCounts[axis] = counts;
+    encoderActive[axis] = true;
+    if (!preferences.isKey(key)) {
+        encoderOrigin[axis] = counts;
+        return;
+    }
+
+    // Shortest way round from the stored zero
+    int offset = ((int)encoder.raw() - preferences.getUShort(key) + AS5600_COUNTS * 3 / 2) % AS5600_COUNTS
+                 - AS5600_COUNTS / 2;
+    encoderOrigin[axis] = counts - offset;
+    long position = lround(offset * encoderScale(axis));
+    stepper.setCurrentPosition(position);
+    motion.setPosition(position);
+    shaper.reset(position);
+    LOG_INFO(LOG_CAT_MOTION, MSG_ENCODER_HOMED, axis, offset * 360.0f / AS5600_COUNTS);
+}
+
+// Hand settings to the settings task; safe from the motion tick
+void requestSave(uint8_t what) {
+    portENTER_CRITICAL(&settingsMux);
+    settingsToSave |= what;
+    portEXIT_CRITICAL(&settingsMux);
+    xTaskNotifyGive(settingsTaskHandle);
+}
+
+// Take the current encoder angles as the zero position; the settings task
+// stores them for homing
+void setEncoderZero() {
+    portENTER_CRITICAL(&settingsMux);
+    for (uint8_t axis = 1; axis <= 2; axis++) {
+        if (encoderActive[axis]) {
+            long counts = encoderCounts[axis];
+            encoderOrigin[axis] = counts;
+            encoderZeroToSave[axis] = ((counts % AS5600_COUNTS) + AS5600_COUNTS) % AS5600_COUNTS;
+        }
+    }
+    portEXIT_CRITICAL(&settingsMux);
+    requestSave(SAVE_ENCODER_ZERO);
+}
+
+void saveEncoderZero(const uint16_t* zero) {
+    preferences.begin("encoder", false);
+    for (uint8_t axis = 1; axis <= 2; axis++) {
+        if (!encoderActive[axis]) {
+            continue;
+        }
+        char key[16];
+        snprintf(key, sizeof(key), "%s_zero", axis == 1 ? "tilt" : "pan");
+        preferences.putUShort(key, zero[axis]);
+    }
+    preferences.end();
+}
+
+// Resynchronise an axis with its encoder after lost steps and, in position
+// mode, replan to the original target from where the shaft really is
+void correctStepLoss(uint8_t axis, AccelStepper& stepper, MotionAxis& motion, InputShaper& shaper) {
+    if (!encoderCorrectionPending[axis]) {
+        return;
+    }
+    long error = encoderCorrection[axis];
+    long actual = stepper.currentPosition() + error;
+    bool resume = motorsEnabled && !motion.velocityMode();
+    long target = motion.target();
+    stepper.setCurrentPosition(actual);
+    motion.setPosition(actual);
+    shaper.reset(actual);
+    if (resume) {
+        motion.moveTo(target);
+    }
+    encoderCorrectionPending[axis] = false;
+
+    // With the outputs off the shaft is free to turn; just follow it
+    if (motorsEnabled) {
+        stepLossCount[axis]++;
+        LOG_WARN(LOG_CAT_MOTION, MSG_STEP_LOSS, axis, error, stepLossCount[axis]);
+        recorderTrigger(TRIGGER_STEP_LOSS);
+    }
+}
+
+// Override the default limits with ones stored by a previous auto-tune
+void loadTunedLimits(MotionAxis& motion, const char* name, double stepsPerDegree) {
+    char velocityKey[16];
+    char accelerationKey[16];
+    snprintf(velocityKey, sizeof(velocityKey), "%s_v", name);
+    snprintf(accelerationKey, sizeof(accelerationKey), "%s_a", name);
+    if (preferences.isKey(velocityKey) && preferences.isKey(accelerationKey)) {
+        AxisLimits limits = motion.limits();
+        limits.velocity = preferences.getFloat(velocityKey) * stepsPerDegree;
+        limits.acceleration = preferences.getFloat(accelerationKey) * stepsPerDegree;
+        motion.setLimits(limits);
+    }
+}
+
+void loadShaper(InputShaper& shaper, const char* name) {
+    char key[16];
+    snprintf(key, sizeof(key), "%s_t", name);
+    ShaperType type = (ShaperType)preferences.getUChar(key, SHAPER_NONE);
+    snprintf(key, sizeof(key), "%s_f", name);
+    float frequency = preferences.getFloat(key, 0);
+    snprintf(key, sizeof(key), "%s_d", name);
+    float damping = preferences.getFloat(key, 0);
+    shaper.configure(type, frequency, damping, MOTION_UPDATE_INTERVAL / 1000000.0f);
+}
+
+void saveShaper(const ShaperSettings& settings, const char* name) {
+    char key[16];
+    preferences.begin("shaper", false);
+    snprintf(key, sizeof(key), "%s_t", name);
+    preferences.putUChar(key, settings.type);
+    snprintf(key, sizeof(key), "%s_f", name);
+    preferences.putFloat(key, settings.frequency);
+    snprintf(key, sizeof(key), "%s_d", name);
+    preferences.putFloat(key, settings.damping);
+    preferences.end();
+}
+
+void loadIdleConfig() {
+    preferences.begin("power", true);
+    idleConfig.mode = min(preferences.getUChar("mode", idleConfig.mode), (uint8_t)IDLE_DISABLE);
+    idleConfig.holdTime = preferences.getUInt("hold", idleConfig.holdTime);
+    idleConfig.holdPercent = min(preferences.getUChar("percent", idleConfig.holdPercent), (uint8_t)100);
+    idleConfig.lightSleep = preferences.getBool("sleep", idleConfig.lightSleep);
+    preferences.end();
+}
+
+void saveIdleConfig(const IdleConfig& config) {
+    preferences.begin("power", false);
+    preferences.putUChar("mode", config.mode);
+    preferences.putUInt("hold", config.holdTime);
+    preferences.putUChar("percent", config.holdPercent);
+    preferences.putBool("sleep", config.lightSleep);
+    preferences.end();
+}
+
+// Low-priority task that stores the settings flagged by requestSave() and
+// reconfigures power management when the light sleep setting changes
+void settingsTask(void* parameter) {
+    bool lightSleep = idleConfig.lightSleep;  // As powerInit() set it up
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        portENTER_CRITICAL(&settingsMux);
+        uint8_t what = settingsToSave;
+        settingsToSave = 0;
+        ShaperSettings shaper[3] = { {}, shaperToSave[1], shaperToSave[2] };
+        float tuned[3][2];
+        memcpy(tuned, tunedToSave, sizeof(tuned));
+        uint16_t zero[3] = { 0, encoderZeroToSave[1], encoderZeroToSave[2] };
+        IdleConfig idleSettings = idleConfig;
+        portEXIT_CRITICAL(&settingsMux);
+
+        if (what & SAVE_SHAPER_TILT) {
+            saveShaper(shaper[1], "tilt");
+        }
+        if (what & SAVE_SHAPER_PAN) {
+            saveShaper(shaper[2], "pan");
+        }
+        if (what & (SAVE_LIMITS_TILT | SAVE_LIMITS_PAN)) {
+            preferences.begin("limits", false);
+            if (what & SAVE_LIMITS_TILT) {
+                preferences.putFloat("tilt_v", tuned[1][0]);
+                preferences.putFloat("tilt_a", tuned[1][1]);
+            }
+            if (what & SAVE_LIMITS_PAN) {
+                preferences.putFloat("pan_v", tuned[2][0]);
+                preferences.putFloat("pan_a", tuned[2][1]);
+            }
+            preferences.end();
+        }
+        if (what & SAVE_ENCODER_ZERO) {
+            saveEncoderZero(zero);
+        }
+        if (what & SAVE_IDLE_CONFIG) {
+            if (idleSettings.lightSleep != lightSleep) {
+                lightSleep = idleSettings.lightSleep;
+                if (!powerConfigure(lightSleep)) {
+                    LOG_WARN(LOG_CAT_SYSTEM, MSG_POWER_UNSUPPORTED, lightSleep);
+                }
+            }
+            saveIdleConfig(idleSettings);
+        }
+    }
+}
+
+// Report auto-tune progress as "state,axis,velocity,acceleration"
+void notifyTune(const char* state, uint8_t axis, float velocity, float acceleration) {
+    char value[96];
+    snprintf(value, sizeof(value), "%s,%s,%.1f,%.1f", state, axis == 1 ? "tilt" : "pan", velocity, acceleration);
+    pTuneCharacteristic->setValue(value);
+    pTuneCharacteristic->notify();
+}
+
+// Scan progress: "tile,index,count,settle,elapsed" after each frame,
+// "done,count,elapsed,unsettled", "cancelled,index,count" or "invalid"
+void notifyScan(const char* state, uint32_t a, uint32_t b, uint32_t c, uint32_t d) {
+    char value[64];
+    snprintf(value, sizeof(value), "%s,%lu,%lu,%lu,%lu", state, (unsigned long)a, (unsigned long)b,
+             (unsigned long)c, (unsigned long)d);
+    pScanCharacteristic->setValue(value);
+    pScanCharacteristic->notify();
+}
+
 void setup() {
     // Initialize Serial for debugging
     Serial.begin(115200);
-    Serial.println("Camera Robot Starting...");
+    logInit();
+    LOG_INFO(LOG_CAT_SYSTEM, MSG_BOOT);
+    recorderInit();
+#ifdef BENCH_ENABLED
+    benchRun();  // Before BLE and the motion tasks start, so nothing competes
+#endif
     
     // Initialize TMC2209 UART for Motor 1
     SerialTMC1.begin(115200, SERIAL_8N1, RX_PIN_1, TX_PIN_1);
@@ -197,7 +1422,7 @@ void setup() {
     // Configure TMC2209 for Motor 1
     driver1.begin();                 // Start TMC2209
     driver1.toff(5);                // Enables driver in software
-    driver1.rms_current(800);       // Set motor current to 800mA
+    driver1.rms_current(MOTOR_CURRENT, MOTOR_HOLD_MULTIPLIER);  // Set motor current
     driver1.microsteps(MICROSTEPS); // Set microsteps
     driver1.en_spreadCycle(false);  // Enable StealthChop quiet stepping mode
     driver1.pwm_autoscale(true);    // Needed for StealthChop
@@ -205,14 +1430,20 @@ void setup() {
     // Configure TMC2209 for Motor 2
     driver2.begin();                 // Start TMC2209
     driver2.toff(5);                // Enables driver in software
-    driver2.rms_current(800);       // Set motor current to 800mA
+    driver2.rms_current(MOTOR_CURRENT, MOTOR_HOLD_MULTIPLIER);  // Set motor current
     driver2.microsteps(MICROSTEPS); // Set microsteps
     driver2.en_spreadCycle(false);  // Enable StealthChop quiet stepping mode
     driver2.pwm_autoscale(true);    // Needed for StealthChop
 
+    // Keep StallGuard readings valid at every speed for auto-tune
+    driver1.TCOOLTHRS(0xFFFFF);
+    driver2.TCOOLTHRS(0xFFFFF);
+
     // Initialize BLE
     BLEDevice::init("CameraRobot");
+    BLEDevice::setMTU(BLE_MTU);
     pServer = BLEDevice::createServer();
+    centralsInit();
     pServer->setCallbacks(new ServerCallbacks());
 
     // Create BLE Service
@@ -233,13 +1464,141 @@ void setup() {
     pZeroCharacteristic->setCallbacks(new ZeroCallbacks());
     pZeroCharacteristic->addDescriptor(new BLE2902());
 
+    pJogCharacteristic = pService->createCharacteristic(
+        JOG_CHAR_UUID,
+        BLECharacteristic::PROPERTY_WRITE |
+        BLECharacteristic::PROPERTY_WRITE_NR
+    );
+    pJogCharacteristic->setCallbacks(new JogCallbacks());
+    pJogCharacteristic->addDescriptor(new BLE2902());
+
+    pLimitsCharacteristic = pService->createCharacteristic(
+        LIMITS_CHAR_UUID,
+        BLECharacteristic::PROPERTY_READ |
+        BLECharacteristic::PROPERTY_WRITE
+    );
+    pLimitsCharacteristic->setCallbacks(new LimitsCallbacks());
+
+    pTuneCharacteristic = pService->createCharacteristic(
+        TUNE_CHAR_UUID,
+        BLECharacteristic::PROPERTY_READ |
+        BLECharacteristic::PROPERTY_WRITE |
+        BLECharacteristic::PROPERTY_NOTIFY
+    );
+    pTuneCharacteristic->setCallbacks(new TuneCallbacks());
+    pTuneCharacteristic->addDescriptor(new BLE2902());
+    pTuneCharacteristic->setValue("idle");
+
+    pShaperCharacteristic = pService->createCharacteristic(
+        SHAPER_CHAR_UUID,
+        BLECharacteristic::PROPERTY_READ |
+        BLECharacteristic::PROPERTY_WRITE |
+        BLECharacteristic::PROPERTY_NOTIFY
+    );
+    pShaperCharacteristic->setCallbacks(new ShaperCallbacks());
+    pShaperCharacteristic->addDescriptor(new BLE2902());
+
+    pBulkControlCharacteristic = pService->createCharacteristic(
+        BULK_CONTROL_CHAR_UUID,
+        BLECharacteristic::PROPERTY_READ |
+        BLECharacteristic::PROPERTY_WRITE |
+        BLECharacteristic::PROPERTY_NOTIFY
+    );
+    pBulkControlCharacteristic->setCallbacks(new BulkControlCallbacks());
+    pBulkControlCharacteristic->addDescriptor(new BLE2902());
+
+    pBulkDataCharacteristic = pService->createCharacteristic(
+        BULK_DATA_CHAR_UUID,
+        BLECharacteristic::PROPERTY_WRITE |
+        BLECharacteristic::PROPERTY_WRITE_NR
+    );
+    pBulkDataCharacteristic->setCallbacks(new BulkDataCallbacks());
+
+    bulkInit(pBulkControlCharacteristic);
+    bulkRegisterSink(BULK_OTA, otaSink());
+
+    pVisionCharacteristic = pService->createCharacteristic(
+        VISION_CHAR_UUID,
+        BLECharacteristic::PROPERTY_READ |
+        BLECharacteristic::PROPERTY_WRITE
+    );
+    pVisionCharacteristic->setCallbacks(new VisionCallbacks());
+
+    pServoCharacteristic = pService->createCharacteristic(
+        SERVO_CHAR_UUID,
+        BLECharacteristic::PROPERTY_READ |
+        BLECharacteristic::PROPERTY_WRITE |
+        BLECharacteristic::PROPERTY_WRITE_NR
+    );
+    pServoCharacteristic->setCallbacks(new ServoCallbacks());
+
     pStatusCharacteristic = pService->createCharacteristic(
         STATUS_CHAR_UUID,
         BLECharacteristic::PROPERTY_READ |
         BLECharacteristic::PROPERTY_NOTIFY
     );
+    pStatusCharacteristic->setCallbacks(new TelemetryCallbacks(CHANNEL_STATUS));
     pStatusCharacteristic->addDescriptor(new BLE2902());
 
+    pPoseCharacteristic = pService->createCharacteristic(
+        POSE_CHAR_UUID,
+        BLECharacteristic::PROPERTY_READ |
+        BLECharacteristic::PROPERTY_NOTIFY
+    );
+    pPoseCharacteristic->setCallbacks(new TelemetryCallbacks(CHANNEL_POSE));
+    pPoseCharacteristic->addDescriptor(new BLE2902());
+
+    pDiagCharacteristic = pService->createCharacteristic(
+        DIAG_CHAR_UUID,
+        BLECharacteristic::PROPERTY_READ |
+        BLECharacteristic::PROPERTY_NOTIFY
+    );
+    pDiagCharacteristic->setCallbacks(new DiagCallbacks());
+    pDiagCharacteristic->addDescriptor(new BLE2902());
+
+    pLogCharacteristic = pService->createCharacteristic(
+        LOG_CHAR_UUID,
+        BLECharacteristic::PROPERTY_WRITE
+    );
+    pLogCharacteristic->setCallbacks(new LogCallbacks());
+
+    pPowerCharacteristic = pService->createCharacteristic(
+        POWER_CHAR_UUID,
+        BLECharacteristic::PROPERTY_READ |
+        BLECharacteristic::PROPERTY_WRITE
+    );
+    pPowerCharacteristic->setCallbacks(new PowerCallbacks());
+
+    pRecorderCharacteristic = pService->createCharacteristic(
+        RECORDER_CHAR_UUID,
+        BLECharacteristic::PROPERTY_READ |
+        BLECharacteristic::PROPERTY_WRITE |
+        BLECharacteristic::PROPERTY_NOTIFY
+    );
+    pRecorderCharacteristic->setCallbacks(new RecorderCallbacks());
+    pRecorderCharacteristic->addDescriptor(new BLE2902());
+
+    pControlCharacteristic = pService->createCharacteristic(
+        CONTROL_CHAR_UUID,
+        BLECharacteristic::PROPERTY_READ |
+        BLECharacteristic::PROPERTY_WRITE
+    );
+    pControlCharacteristic->setCallbacks(new ControlCallbacks());
+
+    pScanCharacteristic = pService->createCharacteristic(
+        SCAN_CHAR_UUID,
+        BLECharacteristic::PROPERTY_READ |
+        BLECharacteristic::PROPERTY_WRITE |
+        BLECharacteristic::PROPERTY_NOTIFY
+    );
+    pScanCharacteristic->setCallbacks(new ScanCallbacks());
+    pScanCharacteristic->addDescriptor(new BLE2902());
+
+    // Status, pose and diagnostics are notified to each client separately
+    centralsRegister(CHANNEL_STATUS, pStatusCharacteristic);
+    centralsRegister(CHANNEL_POSE, pPoseCharacteristic);
+    centralsRegister(CHANNEL_DIAG, pDiagCharacteristic);
+
     // Start the service
     pService->start();
 
@@ -249,22 +1608,22 @@ void setup() {
     pAdvertising->setScanResponse(true);
     pAdvertising->setMinPreferred(0x06);  
     pAdvertising->setMinPreferred(0x12);
-    BLEDevice::startAdvertising();
+    startAdvertising(true);
 
     // Initialize stepper motors
     pinMode(EN_PIN_1, OUTPUT);
     pinMode(EN_PIN_2, OUTPUT);
     digitalWrite(EN_PIN_1, LOW);  // Enable motor 1
     digitalWrite(EN_PIN_2, LOW);  // Enable motor 2
+    pinMode(SHUTTER_PIN, OUTPUT);
+    digitalWrite(SHUTTER_PIN, LOW);
 
-    stepper1.setMaxSpeed(DEFAULT_MAX_SPEED * (TOTAL_STEPS_PER_REV_1 / 360.0));
-    stepper1.setAcceleration(DEFAULT_ACCELERATION);
+    stepper1.setMaxSpeed(MAX_STEP_RATE);
     stepper1.setEnablePin(EN_PIN_1);
     stepper1.setPinsInverted(false, false, true);
     stepper1.enableOutputs();  // Explicitly enable motor 1
 
-    stepper2.setMaxSpeed(DEFAULT_MAX_SPEED * (TOTAL_STEPS_PER_REV_2 / 360.0));
-    stepper2.setAcceleration(DEFAULT_ACCELERATION);
+    stepper2.setMaxSpeed(MAX_STEP_RATE);
     stepper2.setEnablePin(EN_PIN_2);
     stepper2.setPinsInverted(false, false, true);
     stepper2.enableOutputs();  // Explicitly enable motor 2
@@ -273,34 +1632,698 @@ void setup() {
     stepper1.setCurrentPosition(0);
     stepper2.setCurrentPosition(0);
 
-    Serial.println("Setup complete!");
+    // Limits found by a previous auto-tune
+    preferences.begin("limits", true);
+    loadTunedLimits(motion1, "tilt", STEPS_PER_DEGREE_1);
+    loadTunedLimits(motion2, "pan", STEPS_PER_DEGREE_2);
+    preferences.end();
+
+    // Shaper settings saved from the last configuration
+    preferences.begin("shaper", true);
+    loadShaper(shaper1, "tilt");
+    loadShaper(shaper2, "pan");
+    preferences.end();
+    loadIdleConfig();
+
+    // Encoder homing; axes without a usable encoder stay open-loop
+#ifdef VISION_ENABLED
+    if (cameraInit()) {
+        cameraStart(onVisionTarget);
+    }
+#else
+    encoder1.begin(ENCODER_SDA_1, ENCODER_SCL_1, ENCODER_I2C_FREQUENCY);
+    encoder2.begin(ENCODER_SDA_2, ENCODER_SCL_2, ENCODER_I2C_FREQUENCY);
+#endif
+    preferences.begin("encoder", true);
+    homeFromEncoder(1, encoder1, stepper1, motion1, shaper1, "tilt");
+    homeFromEncoder(2, encoder2, stepper2, motion2, shaper2, "pan");
+    preferences.end();
+
+    xTaskCreatePinnedToCore(driverStatusTask, "driverTask", 3072, NULL, 1, NULL, tskNO_AFFINITY);
+    xTaskCreatePinnedToCore(settingsTask, "settingsTask", 3072, NULL, 1, &settingsTaskHandle, tskNO_AFFINITY);
+    if (encoderActive[1] || encoderActive[2]) {
+        xTaskCreatePinnedToCore(encoderTask, "encoderTask", 3072, NULL, 1, NULL, tskNO_AFFINITY);
+    }
+
+    memstatsInit();
+
+    // Frequency scaling and light sleep for the idle policy
+    if (!powerInit(idleConfig.lightSleep)) {
+        LOG_WARN(LOG_CAT_SYSTEM, MSG_POWER_UNSUPPORTED, idleConfig.lightSleep);
+    }
+    lastActive = millis();
+
+    // Everything came up, so keep this firmware if it arrived by OTA
+    otaConfirm();
+
+    LOG_INFO(LOG_CAT_SYSTEM, MSG_SETUP_DONE);
 }
 
-void loop() {
-    // Handle BLE connection
-    if (!deviceConnected && oldDeviceConnected) {
-        delay(500);
-        pServer->startAdvertising();
-        oldDeviceConnected = deviceConnected;
+// Run the auto-tune trials from the motion tick. Each trial moves the axis
+// out by TUNE_TRAVEL and back with trapezoidal profiles at the trial limits,
+// feeding StallGuard readings taken at the tested speed or acceleration to
+// the tuner. A stalled trial can lose steps, so re-zero after tuning.
+void updateTuning() {
+    static TuneConfig config = {
+        TUNE_START_SPEED, TUNE_MAX_SPEED,
+        DEFAULT_ACCELERATION, TUNE_MAX_ACCELERATION,
+        TUNE_GROWTH, TUNE_REFINE_STEPS, TUNE_STALL_FRACTION, TUNE_MARGIN,
+        TUNE_TRAVEL, TUNE_RAMP_TIME
+    };
+    static AutoTuner tuner(config);
+    static AxisLimits savedLimits;
+    static long origin = 0;
+    static bool returning = false;
+    static uint32_t lastLoadCount = 0;
+
+    uint8_t axis = tuneAxis;
+    bool beginTrial = false;
+    if (axis == 0) {
+        axis = tuneRequest;
+        if (axis == 0) {
+            return;
+        }
+        tuneRequest = 0;
+        tuneAxis = axis;
+        loadSampleAxis = axis;
+        beginTrial = true;
+    }
+
+    MotionAxis& motion = axis == 1 ? motion1 : motion2;
+    double stepsPerDegree = axis == 1 ? STEPS_PER_DEGREE_1 : STEPS_PER_DEGREE_2;
+
+    if (beginTrial) {
+        savedLimits = motion.limits();
+        origin = lround(motion.position());
+        returning = false;
+        tuneCancel = false;
+        lastLoadCount = driverLoadCount[axis];
+        config.startAcceleration = min((float)(savedLimits.acceleration / stepsPerDegree), (float)DEFAULT_ACCELERATION);
+        // Only try speeds the step rate allows; the tuner keeps each trial
+        // within TUNE_TRAVEL itself
+        config.maxVelocity = min((float)TUNE_MAX_SPEED, (float)(MAX_STEP_RATE / stepsPerDegree));
+        tuner = AutoTuner(config);
+        tuner.start();
+        LOG_INFO(LOG_CAT_MOTION, MSG_TUNE_START, axis);
     }
-    if (deviceConnected && !oldDeviceConnected) {
-        oldDeviceConnected = deviceConnected;
+
+    if (tuneCancel && !beginTrial) {
+        tuneCancel = false;
+        motion.setLimits(savedLimits);
+        motion.moveTo(origin);
+        tuneAxis = 0;
+        loadSampleAxis = 0;
+        notifyTune("cancelled", axis, 0, 0);
+        return;
+    }
+
+    if (!beginTrial && driverLoadCount[axis] != lastLoadCount) {
+        lastLoadCount = driverLoadCount[axis];
+        bool measuring;
+        if (tuner.phase() == TUNE_ACCELERATION) {
+            measuring = fabsf(motion.acceleration()) >= 0.9f * tuner.trialAcceleration() * stepsPerDegree;
+        } else {
+            measuring = fabsf(motion.velocity()) >= 0.95f * tuner.trialVelocity() * stepsPerDegree;
+        }
+        if (measuring) {
+            tuner.addSample(driverLoad[axis]);
+        }
+    }
+
+    if (!beginTrial) {
+        if (motion.isMoving()) {
+            return;
+        }
+        if (!returning) {
+            motion.moveTo(origin);
+            returning = true;
+            return;
+        }
+
+        // Out and back again: judge the trial
+        returning = false;
+        tuner.finishTrial();
+        if (!tuner.running()) {
+            tuneAxis = 0;
+            loadSampleAxis = 0;
+            if (tuner.phase() == TUNE_DONE) {
+                AxisLimits tuned = { (float)(tuner.velocity() * stepsPerDegree),
+                                     (float)(tuner.acceleration() * stepsPerDegree),
+                                     savedLimits.jerk };
+                motion.setLimits(tuned);
+                portENTER_CRITICAL(&settingsMux);
+                tunedToSave[axis][0] = tuner.velocity();
+                tunedToSave[axis][1] = tuner.acceleration();
+                portEXIT_CRITICAL(&settingsMux);
+                requestSave(axis == 1 ? SAVE_LIMITS_TILT : SAVE_LIMITS_PAN);
+                LOG_INFO(LOG_CAT_MOTION, MSG_TUNE_DONE, axis, tuner.velocity(), tuner.acceleration());
+                notifyTune("done", axis, tuner.velocity(), tuner.acceleration());
+            } else {
+                motion.setLimits(savedLimits);
+                LOG_WARN(LOG_CAT_MOTION, MSG_TUNE_FAILED, axis);
+                notifyTune("failed", axis, 0, 0);
+            }
+            return;
+        }
+    }
+
+    // Next trial: trapezoidal profile at the trial limits, out and back
+    AxisLimits trial = { (float)(tuner.trialVelocity() * stepsPerDegree),
+                         (float)(tuner.trialAcceleration() * stepsPerDegree),
+                         0.0f };
+    motion.setLimits(trial);
+    motion.moveTo(origin + lround(TUNE_TRAVEL * stepsPerDegree));
+    notifyTune("trial", axis, tuner.trialVelocity(), tuner.trialAcceleration());
+}
+
+// Apply a new shaper configuration once the axis and its shaped output are at rest
+void applyShaper(uint8_t axis, MotionAxis& motion, InputShaper& shaper) {
+    if (!shaperPending[axis] || motion.isMoving() || fabs(shaper.position() - motion.position()) > 0.5) {
+        return;
+    }
+    portENTER_CRITICAL(&shaperMux);
+    ShaperSettings settings = pendingShaper[axis];
+    shaperPending[axis] = false;
+    portEXIT_CRITICAL(&shaperMux);
+    if (!shaper.configure(settings.type, settings.frequency, settings.damping, MOTION_UPDATE_INTERVAL / 1000000.0f)) {
+        LOG_WARN(LOG_CAT_MOTION, MSG_SHAPER_INVALID);
+        return;
+    }
+    shaper.reset(motion.position());
+    portENTER_CRITICAL(&settingsMux);
+    shaperToSave[axis] = { shaper.type(), shaper.frequency(), shaper.damping() };
+    portEXIT_CRITICAL(&settingsMux);
+    requestSave(axis == 1 ? SAVE_SHAPER_TILT : SAVE_SHAPER_PAN);
+    LOG_INFO(LOG_CAT_MOTION, MSG_SHAPER, axis, (uint32_t)settings.type, settings.frequency, settings.damping);
+}
+
+// Resonance calibration: step the axis hard with shaping off, then hold while
+// the flight recorder keeps the settling response after a calibration
+// trigger. Download the recorder and run mac/resonance.py on it to pick the
+// shaper frequency and damping.
+void updateCalibration() {
+    enum CalibrationStep { CALIBRATION_OUT, CALIBRATION_HOLD_STILL, CALIBRATION_BACK };
+    static CalibrationStep step;
+    static AxisLimits savedLimits;
+    static ShaperSettings savedShaper;
+    static long origin;
+    static unsigned long holdStart;
+
+    if (calibrateAxis == 0) {
+        uint8_t axis = calibrateRequest;
+        MotionAxis& motion = axis == 1 ? motion1 : motion2;
+        if (axis == 0 || motion.isMoving()) {
+            return;
+        }
+        calibrateRequest = 0;
+        calibrateAxis = axis;
+        loadSampleAxis = axis;
+
+        InputShaper& shaper = axis == 1 ? shaper1 : shaper2;
+        double stepsPerDegree = axis == 1 ? STEPS_PER_DEGREE_1 : STEPS_PER_DEGREE_2;
+        savedShaper = { shaper.type(), shaper.frequency(), shaper.damping() };
+        shaper.configure(SHAPER_NONE, 0, 0, 0);
+        shaper.reset(motion.position());
+        savedLimits = motion.limits();
+        AxisLimits hard = { savedLimits.velocity, savedLimits.acceleration * CALIBRATION_ACCEL_FACTOR, 0.0f };
+        motion.setLimits(hard);
+        origin = lround(motion.position());
+        motion.moveTo(origin + lround(CALIBRATION_STEP * stepsPerDegree));
+        step = CALIBRATION_OUT;
+        LOG_INFO(LOG_CAT_MOTION, MSG_CALIBRATION_START, axis);
+        return;
+    }
+
+    MotionAxis& motion = calibrateAxis == 1 ? motion1 : motion2;
+    InputShaper& shaper = calibrateAxis == 1 ? shaper1 : shaper2;
+    switch (step) {
+    case CALIBRATION_OUT:
+        if (!motion.isMoving()) {
+            recorderTrigger(TRIGGER_CALIBRATION);
+            holdStart = millis();
+            step = CALIBRATION_HOLD_STILL;
+        }
+        break;
+    case CALIBRATION_HOLD_STILL:
+        if (millis() - holdStart >= CALIBRATION_HOLD) {
+            motion.setLimits(savedLimits);
+            motion.moveTo(origin);
+            step = CALIBRATION_BACK;
+        }
+        break;
+    case CALIBRATION_BACK:
+        if (!motion.isMoving()) {
+            shaper.configure(savedShaper.type, savedShaper.frequency, savedShaper.damping,
+                             MOTION_UPDATE_INTERVAL / 1000000.0f);
+            shaper.reset(motion.position());
+            loadSampleAxis = 0;
+            pShaperCharacteristic->setValue(calibrateAxis == 1 ? "calibrated,tilt" : "calibrated,pan");
+            pShaperCharacteristic->notify();
+            calibrateAxis = 0;
+        }
+        break;
+    }
+}
+
+// Feed image-space error into the visual servos and, in tracking mode, drive
+// both axes with their velocity commands
+void updateServo(uint32_t now, float dt) {
+    static uint32_t lastSequence = 0;
+    static bool wasTracking = false;
+
+    if (servoConfigPending) {
+        portENTER_CRITICAL(&servoConfigMux);
+        servoConfig = pendingServoConfig;
+        servoConfigPending = false;
+        portEXIT_CRITICAL(&servoConfigMux);
+        ServoConfig& c = servoConfig;
+        servo1.setGains({ c.kp, c.kpNear, (float)(c.scheduleError * STEPS_PER_DEGREE_1), c.ki, c.kd });
+        servo2.setGains({ c.kp, c.kpNear, (float)(c.scheduleError * STEPS_PER_DEGREE_2), c.ki, c.kd });
+        LOG_INFO(LOG_CAT_MOTION, MSG_SERVO_CONFIG, c.kp, c.kpNear, c.ki, c.kd, c.fovH, c.fovV);
+    }
+
+    // The camera sees the shaft, so the history holds the step count
+    servo1.record(stepper1.currentPosition(), now);
+    servo2.record(stepper2.currentPosition(), now);
+
+    bool tracking = controlMode == MODE_TRACK;
+    if (tracking && !wasTracking) {
+        servo1.reset();
+        servo2.reset();
+    } else if (!tracking && wasTracking) {
+        // Left tracking without a new position target: come to a stop
+        if (motion1.velocityMode()) {
+            motion1.stop();
+        }
+        if (motion2.velocityMode()) {
+            motion2.stop();
+        }
+    }
+    wasTracking = tracking;
+    if (!tracking) {
+        return;
+    }
+
+    portENTER_CRITICAL(&imageErrorMux);
+    ImageError error = imageError;
+    portEXIT_CRITICAL(&imageErrorMux);
+    if (error.sequence != lastSequence) {
+        lastSequence = error.sequence;
+        // Pinhole camera: normalised image position to angle off the optical axis
+        float tiltDegrees = atanf(error.y * tanf(servoConfig.fovV * DEG_TO_RAD / 2)) * RAD_TO_DEG;
+        float panDegrees = atanf(error.x * tanf(servoConfig.fovH * DEG_TO_RAD / 2)) * RAD_TO_DEG;
+        servo1.measure(tiltDegrees * STEPS_PER_DEGREE_1, error.captureTime);
+        servo2.measure(panDegrees * STEPS_PER_DEGREE_2, error.captureTime);
+    }
+
+    motion1.setVelocity(servo1.update(stepper1.currentPosition(), motion1.velocity(), now, dt,
+                                      motion1.limits().velocity));
+    motion2.setVelocity(servo2.update(stepper2.currentPosition(), motion2.velocity(), now, dt,
+                                      motion2.limits().velocity));
+}
+
+// Whether an axis or its shaped output is still moving, or the step count
+// has yet to catch up with it
+bool axisBusy(AccelStepper& stepper, MotionAxis& motion, InputShaper& shaper) {
+    return motion.isMoving() || shaper.velocity() != 0.0f ||
+           fabs(shaper.position() - stepper.currentPosition()) >= 1.0;
+}
+
+void leaveIdle() {
+    if (!idle) {
+        return;
+    }
+    idle = false;
+    driverHoldMultiplier = MOTOR_HOLD_MULTIPLIER;
+    powerSetActive(true);
+    LOG_DEBUG(LOG_CAT_MOTION, MSG_IDLE_EXIT);
+}
+
+// Idle policy: restore the drivers as soon as anything is about to move, and
+// once both axes have rested for the hold time reduce the standstill current
+// or switch the outputs off. The step count is untouched throughout, so
+// motion resumes from where it stopped; the driver keeps its microstep
+// position while disabled and encoder corrections follow a shaft turned by hand.
+void updateIdle() {
+    unsigned long now = millis();
+    if (idleConfigPending) {
+        portENTER_CRITICAL(&idleConfigMux);
+        IdleConfig config = pendingIdleConfig;
+        idleConfigPending = false;
+        portEXIT_CRITICAL(&idleConfigMux);
+        portENTER_CRITICAL(&settingsMux);
+        idleConfig = config;
+        portEXIT_CRITICAL(&settingsMux);
+        requestSave(SAVE_IDLE_CONFIG);
+        LOG_INFO(LOG_CAT_SYSTEM, MSG_POWER_CONFIG, config.mode, config.holdTime, config.holdPercent, config.lightSleep);
+        leaveIdle();
+        lastActive = now;
+    }
+
+    bool busy = axisBusy(stepper1, motion1, shaper1) || axisBusy(stepper2, motion2, shaper2) ||
+                servo1.tracking() || servo2.tracking() || tuneAxis != 0 || calibrateAxis != 0 || scanning;
+    atRest = !busy;
+    if (busy) {
+        lastActive = now;
+        leaveIdle();
+        if (!motorsEnabled) {
+            // After an idle switch-off or a halt
+            stepper1.enableOutputs();
+            stepper2.enableOutputs();
+            motorsEnabled = true;
+        }
+        return;
+    }
+
+    if (!idle && now - lastActive >= idleConfig.holdTime) {
+        idle = true;
+        if (idleConfig.mode == IDLE_REDUCE) {
+            driverHoldMultiplier = idleConfig.holdPercent / 100.0f;
+        } else if (idleConfig.mode == IDLE_DISABLE && motorsEnabled) {
+            stepper1.disableOutputs();
+            stepper2.disableOutputs();
+            motorsEnabled = false;
+        }
+        powerSetActive(false);
+        LOG_DEBUG(LOG_CAT_MOTION, MSG_IDLE_ENTER, idleConfig.mode);
+    }
+}
+
+// Run a grid scan from the motion tick: move to each tile in turn, wait
+// until both shaped moves have finished and, with encoders, the shafts have
+// stopped ringing, then pulse the shutter and hold for the exposure. The
+// shutter fires at once when the next frame is due, so a scan takes the
+// travel plus the settling actually needed, with no fixed delays.
+void updateScan() {
+    enum ScanStep { SCAN_MOVE, SCAN_SETTLE, SCAN_SHUTTER };
+    static ScanStep step;
+    static SettleDetector settle1;
+    static SettleDetector settle2;
+    static bool arrived;
+    static unsigned long scanStart;
+    static unsigned long stepStart;
+    static uint32_t settleTime;
+    static uint16_t unsettled;
+    unsigned long now = millis();
+
+    if (scanTimingPending) {
+        portENTER_CRITICAL(&scanMux);
+        scanTiming = pendingScanTiming;
+        scanTimingPending = false;
+        portEXIT_CRITICAL(&scanMux);
+    }
+
+    if (scanRequest) {
+        portENTER_CRITICAL(&scanMux);
+        ScanConfig config = pendingScanConfig;
+        scanRequest = false;
+        portEXIT_CRITICAL(&scanMux);
+        digitalWrite(SHUTTER_PIN, LOW);
+        AxisLimits panLimits = motion2.limits();
+        AxisLimits tiltLimits = motion1.limits();
+        AxisMove pan = { (float)(panLimits.velocity / STEPS_PER_DEGREE_2), (float)(panLimits.acceleration / STEPS_PER_DEGREE_2),
+                         (float)(panLimits.jerk / STEPS_PER_DEGREE_2) };
+        AxisMove tilt = { (float)(tiltLimits.velocity / STEPS_PER_DEGREE_1), (float)(tiltLimits.acceleration / STEPS_PER_DEGREE_1),
+                          (float)(tiltLimits.jerk / STEPS_PER_DEGREE_1) };
+        if (!scanPlan.configure(config, pan, tilt)) {
+            scanning = false;
+            LOG_WARN(LOG_CAT_MOTION, MSG_SCAN_INVALID);
+            notifyScan("invalid", 0, 0, 0, 0);
+            return;
+        }
+        scanning = true;
+        scanCancel = false;
+        scanIndex = 0;
+        unsettled = 0;
+        scanStart = now;
+        step = SCAN_MOVE;
+        LOG_INFO(LOG_CAT_MOTION, MSG_SCAN_START, scanPlan.columns(), scanPlan.rows(), scanPlan.rowMajor(),
+                 scanPlan.travelTime());
+    }
+    if (!scanning) {
+        return;
+    }
+
+    if (scanCancel) {
+        scanCancel = false;
+        scanning = false;
+        digitalWrite(SHUTTER_PIN, LOW);
+        motion1.stop();
+        motion2.stop();
+        LOG_INFO(LOG_CAT_MOTION, MSG_SCAN_CANCELLED, scanIndex, scanPlan.count());
+        notifyScan("cancelled", scanIndex, scanPlan.count(), 0, 0);
+        return;
+    }
+
+    switch (step) {
+    case SCAN_MOVE: {
+        float pan, tilt;
+        scanPlan.tile(scanIndex, pan, tilt);
+        targetPosition1 = lround(tilt * STEPS_PER_DEGREE_1);
+        targetPosition2 = lround(pan * STEPS_PER_DEGREE_2);
+        motion1.moveTo(targetPosition1);
+        motion2.moveTo(targetPosition2);
+        arrived = false;
+        step = SCAN_SETTLE;
+        break;
+    }
+    case SCAN_SETTLE: {
+        if (axisBusy(stepper1, motion1, shaper1) || axisBusy(stepper2, motion2, shaper2)) {
+            break;
+        }
+        if (!arrived) {
+            arrived = true;
+            stepStart = now;
+            settle1.start(now);
+            settle2.start(now);
+        }
+        // Without an encoder the window is a plain wait after the shaped move
+        float position1 = encoderActive[1] ? encoderMeasured[1] / STEPS_PER_DEGREE_1 : 0;
+        float position2 = encoderActive[2] ? encoderMeasured[2] / STEPS_PER_DEGREE_2 : 0;
+        bool settled = settle1.update(position1, SCAN_SETTLE_TOLERANCE, scanTiming.settleWindow, now) &
+                       settle2.update(position2, SCAN_SETTLE_TOLERANCE, scanTiming.settleWindow, now);
+        bool timedOut = now - stepStart >= SCAN_SETTLE_TIMEOUT;
+        if (!settled && !timedOut) {
+            break;
+        }
+        if (!settled) {
+            unsettled++;
+        }
+        settleTime = now - stepStart;
+        digitalWrite(SHUTTER_PIN, HIGH);
+        stepStart = now;
+        step = SCAN_SHUTTER;
+        break;
+    }
+    case SCAN_SHUTTER:
+        if (now - stepStart >= scanTiming.pulse) {
+            digitalWrite(SHUTTER_PIN, LOW);
+        }
+        if (now - stepStart < (uint32_t)scanTiming.pulse + scanTiming.exposure) {
+            break;
+        }
+        notifyScan("tile", scanIndex, scanPlan.count(), settleTime, now - scanStart);
+        if (++scanIndex < scanPlan.count()) {
+            step = SCAN_MOVE;
+            break;
+        }
+        scanning = false;
+        LOG_INFO(LOG_CAT_MOTION, MSG_SCAN_DONE, scanPlan.count(), now - scanStart, unsettled);
+        notifyScan("done", scanPlan.count(), now - scanStart, unsettled, 0);
+        break;
+    }
+}
+
+// Apply pending commands and advance both trajectories at a fixed rate
+void updateMotion() {
+    static unsigned long lastMotionUpdate = 0;
+    static float lastJogVelocity1 = 0;
+    static float lastJogVelocity2 = 0;
+    unsigned long now = micros();
+    if (now - lastMotionUpdate < MOTION_UPDATE_INTERVAL) {
+        return;
+    }
+    float dt = min((now - lastMotionUpdate) / 1000000.0f, 0.01f);
+    lastMotionUpdate = now;
+
+    if (limitsPending && tuneAxis == 0) {
+        portENTER_CRITICAL(&limitsMux);
+        motion1.setLimits(pendingLimits1);
+        motion2.setLimits(pendingLimits2);
+        limitsPending = false;
+        portEXIT_CRITICAL(&limitsMux);
+    }
+
+    if (haltAwaited && millis() - lastClientLeft >= DISCONNECT_GRACE) {
+        haltAwaited = false;
+        haltPending = true;
+    }
+
+    if (haltPending) {
+        haltPending = false;
+        if (tuneAxis != 0) {
+            tuneCancel = true;
+            updateTuning();
+        }
+        motion1.setPosition(stepper1.currentPosition());
+        motion2.setPosition(stepper2.currentPosition());
+        shaper1.reset(stepper1.currentPosition());
+        shaper2.reset(stepper2.currentPosition());
+        stepper1.disableOutputs();
+        stepper2.disableOutputs();
+        motorsEnabled = false;
+        scanCancel = scanning;
+    }
+
+    if (zeroPending) {
+        zeroPending = false;
+        stepper1.setCurrentPosition(0);
+        stepper2.setCurrentPosition(0);
+        motion1.setPosition(0);
+        motion2.setPosition(0);
+        shaper1.reset(0);
+        shaper2.reset(0);
+        targetPosition1 = 0;
+        targetPosition2 = 0;
+        setEncoderZero();
+        stepper1.enableOutputs();
+        stepper2.enableOutputs();
+        motorsEnabled = true;
+    }
+
+    correctStepLoss(1, stepper1, motion1, shaper1);
+    correctStepLoss(2, stepper2, motion2, shaper2);
+
+    if (scanning && (positionPending || stopPending || controlMode != MODE_POSITION ||
+                     tuneRequest != 0 || calibrateRequest != 0)) {
+        // A manual command, tuning or calibration takes over from the scan
+        scanCancel = true;
+    }
+    updateScan();
+
+    if (tuneAxis != 0 || tuneRequest != 0) {
+        // The tuner owns the axes; drop manual commands until it finishes
+        positionPending = false;
+        controlMode = MODE_POSITION;
+        updateTuning();
+    } else if (calibrateAxis != 0 || calibrateRequest != 0) {
+        positionPending = false;
+        controlMode = MODE_POSITION;
+        updateCalibration();
+    }
+
+    if (positionPending) {
+        positionPending = false;
+        motion1.moveTo(targetPosition1);
+        motion2.moveTo(targetPosition2);
+        recorderRecord(REC_PLAN, 1, PLAN_POSITION, targetPosition1, recorderFloat(motion1.limits().velocity));
+        recorderRecord(REC_PLAN, 2, PLAN_POSITION, targetPosition2, recorderFloat(motion2.limits().velocity));
+    }
+
+    if (stopPending) {
+        stopPending = false;
+        motion1.stop();
+        motion2.stop();
+    }
+
+    updateServo(now, dt);
+
+    if (controlMode == MODE_JOG) {
+        float velocity1 = jogVelocity1;
+        float velocity2 = jogVelocity2;
+        if (millis() - lastJogCommand > jogTimeout) {
+            // Deadman: no fresh command, decelerate to a stop
+            velocity1 = 0;
+            velocity2 = 0;
+        }
+        if (!motion1.velocityMode() || velocity1 != lastJogVelocity1 ||
+            !motion2.velocityMode() || velocity2 != lastJogVelocity2) {
+            lastJogVelocity1 = velocity1;
+            lastJogVelocity2 = velocity2;
+            recorderRecord(REC_PLAN, 1, PLAN_JOG, recorderFloat(velocity1), recorderFloat(motion1.limits().velocity));
+            recorderRecord(REC_PLAN, 2, PLAN_JOG, recorderFloat(velocity2), recorderFloat(motion2.limits().velocity));
+        }
+        motion1.setVelocity(velocity1);
+        motion2.setVelocity(velocity2);
+    }
+
+    updateIdle();
+
+    motion1.update(dt);
+    motion2.update(dt);
+    shaper1.update(motion1.position(), motion1.velocity());
+    shaper2.update(motion2.position(), motion2.velocity());
+    applyShaper(1, motion1, shaper1);
+    applyShaper(2, motion2, shaper2);
+
+    // Feed forward the shaped velocity and pull out any drift between the
+    // shaped plan and the pulses actually sent
+    stepper1.setSpeed(shaper1.velocity() + (shaper1.position() - stepper1.currentPosition()) * POSITION_GAIN);
+    stepper2.setSpeed(shaper2.velocity() + (shaper2.position() - stepper2.currentPosition()) * POSITION_GAIN);
+}
+
+void loop() {
+    // Nobody came back quickly: keep advertising, but slower
+    if (advertisingFast && millis() - advertisingFastSince >= ADV_FAST_WINDOW &&
+        centralsCount() < MAX_CENTRALS) {
+        startAdvertising(false);
     }
 
     // Run steppers
-    stepper1.run();
-    stepper2.run();
+    updateMotion();
+    stepper1.runSpeed();
+    stepper2.runSpeed();
+
+    recordSamples();
 
     // Update current positions
-    currentPosition1 = stepper1.currentPosition() / (TOTAL_STEPS_PER_REV_1 / 360.0);
-    currentPosition2 = stepper2.currentPosition() / (TOTAL_STEPS_PER_REV_2 / 360.0);
+    currentPosition1 = stepper1.currentPosition() / STEPS_PER_DEGREE_1;
+    currentPosition2 = stepper2.currentPosition() / STEPS_PER_DEGREE_2;
 
     // Send status update every 100ms
     static unsigned long lastStatusUpdate = 0;
     if (millis() - lastStatusUpdate >= 100) {
-        String status = "Pos1: " + String(currentPosition1) + "° Pos2: " + String(currentPosition2) + "°";
-        pStatusCharacteristic->setValue(status.c_str());
-        pStatusCharacteristic->notify();
+        AllocScope allocScope(ALLOC_TELEMETRY);
+        char status[48];
+        formatStatus(status, sizeof(status), currentPosition1, currentPosition2);
+        centralsNotify(CHANNEL_STATUS, status);
         lastStatusUpdate = millis();
     }
+
+    // Pose with its time in micros() for hosts that align camera frames to
+    // it, "micros,pan,tilt" in degrees. At rest it only needs the status rate.
+    static unsigned long lastPoseUpdate = 0;
+    if (millis() - lastPoseUpdate >= (idle ? IDLE_POLL_INTERVAL : POSE_INTERVAL)) {
+        AllocScope allocScope(ALLOC_TELEMETRY);
+        char pose[48];
+        snprintf(pose, sizeof(pose), "%lu,%.3f,%.3f", (unsigned long)micros(),
+                 stepper2.currentPosition() / STEPS_PER_DEGREE_2, stepper1.currentPosition() / STEPS_PER_DEGREE_1);
+        centralsNotify(CHANNEL_POSE, pose);
+        lastPoseUpdate = millis();
+    }
+
+    // Log memory diagnostics periodically for long-running sessions
+    static unsigned long lastDiagUpdate = 0;
+    if (millis() - lastDiagUpdate >= DIAG_LOG_INTERVAL) {
+        MemStats stats;
+        char record[128];
+        memstatsSample(stats);
+        memstatsFormat(record, sizeof(record), stats);
+        LOG_INFO(LOG_CAT_MEMORY, MSG_MEM_HEAP, stats.freeHeap, stats.largestFreeBlock, stats.minFreeHeap);
+        LOG_INFO(LOG_CAT_MEMORY, MSG_MEM_STACK, stats.stackFree[STACK_LOOP], stats.stackFree[STACK_BTC],
+                 stats.stackFree[STACK_BTU], stats.stackFree[STACK_LOG]);
+        LOG_INFO(LOG_CAT_MEMORY, MSG_MEM_ALLOC, stats.allocCount[ALLOC_BLE_CALLBACK], stats.allocCount[ALLOC_TELEMETRY]);
+        centralsNotify(CHANNEL_DIAG, record);
+
+        powerSample(powerStats);
+        LOG_INFO(LOG_CAT_SYSTEM, MSG_POWER_STATS, powerStats.idlePercent, motorCurrent(1), motorCurrent(2),
+                 powerStats.wakes, powerStats.lastWakeLatency, powerStats.maxWakeLatency);
+        lastDiagUpdate = millis();
+    }
+
+    // Nothing to step: block until a command or the next status update so
+    // the CPU can slow down or sleep
+    if (idle) {
+        powerWait(IDLE_POLL_INTERVAL);
+    }
 }
\ No newline at end of file
@@ -0,0 +1,85 @@
+#include <Arduino.h>
+#include "memstats.h"
+
+static const char* stackTaskNames[STACK_TASK_COUNT] = { "loopTask", "BTC_TASK", "BTU_TASK", "logTask" };
+static TaskHandle_t stackTaskHandles[STACK_TASK_COUNT] = { NULL };
+
+static volatile TaskHandle_t scopeTask[ALLOC_SITE_COUNT] = { NULL };
+static volatile uint32_t allocCount[ALLOC_SITE_COUNT] = { 0 };
+
+// Called on every allocation, so keep it to a handle compare per site
+static inline void countAllocation() {
+    // Global constructors allocate before there is a current task; the
+    // handle they get back is not theirs and may be NULL like an idle slot
+    if (xTaskGetSchedulerState() == taskSCHEDULER_NOT_STARTED) {
+        return;
+    }
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    for (int i = 0; i < ALLOC_SITE_COUNT; i++) {
+        if (scopeTask[i] == task) {
+            allocCount[i] = allocCount[i] + 1;
+        }
+    }
+}
+
+extern "C" {
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+
+void* __wrap_malloc(size_t size) {
+    countAllocation();
+    return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t count, size_t size) {
+    countAllocation();
+    return __real_calloc(count, size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size) {
+    countAllocation();
+    return __real_realloc(ptr, size);
+}
+}
+
+AllocScope::AllocScope(AllocSite site) : _site(site) {
+    scopeTask[_site] = xTaskGetCurrentTaskHandle();
+}
+
+AllocScope::~AllocScope() {
+    scopeTask[_site] = NULL;
+}
+
+void memstatsInit() {
+    // The BLE and log tasks only exist once BLEDevice::init() and logInit() have run
+    for (int i = 0; i < STACK_TASK_COUNT; i++) {
+        stackTaskHandles[i] = xTaskGetHandle(stackTaskNames[i]);
+    }
+}
+
+void memstatsSample(MemStats& stats) {
+    stats.freeHeap = ESP.getFreeHeap();
+    stats.largestFreeBlock = ESP.getMaxAllocHeap();
+    stats.minFreeHeap = ESP.getMinFreeHeap();
+    for (int i = 0; i < STACK_TASK_COUNT; i++) {
+        stats.stackFree[i] = stackTaskHandles[i] ? uxTaskGetStackHighWaterMark(stackTaskHandles[i]) : 0;
+    }
+    for (int i = 0; i < ALLOC_SITE_COUNT; i++) {
+        stats.allocCount[i] = allocCount[i];
+    }
+}
+
+int memstatsFormat(char* buffer, size_t size, const MemStats& stats) {
+    return snprintf(buffer, size,
+        "heap=%lu max=%lu min=%lu stk loop=%lu btc=%lu btu=%lu log=%lu alloc ble=%lu tlm=%lu",
+        (unsigned long)stats.freeHeap,
+        (unsigned long)stats.largestFreeBlock,
+        (unsigned long)stats.minFreeHeap,
+        (unsigned long)stats.stackFree[STACK_LOOP],
+        (unsigned long)stats.stackFree[STACK_BTC],
+        (unsigned long)stats.stackFree[STACK_BTU],
+        (unsigned long)stats.stackFree[STACK_LOG],
+        (unsigned long)stats.allocCount[ALLOC_BLE_CALLBACK],
+        (unsigned long)stats.allocCount[ALLOC_TELEMETRY]);
+}
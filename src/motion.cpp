@@ -0,0 +1,166 @@
+#include <math.h>
+#include "motion.h"
+
+#define SETTLE_DISTANCE 0.5  // Snap to the target within half a step
+
+MotionAxis::MotionAxis(const AxisLimits& limits)
+    : _limits(limits), _active(limits), _position(0.0), _velocity(0.0f), _acceleration(0.0f),
+      _target(0), _targetVelocity(0.0f), _velocityMode(false), _braking(false) {
+}
+
+void MotionAxis::setLimits(const AxisLimits& limits) {
+    _limits = limits;
+    if (!isMoving()) {
+        _active = limits;
+        return;
+    }
+    // More acceleration or jerk is always safe; less waits in update()
+    _active.velocity = limits.velocity;
+    _active.acceleration = fmaxf(_active.acceleration, limits.acceleration);
+    if (limits.jerk <= 0.0f || (_active.jerk > 0.0f && limits.jerk > _active.jerk)) {
+        _active.jerk = limits.jerk;
+    }
+}
+
+// Whether the axis, as it is moving now, can continue within these limits
+bool MotionAxis::fits(const AxisLimits& limits) const {
+    if (limits.jerk > 0.0f) {
+        if (fabsf(_acceleration) > limits.acceleration) {
+            return false;
+        }
+        // Speed still gained while the acceleration ramps out
+        if (_acceleration * _velocity > 0.0f &&
+            fabsf(_velocity) + _acceleration * _acceleration / (2.0f * limits.jerk) > limits.velocity) {
+            return false;
+        }
+    }
+    if (!_velocityMode) {
+        double error = _target - _position;
+        float direction = error >= 0.0 ? 1.0f : -1.0f;
+        float speed = _velocity * direction;
+        if (speed > 0.0f && stoppingDistance(speed, _acceleration * direction, limits) > fabs(error)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void MotionAxis::moveTo(long target) {
+    _target = target;
+    _velocityMode = false;
+    _braking = false;
+}
+
+void MotionAxis::setVelocity(float velocity) {
+    _targetVelocity = velocity;
+    _velocityMode = true;
+}
+
+void MotionAxis::setPosition(double position) {
+    _position = position;
+    _target = lround(position);
+    _velocity = 0.0f;
+    _acceleration = 0.0f;
+    _targetVelocity = 0.0f;
+    _braking = false;
+}
+
+bool MotionAxis::isMoving() const {
+    if (_velocity != 0.0f || _acceleration != 0.0f) {
+        return true;
+    }
+    return _velocityMode ? _targetVelocity != 0.0f : _position != _target;
+}
+
+// Distance needed to stop from speed v while accelerating at a (both measured
+// along the direction of travel). With a jerk limit the deceleration ramps up,
+// holds at the acceleration limit if there is time, and ramps back to zero.
+float MotionAxis::stoppingDistance(float v, float a, const AxisLimits& limits) {
+    float maxAccel = limits.acceleration;
+    float jerk = limits.jerk;
+    if (jerk <= 0.0f) {
+        return v * v / (2.0f * maxAccel);
+    }
+
+    float distance = 0.0f;
+    if (a > 0.0f) {
+        // Still speeding up: first bring the acceleration down to zero
+        float t = a / jerk;
+        distance = v * t + 0.5f * a * t * t - jerk * t * t * t / 6.0f;
+        v += a * a / (2.0f * jerk);
+    } else if (a < 0.0f) {
+        // Already part way into the deceleration ramp: plan from the virtual
+        // point where it started and subtract the part already behind us
+        float t = -a / jerk;
+        v += a * a / (2.0f * jerk);
+        distance = -(v * t - jerk * t * t * t / 6.0f);
+    }
+
+    if (v >= maxAccel * maxAccel / jerk) {
+        distance += 0.5f * v * (v / maxAccel + maxAccel / jerk);
+    } else {
+        distance += v * sqrtf(v / jerk);
+    }
+    return distance;
+}
+
+void MotionAxis::update(float dt) {
+    if (dt <= 0.0f) {
+        return;
+    }
+    if ((_active.acceleration != _limits.acceleration || _active.jerk != _limits.jerk) && fits(_limits)) {
+        _active = _limits;
+    }
+
+    float desired;
+    if (_velocityMode) {
+        desired = _targetVelocity;
+    } else {
+        double error = _target - _position;
+        float direction = error >= 0.0 ? 1.0f : -1.0f;
+        if (fabs(error) <= SETTLE_DISTANCE && fabsf(_velocity) * dt <= SETTLE_DISTANCE) {
+            _position = _target;
+            _velocity = 0.0f;
+            _acceleration = 0.0f;
+            _braking = false;
+            return;
+        }
+
+        // Look one tick ahead so braking never starts late
+        float speed = _velocity * direction;
+        if (speed <= 0.0f) {
+            _braking = false;
+        } else if (stoppingDistance(speed, _acceleration * direction, _active) >= fabs(error) - speed * dt) {
+            _braking = true;
+        }
+        desired = _braking ? 0.0f : direction * _active.velocity;
+    }
+    desired = fmaxf(-_active.velocity, fminf(desired, _active.velocity));
+
+    // Acceleration needed to reach the desired velocity with the acceleration
+    // itself ramping back to zero on arrival
+    float dv = desired - _velocity;
+    float accel;
+    if (_active.jerk > 0.0f) {
+        float wanted = sqrtf(2.0f * _active.jerk * fabsf(dv));
+        wanted = fminf(wanted, _active.acceleration);
+        if (dv < 0.0f) {
+            wanted = -wanted;
+        }
+        float maxChange = _active.jerk * dt;
+        accel = _acceleration + fmaxf(-maxChange, fminf(wanted - _acceleration, maxChange));
+    } else {
+        accel = fmaxf(-_active.acceleration, fminf(dv / dt, _active.acceleration));
+    }
+
+    float velocity = _velocity + accel * dt;
+    if ((dv >= 0.0f && velocity > desired) || (dv <= 0.0f && velocity < desired)) {
+        // Arrived at the desired velocity within this tick
+        velocity = desired;
+        accel = (velocity - _velocity) / dt;
+    }
+
+    _position += 0.5 * (_velocity + velocity) * dt;
+    _velocity = velocity;
+    _acceleration = accel;
+}
@@ -0,0 +1,62 @@
+#include <Arduino.h>
+#include <esp_ota_ops.h>
+#include "ota.h"
+#include "log.h"
+
+class OtaSink: public BulkSink {
+public:
+    bool begin(uint32_t size) override {
+        _partition = esp_ota_get_next_update_partition(NULL);
+        if (_partition == NULL || size > _partition->size) {
+            return false;
+        }
+        // Erases as much of the partition as the image needs
+        return esp_ota_begin(_partition, size, &_handle) == ESP_OK;
+    }
+
+    bool write(const uint8_t* data, size_t length) override {
+        return esp_ota_write(_handle, data, length) == ESP_OK;
+    }
+
+    bool finish() override {
+        if (esp_ota_end(_handle) != ESP_OK) {
+            return false;  // Image failed verification
+        }
+        return esp_ota_set_boot_partition(_partition) == ESP_OK;
+    }
+
+    void abort() override {
+        esp_ota_abort(_handle);
+    }
+
+    void completed() override {
+        LOG_INFO(LOG_CAT_SYSTEM, MSG_OTA_RESTART);
+        vTaskDelay(pdMS_TO_TICKS(OTA_RESTART_DELAY));
+        esp_restart();
+    }
+
+private:
+    const esp_partition_t* _partition = NULL;
+    esp_ota_handle_t _handle = 0;
+};
+
+static OtaSink sink;
+
+// The Arduino core marks a new image valid before setup() runs unless this
+// returns true; otaConfirm() does it once setup() has succeeded instead.
+extern "C" bool verifyRollbackLater() {
+    return true;
+}
+
+BulkSink* otaSink() {
+    return &sink;
+}
+
+void otaConfirm() {
+    const esp_partition_t* running = esp_ota_get_running_partition();
+    esp_ota_img_states_t state;
+    if (esp_ota_get_state_partition(running, &state) == ESP_OK && state == ESP_OTA_IMG_PENDING_VERIFY) {
+        esp_ota_mark_app_valid_cancel_rollback();
+        LOG_INFO(LOG_CAT_SYSTEM, MSG_OTA_CONFIRMED);
+    }
+}
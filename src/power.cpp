@@ -0,0 +1,107 @@
+#include <Arduino.h>
+#include <esp_pm.h>
+#include "power.h"
+
+static TaskHandle_t loopTask = NULL;
+static esp_pm_lock_handle_t activeLock = NULL;
+static bool lightSleepEnabled = false;
+static volatile bool active = true;
+
+// Set by powerWake() while idle, cleared once the wake is timed
+static volatile uint32_t wakeRequestTime = 0;
+static volatile bool wakeRequested = false;
+static bool wakeSeen = false;  // The request was already pending when the last wait ended
+
+static uint32_t wakeCount = 0;
+static uint32_t lastWakeLatency = 0;
+static uint32_t maxWakeLatency = 0;
+
+// loop() time spent blocked, for the idle share
+static uint32_t blockedTime = 0;
+static uint32_t sampleStart = 0;
+
+bool powerInit(bool lightSleep) {
+    loopTask = xTaskGetCurrentTaskHandle();
+    sampleStart = micros();
+    bool configured = powerConfigure(lightSleep);
+
+    if (activeLock == NULL) {
+        if (esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "motion", &activeLock) != ESP_OK) {
+            activeLock = NULL;
+        } else if (active) {
+            esp_pm_lock_acquire(activeLock);
+        }
+    }
+    return configured;
+}
+
+bool powerConfigure(bool lightSleep) {
+    esp_pm_config_esp32s3_t config = {};
+    config.max_freq_mhz = POWER_MAX_FREQUENCY;
+    config.min_freq_mhz = POWER_MIN_FREQUENCY;
+    config.light_sleep_enable = lightSleep;
+    bool configured = esp_pm_configure(&config) == ESP_OK;
+    if (!configured && lightSleep) {
+        // Builds without tickless idle still take frequency scaling alone
+        config.light_sleep_enable = false;
+        esp_pm_configure(&config);
+    }
+    lightSleepEnabled = configured && lightSleep;
+    return configured;
+}
+
+void powerSetActive(bool isActive) {
+    if (isActive == active) {
+        return;
+    }
+    active = isActive;
+    if (activeLock != NULL) {
+        if (isActive) {
+            esp_pm_lock_acquire(activeLock);
+        } else {
+            esp_pm_lock_release(activeLock);
+        }
+    }
+    if (isActive && wakeRequested) {
+        lastWakeLatency = micros() - wakeRequestTime;
+        maxWakeLatency = max(maxWakeLatency, lastWakeLatency);
+        wakeCount++;
+        wakeRequested = false;
+    }
+}
+
+void powerWake() {
+    if (active || loopTask == NULL) {
+        return;
+    }
+    if (!wakeRequested) {
+        wakeRequestTime = micros();
+        wakeRequested = true;
+    }
+    xTaskNotifyGive(loopTask);
+}
+
+void powerWait(uint32_t timeoutMs) {
+    // A command that woke the loop without starting any motion is not a
+    // wake worth timing
+    if (wakeSeen) {
+        wakeRequested = false;
+    }
+    uint32_t start = micros();
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(timeoutMs));
+    blockedTime += micros() - start;
+    wakeSeen = wakeRequested;
+}
+
+void powerSample(PowerStats& stats) {
+    uint32_t now = micros();
+    uint32_t elapsed = now - sampleStart;
+    stats.lightSleep = lightSleepEnabled;
+    uint64_t percent = elapsed > 0 ? (uint64_t)blockedTime * 100 / elapsed : 0;
+    stats.idlePercent = percent < 100 ? percent : 100;
+    stats.wakes = wakeCount;
+    stats.lastWakeLatency = lastWakeLatency;
+    stats.maxWakeLatency = maxWakeLatency;
+    blockedTime = 0;
+    sampleStart = now;
+}
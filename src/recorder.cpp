@@ -0,0 +1,160 @@
+#include <Arduino.h>
+#include <BLEDevice.h>
+#include <atomic>
+#include "recorder.h"
+#include "centrals.h"
+#include "log.h"
+
+#define RECORDER_CAPACITY (RECORDER_BYTES / sizeof(RecorderRecord))
+#define RECORDER_MASK (RECORDER_CAPACITY - 1)
+#define RECORDER_CHUNK_HEADER 4
+#define RECORDER_END_OF_DOWNLOAD 0xFFFFFFFFu
+#define RECORDER_FREEZE_SETTLE 2  // Lets in-flight writers finish, in milliseconds
+#define DOWNLOAD_TASK_STACK 4096
+#define DOWNLOAD_TASK_PRIORITY 1
+
+enum RecorderState : uint8_t {
+    RECORDER_RECORDING,
+    RECORDER_TRIGGERED,
+    RECORDER_FROZEN
+};
+
+static RecorderRecord* ring = NULL;
+static std::atomic<uint32_t> writeIndex(0);
+static std::atomic<uint8_t> state(RECORDER_RECORDING);
+static std::atomic<uint32_t> postTriggerRemaining(0);
+static std::atomic<bool> triggerClaimed(false);
+static bool wrapped = false;
+static uint16_t triggerReason = 0;
+static uint32_t triggerTime = 0;
+
+static TaskHandle_t downloadTaskHandle = NULL;
+static BLECharacteristic* downloadCharacteristic = NULL;
+static uint16_t downloadConnId = CONTROL_NONE;
+static uint32_t downloadFromChunk = 0;
+
+static uint32_t snapshotCount() {
+    return wrapped ? RECORDER_CAPACITY : writeIndex.load(std::memory_order_acquire);
+}
+
+static uint32_t snapshotStart() {
+    return wrapped ? writeIndex.load(std::memory_order_acquire) : 0;
+}
+
+static void downloadTask(void* parameter) {
+    uint8_t chunk[RECORDER_CHUNK_HEADER + 512];
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        vTaskDelay(pdMS_TO_TICKS(RECORDER_FREEZE_SETTLE));
+
+        // ATT notifications carry at most MTU - 3 bytes, on the requester's link
+        size_t payload = min((size_t)centralsMtu(downloadConnId) - 3, sizeof(chunk)) - RECORDER_CHUNK_HEADER;
+        uint32_t perChunk = payload / sizeof(RecorderRecord);
+        uint32_t count = snapshotCount();
+        uint32_t start = snapshotStart();
+        LOG_INFO(LOG_CAT_SYSTEM, MSG_RECORDER_DOWNLOAD, count, perChunk, downloadFromChunk);
+
+        bool sending = true;
+        for (uint32_t index = downloadFromChunk; sending && index * perChunk < count; index++) {
+            uint32_t first = index * perChunk;
+            uint32_t records = min(perChunk, count - first);
+            memcpy(chunk, &index, RECORDER_CHUNK_HEADER);
+            RecorderRecord* out = (RecorderRecord*)(chunk + RECORDER_CHUNK_HEADER);
+            for (uint32_t i = 0; i < records; i++) {
+                out[i] = ring[(start + first + i) & RECORDER_MASK];
+            }
+            // Each send waits for the stack, which paces the stream. A client
+            // that went away resumes with "dump,<chunk>" when it is back.
+            sending = centralsSend(downloadConnId, downloadCharacteristic, chunk,
+                                   RECORDER_CHUNK_HEADER + records * sizeof(RecorderRecord));
+        }
+
+        if (sending) {
+            uint32_t end[2] = { RECORDER_END_OF_DOWNLOAD, count };
+            centralsSend(downloadConnId, downloadCharacteristic, (uint8_t*)end, sizeof(end));
+        }
+    }
+}
+
+void recorderInit() {
+    ring = (RecorderRecord*)ps_malloc(RECORDER_BYTES);
+    if (ring == NULL) {
+        LOG_WARN(LOG_CAT_SYSTEM, MSG_RECORDER_NO_PSRAM);
+        return;
+    }
+    xTaskCreatePinnedToCore(downloadTask, "recorderTask", DOWNLOAD_TASK_STACK, NULL,
+                            DOWNLOAD_TASK_PRIORITY, &downloadTaskHandle, tskNO_AFFINITY);
+}
+
+void recorderRecord(uint8_t type, uint8_t axis, uint16_t flags, int32_t a, int32_t b) {
+    uint8_t current = state.load(std::memory_order_relaxed);
+    if (ring == NULL || current == RECORDER_FROZEN) {
+        return;
+    }
+
+    uint32_t index = writeIndex.fetch_add(1, std::memory_order_relaxed);
+    RecorderRecord& record = ring[index & RECORDER_MASK];
+    record.time = micros();
+    record.type = type;
+    record.axis = axis;
+    record.flags = flags;
+    record.a = a;
+    record.b = b;
+    if (index == RECORDER_MASK) {
+        wrapped = true;
+    }
+
+    if (current == RECORDER_TRIGGERED &&
+        postTriggerRemaining.fetch_sub(1, std::memory_order_relaxed) == 1) {
+        state.store(RECORDER_FROZEN, std::memory_order_release);
+        LOG_INFO(LOG_CAT_SYSTEM, MSG_RECORDER_FROZEN, triggerReason);
+    }
+}
+
+void recorderTrigger(uint16_t reason) {
+    if (ring == NULL || triggerClaimed.exchange(true)) {
+        return;  // Already holding an earlier event
+    }
+    triggerReason = reason;
+    triggerTime = micros();
+    postTriggerRemaining.store(RECORDER_POST_TRIGGER, std::memory_order_relaxed);
+    state.store(RECORDER_TRIGGERED, std::memory_order_release);
+    recorderRecord(REC_TRIGGER, 0, reason, 0, 0);
+    LOG_WARN(LOG_CAT_SYSTEM, MSG_RECORDER_TRIGGER, reason);
+}
+
+void recorderArm() {
+    state.store(RECORDER_FROZEN, std::memory_order_release);
+    vTaskDelay(pdMS_TO_TICKS(RECORDER_FREEZE_SETTLE));
+    writeIndex.store(0, std::memory_order_relaxed);
+    wrapped = false;
+    triggerClaimed.store(false);
+    state.store(RECORDER_RECORDING, std::memory_order_release);
+}
+
+bool recorderFrozen() {
+    return state.load(std::memory_order_acquire) == RECORDER_FROZEN;
+}
+
+int recorderFormatInfo(char* buffer, size_t size) {
+    static const char* stateNames[] = { "recording", "triggered", "frozen" };
+    return snprintf(buffer, size, "state=%s records=%lu capacity=%lu reason=%u trigger_us=%lu",
+                    ring ? stateNames[state.load()] : "disabled",
+                    (unsigned long)snapshotCount(),
+                    (unsigned long)RECORDER_CAPACITY,
+                    triggerReason,
+                    (unsigned long)triggerTime);
+}
+
+void recorderStartDownload(BLECharacteristic* pCharacteristic, uint16_t connId, uint32_t fromChunk) {
+    if (downloadTaskHandle == NULL) {
+        return;
+    }
+    // Downloads always read a frozen ring so the snapshot cannot move underneath
+    triggerClaimed.store(true);
+    state.store(RECORDER_FROZEN, std::memory_order_release);
+    downloadCharacteristic = pCharacteristic;
+    downloadConnId = connId;
+    downloadFromChunk = fromChunk;
+    xTaskNotifyGive(downloadTaskHandle);
+}
@@ -0,0 +1,114 @@
+#include <math.h>
+#include "scan.h"
+
+float scanMoveTime(float distance, const AxisMove& limits) {
+    distance = fabsf(distance);
+    if (distance <= 0 || limits.velocity <= 0 || limits.acceleration <= 0) {
+        return 0;
+    }
+    float ramps = limits.jerk > 0 ? limits.acceleration / limits.jerk : 0;
+    if (distance < limits.velocity * limits.velocity / limits.acceleration) {
+        // Never reaches cruise speed
+        return 2 * sqrtf(distance / limits.acceleration) + ramps;
+    }
+    return distance / limits.velocity + limits.velocity / limits.acceleration + ramps;
+}
+
+// Frame centres spread evenly so the outer frames sit on the field edges
+static uint16_t layOut(float from, float to, float fov, float overlap, float& start, float& step) {
+    float span = fabsf(to - from);
+    float direction = to >= from ? 1 : -1;
+    if (span <= fov) {
+        start = (from + to) / 2;
+        step = 0;
+        return 1;
+    }
+    uint16_t count = (uint16_t)ceilf((span - fov) / (fov * (1 - overlap))) + 1;
+    start = from + direction * fov / 2;
+    step = direction * (span - fov) / (count - 1);
+    return count;
+}
+
+ScanPlan::ScanPlan()
+    : _columns(0), _rows(0), _panStart(0), _panStep(0), _tiltStart(0), _tiltStep(0),
+      _rowMajor(true), _travelTime(0) {
+}
+
+bool ScanPlan::configure(const ScanConfig& config, const AxisMove& pan, const AxisMove& tilt) {
+    if (!(config.overlap >= 0 && config.overlap <= 0.9f) || !(config.fovH > 0 && config.fovH < 180) ||
+        !(config.fovV > 0 && config.fovV < 180) || !isfinite(config.panFrom) || !isfinite(config.panTo) ||
+        !isfinite(config.tiltFrom) || !isfinite(config.tiltTo)) {
+        return false;
+    }
+    float panSpan = fabsf(config.panTo - config.panFrom);
+    float tiltSpan = fabsf(config.tiltTo - config.tiltFrom);
+    if ((panSpan - config.fovH) / (config.fovH * (1 - config.overlap)) >= MAX_SCAN_TILES ||
+        (tiltSpan - config.fovV) / (config.fovV * (1 - config.overlap)) >= MAX_SCAN_TILES) {
+        return false;
+    }
+
+    float panStart, panStep, tiltStart, tiltStep;
+    uint16_t columns = layOut(config.panFrom, config.panTo, config.fovH, config.overlap, panStart, panStep);
+    uint16_t rows = layOut(config.tiltFrom, config.tiltTo, config.fovV, config.overlap, tiltStart, tiltStep);
+    if ((uint32_t)columns * rows > MAX_SCAN_TILES) {
+        return false;
+    }
+
+    // Every tile move is one step on one axis; only the split differs
+    float panMove = scanMoveTime(panStep, pan);
+    float tiltMove = scanMoveTime(tiltStep, tilt);
+    float rowsTime = rows * (columns - 1) * panMove + (rows - 1) * tiltMove;
+    float columnsTime = columns * (rows - 1) * tiltMove + (columns - 1) * panMove;
+    bool rowMajor = config.order == SCAN_AUTO ? rowsTime <= columnsTime : config.order == SCAN_ROWS;
+
+    _columns = columns;
+    _rows = rows;
+    _panStart = panStart;
+    _panStep = panStep;
+    _tiltStart = tiltStart;
+    _tiltStep = tiltStep;
+    _rowMajor = rowMajor;
+    _travelTime = rowMajor ? rowsTime : columnsTime;
+    return true;
+}
+
+void ScanPlan::tile(uint16_t index, float& pan, float& tilt) const {
+    uint16_t inner = _rowMajor ? _columns : _rows;
+    uint16_t line = index / inner;
+    uint16_t position = index % inner;
+    if (line & 1) {
+        position = inner - 1 - position;  // Serpentine: every other line runs back
+    }
+    uint16_t column = _rowMajor ? position : line;
+    uint16_t row = _rowMajor ? line : position;
+    pan = _panStart + column * _panStep;
+    tilt = _tiltStart + row * _tiltStep;
+}
+
+SettleDetector::SettleDetector()
+    : _start(0), _windowStart(0), _reference(0), _inWindow(false), _settled(false), _settleTime(0) {
+}
+
+void SettleDetector::start(uint32_t now) {
+    _start = now;
+    _inWindow = false;
+    _settled = false;
+    _settleTime = 0;
+}
+
+bool SettleDetector::update(float position, float tolerance, uint32_t window, uint32_t now) {
+    if (_settled) {
+        return true;
+    }
+    if (!_inWindow || fabsf(position - _reference) > tolerance) {
+        // Still moving: start the window again from here
+        _inWindow = true;
+        _reference = position;
+        _windowStart = now;
+    }
+    if (now - _windowStart >= window) {
+        _settled = true;
+        _settleTime = now - _start;
+    }
+    return _settled;
+}
@@ -0,0 +1,115 @@
+#include <math.h>
+#include "servo.h"
+
+#define CLOCK_SYNC_CREEP 20  // Offset drift allowance per message, microseconds
+#define MIN_VELOCITY_INTERVAL 0.005f  // Shortest gap used for a target velocity estimate, seconds
+
+VisualServo::VisualServo(const ServoGains& gains)
+    : _gains(gains), _historyHead(0), _historyCount(0) {
+    reset();
+}
+
+void VisualServo::reset() {
+    _valid = false;
+    _target = 0;
+    _measureTime = 0;
+    _targetVelocity = 0;
+    _integral = 0;
+}
+
+void VisualServo::record(long position, uint32_t now) {
+    if (_historyCount > 0) {
+        int newest = (_historyHead + SERVO_HISTORY - 1) % SERVO_HISTORY;
+        if (now - _historyTime[newest] < SERVO_HISTORY_INTERVAL) {
+            return;
+        }
+    }
+    _history[_historyHead] = position;
+    _historyTime[_historyHead] = now;
+    _historyHead = (_historyHead + 1) % SERVO_HISTORY;
+    if (_historyCount < SERVO_HISTORY) {
+        _historyCount++;
+    }
+}
+
+double VisualServo::positionAt(uint32_t time) const {
+    // Walk back from the newest sample to the pair around the capture time
+    int index = (_historyHead + SERVO_HISTORY - 1) % SERVO_HISTORY;
+    for (int i = 0; i < _historyCount - 1; i++) {
+        int older = (index + SERVO_HISTORY - 1) % SERVO_HISTORY;
+        if ((int32_t)(time - _historyTime[older]) >= 0) {
+            if ((int32_t)(time - _historyTime[index]) >= 0) {
+                return _history[index];  // Newer than the newest sample
+            }
+            float fraction = (float)(time - _historyTime[older]) / (_historyTime[index] - _historyTime[older]);
+            return _history[older] + fraction * (_history[index] - _history[older]);
+        }
+        index = older;
+    }
+    return _history[index];  // Older than the history; the oldest sample is closest
+}
+
+void VisualServo::measure(float error, uint32_t captureTime) {
+    if (_historyCount == 0) {
+        return;
+    }
+    double target = positionAt(captureTime) + error;
+    if (_valid) {
+        float interval = (int32_t)(captureTime - _measureTime) / 1000000.0f;
+        if (interval >= MIN_VELOCITY_INTERVAL) {
+            float velocity = (target - _target) / interval;
+            _targetVelocity += SERVO_VELOCITY_FILTER * (velocity - _targetVelocity);
+        }
+    } else {
+        _targetVelocity = 0;
+        _integral = 0;
+    }
+    _target = target;
+    _measureTime = captureTime;
+    _valid = true;
+}
+
+float VisualServo::update(long position, float velocity, uint32_t now, float dt, float velocityLimit) {
+    if (!_valid) {
+        return 0;
+    }
+    uint32_t age = now - _measureTime;
+    if ((int32_t)age > SERVO_LOST_TIMEOUT) {
+        reset();
+        return 0;
+    }
+
+    // Extrapolate the target from the last measurement
+    float predict = (float)((int32_t)age < SERVO_MAX_PREDICT ? (int32_t)age : SERVO_MAX_PREDICT) / 1000000.0f;
+    double target = _target + _targetVelocity * predict;
+    float error = target - position;
+
+    // Gain scheduled on the size of the error
+    float blend = _gains.scheduleError > 0 ? fminf(fabsf(error) / _gains.scheduleError, 1.0f) : 1.0f;
+    float kp = _gains.kpNear + (_gains.kp - _gains.kpNear) * blend;
+
+    float output = _targetVelocity + kp * error + _gains.ki * _integral +
+                   _gains.kd * (_targetVelocity - velocity);
+
+    // Anti-windup: stop integrating while saturated in the direction of the error
+    bool saturated = fabsf(output) >= velocityLimit;
+    if (!saturated || (error > 0) != (output > 0)) {
+        _integral += error * dt;
+    }
+    return fmaxf(-velocityLimit, fminf(output, velocityLimit));
+}
+
+ClockSync::ClockSync()
+    : _valid(false), _offset(0) {
+}
+
+uint32_t ClockSync::toLocal(uint32_t remoteMicros, uint32_t now) {
+    int32_t offset = (int32_t)(now - remoteMicros);
+    if (!_valid || offset < _offset) {
+        _offset = offset;
+        _valid = true;
+    } else {
+        _offset += offset - _offset < CLOCK_SYNC_CREEP ? offset - _offset : CLOCK_SYNC_CREEP;
+    }
+    return remoteMicros + _offset;
+}
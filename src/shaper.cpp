@@ -0,0 +1,102 @@
+#include <math.h>
+#include "shaper.h"
+
+#define EI_TOLERANCE 0.05f  // Residual vibration allowed at the design frequency
+
+InputShaper::InputShaper()
+    : _type(SHAPER_NONE), _frequency(0), _damping(0), _duration(0), _impulses(1),
+      _head(0), _position(0), _velocity(0) {
+    _amplitude[0] = 1.0f;
+    _delay[0] = 0;
+    reset(0);
+}
+
+bool InputShaper::configure(ShaperType type, float frequency, float damping, float tick) {
+    if (type == SHAPER_NONE) {
+        _type = SHAPER_NONE;
+        _frequency = 0;
+        _damping = 0;
+        _duration = 0;
+        _impulses = 1;
+        _amplitude[0] = 1.0f;
+        _delay[0] = 0;
+        return true;
+    }
+    if (frequency <= 0 || damping < 0 || damping >= 1 || tick <= 0) {
+        return false;
+    }
+
+    // Damped period and the per-half-period decay of the oscillation
+    float dampedRoot = sqrtf(1.0f - damping * damping);
+    float period = 1.0f / (frequency * dampedRoot);
+    float k = expf(-damping * M_PI / dampedRoot);
+
+    float amplitude[SHAPER_MAX_IMPULSES];
+    int impulses;
+    switch (type) {
+    case SHAPER_ZV:
+        impulses = 2;
+        amplitude[0] = 1.0f;
+        amplitude[1] = k;
+        break;
+    case SHAPER_ZVD:
+        impulses = 3;
+        amplitude[0] = 1.0f;
+        amplitude[1] = 2.0f * k;
+        amplitude[2] = k * k;
+        break;
+    default:
+        // EI impulses spaced like ZVD, with the damping decay folded in the same way
+        impulses = 3;
+        amplitude[0] = 0.25f * (1.0f + EI_TOLERANCE);
+        amplitude[1] = 0.5f * (1.0f - EI_TOLERANCE) * k;
+        amplitude[2] = 0.25f * (1.0f + EI_TOLERANCE) * k * k;
+        break;
+    }
+
+    int lastDelay = lroundf(0.5f * period * (impulses - 1) / tick);
+    if (lastDelay >= SHAPER_HISTORY) {
+        return false;
+    }
+
+    float sum = 0;
+    for (int i = 0; i < impulses; i++) {
+        sum += amplitude[i];
+    }
+    for (int i = 0; i < impulses; i++) {
+        _amplitude[i] = amplitude[i] / sum;
+        _delay[i] = lroundf(0.5f * period * i / tick);
+    }
+    _impulses = impulses;
+    _type = type;
+    _frequency = frequency;
+    _damping = damping;
+    _duration = lastDelay * tick;
+    return true;
+}
+
+void InputShaper::reset(double position) {
+    for (int i = 0; i < SHAPER_HISTORY; i++) {
+        _positions[i] = position;
+        _velocities[i] = 0;
+    }
+    _head = 0;
+    _position = position;
+    _velocity = 0;
+}
+
+void InputShaper::update(double position, float velocity) {
+    _head = (_head + 1) % SHAPER_HISTORY;
+    _positions[_head] = position;
+    _velocities[_head] = velocity;
+
+    double shapedPosition = 0;
+    float shapedVelocity = 0;
+    for (int i = 0; i < _impulses; i++) {
+        int index = (_head - _delay[i] + SHAPER_HISTORY) % SHAPER_HISTORY;
+        shapedPosition += _amplitude[i] * _positions[index];
+        shapedVelocity += _amplitude[i] * _velocities[index];
+    }
+    _position = shapedPosition;
+    _velocity = shapedVelocity;
+}
@@ -0,0 +1,150 @@
+#include <string.h>
+#include "vision.h"
+
+#define GRID_COLUMNS (VISION_WIDTH / VISION_CELL)
+#define GRID_ROWS (VISION_HEIGHT / VISION_CELL)
+#define PATCH_PIXELS (VISION_PATCH_CELLS * VISION_CELL * VISION_PATCH_CELLS * VISION_CELL)
+
+// Byte-lane helpers for the fast kernels. Each treats a 32-bit word as four
+// independent unsigned bytes and never carries or borrows between them.
+#define LANES(x) ((uint32_t)(x) * 0x01010101u)
+#define HIGH_BITS 0x80808080u
+
+static inline uint32_t laneAverage(uint32_t a, uint32_t b) {
+    return (a & b) + (((a ^ b) & 0xFEFEFEFEu) >> 1);  // Rounds down like (a + b) >> 1
+}
+
+static inline uint32_t laneSubtract(uint32_t a, uint32_t b) {
+    return ((a | HIGH_BITS) - (b & ~HIGH_BITS)) ^ ((a ^ ~b) & HIGH_BITS);  // Modulo 256
+}
+
+// High bit set in each lane where a < n; needs n <= 128
+static inline uint32_t laneLess(uint32_t a, uint32_t n) {
+    return ~((a | HIGH_BITS) - LANES(n)) & ~a & HIGH_BITS;
+}
+
+// High bit set in each lane where lo <= a <= hi; needs hi - lo < 128
+static inline uint32_t laneInRange(uint32_t a, uint32_t lo, uint32_t hi) {
+    return laneLess(laneSubtract(a, LANES(lo)), hi - lo + 1);
+}
+
+void visionDownscaleScalar(const uint8_t* yuyv, int width, int height, VisionFrame& frame) {
+    if (width != 2 * VISION_WIDTH || height != 2 * VISION_HEIGHT) {
+        return;
+    }
+    int stride = width * 2;
+    for (int row = 0; row < VISION_HEIGHT; row++) {
+        const uint8_t* a = yuyv + 2 * row * stride;
+        const uint8_t* b = a + stride;
+        int out = row * VISION_WIDTH;
+        for (int column = 0; column < VISION_WIDTH; column++, a += 4, b += 4, out++) {
+            // Each YUYV group is two pixels sharing one chroma pair
+            uint8_t y0 = (a[0] + b[0]) >> 1;
+            uint8_t y1 = (a[2] + b[2]) >> 1;
+            frame.y[out] = (y0 + y1) >> 1;
+            frame.u[out] = (a[1] + b[1]) >> 1;
+            frame.v[out] = (a[3] + b[3]) >> 1;
+        }
+    }
+}
+
+void visionDownscaleFast(const uint8_t* yuyv, int width, int height, VisionFrame& frame) {
+    if (width != 2 * VISION_WIDTH || height != 2 * VISION_HEIGHT) {
+        return;
+    }
+    int stride = width * 2;
+    for (int row = 0; row < VISION_HEIGHT; row++) {
+        const uint32_t* a = (const uint32_t*)(yuyv + 2 * row * stride);
+        const uint32_t* b = (const uint32_t*)(yuyv + (2 * row + 1) * stride);
+        int out = row * VISION_WIDTH;
+        for (int column = 0; column < VISION_WIDTH; column++, out++) {
+            // One word is Y0 U Y1 V; average the two rows in all four lanes at once
+            uint32_t word = laneAverage(a[column], b[column]);
+            frame.y[out] = ((word & 0xFF) + ((word >> 16) & 0xFF)) >> 1;
+            frame.u[out] = word >> 8;
+            frame.v[out] = word >> 24;
+        }
+    }
+}
+
+void visionSkinMaskScalar(const VisionFrame& frame, uint8_t* mask) {
+    for (int i = 0; i < VISION_PIXELS; i++) {
+        mask[i] = frame.y[i] >= VISION_Y_MIN &&
+                  frame.u[i] >= VISION_U_MIN && frame.u[i] <= VISION_U_MAX &&
+                  frame.v[i] >= VISION_V_MIN && frame.v[i] <= VISION_V_MAX;
+    }
+}
+
+void visionSkinMaskFast(const VisionFrame& frame, uint8_t* mask) {
+    for (int i = 0; i < VISION_PIXELS; i += 4) {
+        uint32_t y, u, v;
+        memcpy(&y, frame.y + i, sizeof(y));
+        memcpy(&u, frame.u + i, sizeof(u));
+        memcpy(&v, frame.v + i, sizeof(v));
+        uint32_t skin = ~laneLess(y, VISION_Y_MIN) &
+                        laneInRange(u, VISION_U_MIN, VISION_U_MAX) &
+                        laneInRange(v, VISION_V_MIN, VISION_V_MAX) & HIGH_BITS;
+        skin >>= 7;
+        memcpy(mask + i, &skin, sizeof(skin));
+    }
+}
+
+void visionCentroid(const uint8_t* mask, VisionTarget& target) {
+    // Skin pixels per grid cell
+    uint16_t cells[GRID_ROWS][GRID_COLUMNS];
+    memset(cells, 0, sizeof(cells));
+    for (int y = 0; y < VISION_HEIGHT; y++) {
+        const uint8_t* row = mask + y * VISION_WIDTH;
+        for (int x = 0; x < VISION_WIDTH; x++) {
+            cells[y / VISION_CELL][x / VISION_CELL] += row[x];
+        }
+    }
+
+    // Densest face-sized patch; scattered skin-coloured pixels elsewhere
+    // (hands, wood, walls) do not pull the target off the face
+    int bestCount = 0;
+    int bestRow = 0;
+    int bestColumn = 0;
+    for (int row = 0; row + VISION_PATCH_CELLS <= GRID_ROWS; row++) {
+        for (int column = 0; column + VISION_PATCH_CELLS <= GRID_COLUMNS; column++) {
+            int count = 0;
+            for (int r = 0; r < VISION_PATCH_CELLS; r++) {
+                for (int c = 0; c < VISION_PATCH_CELLS; c++) {
+                    count += cells[row + r][column + c];
+                }
+            }
+            if (count > bestCount) {
+                bestCount = count;
+                bestRow = row;
+                bestColumn = column;
+            }
+        }
+    }
+
+    target.found = bestCount >= VISION_MIN_PIXELS;
+    target.confidence = (float)bestCount / PATCH_PIXELS;
+    if (!target.found) {
+        target.x = 0;
+        target.y = 0;
+        return;
+    }
+
+    // First moments of the skin pixels inside the patch
+    long sumX = 0;
+    long sumY = 0;
+    int top = bestRow * VISION_CELL;
+    int left = bestColumn * VISION_CELL;
+    int size = VISION_PATCH_CELLS * VISION_CELL;
+    for (int y = top; y < top + size; y++) {
+        for (int x = left; x < left + size; x++) {
+            if (mask[y * VISION_WIDTH + x]) {
+                sumX += x;
+                sumY += y;
+            }
+        }
+    }
+    float centreX = (float)sumX / bestCount + 0.5f;
+    float centreY = (float)sumY / bestCount + 0.5f;
+    target.x = (centreX - VISION_WIDTH / 2) / (VISION_WIDTH / 2);
+    target.y = (centreY - VISION_HEIGHT / 2) / (VISION_HEIGHT / 2);
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Stand-in for the Arduino TwoWire on the native build: one device whose
+// registers the test sets directly. A read starts at the register written
+// before the repeated start and auto-increments, as on most I2C sensors.
+
+class TwoWire {
+public:
+    uint8_t address = 0;  // Device on the bus; any other address NACKs
+    uint8_t registers[256] = { 0 };
+    bool connected = true;  // false: every transfer NACKs, as with no device
+    uint32_t failReads = 0;  // Number of upcoming requestFrom() calls that return nothing
+    uint32_t transfers = 0;
+    bool started = false;
+
+    bool begin(int sda, int scl, uint32_t frequency) {
+        (void)sda;
+        (void)scl;
+        (void)frequency;
+        started = true;
+        return true;
+    }
+
+    void beginTransmission(uint8_t device) {
+        _device = device;
+        _written = false;
+    }
+
+    size_t write(uint8_t data) {
+        if (!_written) {
+            _pointer = data;
+            _written = true;
+        }
+        return 1;
+    }
+
+    uint8_t endTransmission(bool sendStop = true) {
+        (void)sendStop;
+        transfers++;
+        return connected && _device == address ? 0 : 2;
+    }
+
+    uint8_t requestFrom(uint8_t device, uint8_t length) {
+        transfers++;
+        if (!connected || device != address) {
+            return 0;
+        }
+        if (failReads > 0) {
+            failReads--;
+            return 0;
+        }
+        _available = length;
+        return length;
+    }
+
+    int read() {
+        if (_available == 0) {
+            return -1;
+        }
+        _available--;
+        return registers[_pointer++];
+    }
+
+private:
+    uint8_t _device = 0;
+    uint8_t _pointer = 0;
+    bool _written = false;
+    uint8_t _available = 0;
+};
@@ -0,0 +1,123 @@
+// Steady-state command handling must not touch the heap: the same parsers
+// and formatters run in the BLE callbacks and the status loop on the device,
+// where AllocScope counts allocations (include/memstats.h). Here every
+// malloc/calloc/realloc and operator new in the process is counted instead.
+//
+//   pio test -e native -f test_alloc
+
+#include <new>
+#include <stdlib.h>
+#include <unity.h>
+#include "command.h"
+
+#define STEADY_ITERATIONS 1000  // Calls per parser after the warm-up
+
+static volatile unsigned long allocations = 0;
+
+#ifdef __GLIBC__
+// glibc lets the program interpose its own allocator; libc's internal
+// calls, e.g. from snprintf, go through it too
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void __libc_free(void* ptr);
+
+void* malloc(size_t size) {
+    allocations = allocations + 1;
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) {
+    allocations = allocations + 1;
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void* ptr, size_t size) {
+    allocations = allocations + 1;
+    return __libc_realloc(ptr, size);
+}
+
+void free(void* ptr) {
+    __libc_free(ptr);
+}
+}
+#endif
+
+// Elsewhere only operator new can be counted
+void* operator new(size_t size) {
+#ifndef __GLIBC__
+    allocations = allocations + 1;
+#endif
+    void* ptr = malloc(size ? size : 1);
+    if (ptr == NULL) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void operator delete(void* ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    free(ptr);
+}
+
+static const char* positions[] = { "12.5,-3.25", "-90,90", "0,0", "45.125,-45.125" };
+static const char* jogs[] = { "10,-5", "30.5,0,250", "-12,12,5000", "0,0" };
+static const char* limits[] = { "90,180,1800,60,120,1200", "20,30,0,20,30,0" };
+
+// One pass over every command type, as the callbacks and loop() do them
+static void handleCommands(int i) {
+    float pan, tilt;
+    parsePosition(positions[i % 4], pan, tilt);
+
+    long timeout;
+    parseJog(jogs[i % 4], pan, tilt, timeout);
+
+    float fields[6];
+    parseLimits(limits[i % 2], fields);
+
+    char status[48];
+    formatStatus(status, sizeof(status), (long)(i % 181) - 90, (long)(i % 361) - 180);
+}
+
+void setUp() {
+}
+
+void tearDown() {
+}
+
+void test_counter_sees_allocations() {
+    // Guards against a counter that silently never fires
+    unsigned long before = allocations;
+    int* volatile value = new int(1);
+    delete value;
+    TEST_ASSERT_EQUAL_UINT32(before + 1, allocations);
+}
+
+void test_steady_state_command_handling_does_not_allocate() {
+    // First calls may set up locale or stdio state once
+    handleCommands(0);
+
+    unsigned long before = allocations;
+    for (int i = 0; i < STEADY_ITERATIONS; i++) {
+        handleCommands(i);
+    }
+    TEST_ASSERT_EQUAL_UINT32_MESSAGE(before, allocations, "command handling allocated");
+}
+
+void test_status_format_fits_notification_buffer() {
+    char status[48];
+    int length = formatStatus(status, sizeof(status), -180, -180);
+    TEST_ASSERT_LESS_THAN((int)sizeof(status), length);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_counter_sees_allocations);
+    RUN_TEST(test_steady_state_command_handling_does_not_allocate);
+    RUN_TEST(test_status_format_fits_notification_buffer);
+    return UNITY_END();
+}
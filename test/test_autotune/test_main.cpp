@@ -0,0 +1,223 @@
+// AutoTuner against a simulated stepper and StallGuard. The motor's torque
+// falls off with speed; the load is friction plus inertia times
+// acceleration. StallGuard reads high at light load and falls towards 0 as
+// the load approaches the available torque, so the true limits are known
+// and the tuned ones can be checked against them. A load beyond the
+// available torque stalls the motor outright. Configuration as updateTuning()
+// in main.cpp uses it, in degrees and seconds.
+//
+//   pio test -e native -f test_autotune
+
+#include <math.h>
+#include <stdint.h>
+#include <unity.h>
+#include "autotune.h"
+
+#define SAMPLES_PER_TRIAL 20
+#define MAX_TRIALS 100  // Guard against a search that never ends
+
+struct Motor {
+    float holdingTorque;  // Available torque at standstill
+    float cornerSpeed;    // Speed at which the available torque has halved, deg/s
+    float friction;       // Load torque at constant speed
+    float inertia;        // Load torque per deg/s^2
+    float sgMax;          // StallGuard reading with no load
+    float noise;          // Peak reading noise
+    uint32_t seed;
+
+    float available(float velocity) const {
+        return holdingTorque / (1 + velocity / cornerSpeed);
+    }
+
+    // Fraction of the available torque in use
+    float load(float velocity, float acceleration) const {
+        return (friction + inertia * acceleration) / available(velocity);
+    }
+
+    bool stalls(float velocity, float acceleration) const {
+        return load(velocity, acceleration) >= 1;
+    }
+
+    uint16_t reading(float velocity, float acceleration) {
+        seed = seed * 1664525u + 1013904223u;
+        float jitter = ((seed >> 8) / 16777216.0f * 2 - 1) * noise;
+        float sg = sgMax * (1 - load(velocity, acceleration)) + jitter;
+        return sg < 0 ? 0 : (uint16_t)sg;
+    }
+};
+
+static const TuneConfig config = {
+    30, 360,     // TUNE_START_SPEED, TUNE_MAX_SPEED
+    180, 5000,   // DEFAULT_ACCELERATION, TUNE_MAX_ACCELERATION
+    1.5f, 3,     // TUNE_GROWTH, TUNE_REFINE_STEPS
+    0.3f, 0.7f,  // TUNE_STALL_FRACTION, TUNE_MARGIN
+    90, 0.1f     // TUNE_TRAVEL, TUNE_RAMP_TIME
+};
+
+#define DEFAULT_MAX_SPEED 90  // Velocity limit before tuning, degrees per second
+
+static Motor nema17() {
+    return { 1.0f, 120.0f, 0.3f, 0.0001f, 500.0f, 5.0f, 12345 };
+}
+
+// Highest value of x in [0, limit] where the StallGuard reading stays above
+// the stall threshold, by bisection on the noise-free model
+template <typename Load>
+static float trueLimit(const Motor& motor, float baseline, float limit, Load load) {
+    float low = 0, high = limit;
+    for (int i = 0; i < 40; i++) {
+        float mid = 0.5f * (low + high);
+        bool passes = motor.sgMax * (1 - load(mid)) >= baseline * config.stallFraction;
+        (passes ? low : high) = mid;
+    }
+    return low;
+}
+
+// Speed an acceleration trial ramps up to, as the tuner picks it
+static float rampVelocity(float acceleration) {
+    float velocity = fminf(acceleration * config.rampTime, sqrtf(0.8f * acceleration * config.travel));
+    return fminf(fmaxf(velocity, config.startVelocity), config.maxVelocity);
+}
+
+// Runs the search the way updateTuning() does: the baseline at the start
+// speed, acceleration trials sampled while ramping up, velocity trials
+// sampled at cruise. A motor that stalls on the way up reads 0 at cruise.
+static int runTune(AutoTuner& tuner, Motor& motor, int samples = SAMPLES_PER_TRIAL) {
+    tuner.start();
+    int trials = 0;
+    while (tuner.running() && trials < MAX_TRIALS) {
+        bool stalled = tuner.phase() == TUNE_VELOCITY &&
+                       motor.stalls(tuner.trialVelocity(), tuner.trialAcceleration());
+        for (int i = 0; i < samples; i++) {
+            if (tuner.phase() == TUNE_ACCELERATION) {
+                float velocity = tuner.trialVelocity() * (i + 1) / samples;
+                tuner.addSample(motor.reading(velocity, tuner.trialAcceleration()));
+            } else {
+                tuner.addSample(stalled ? 0 : motor.reading(tuner.trialVelocity(), 0));
+            }
+        }
+        tuner.finishTrial();
+        trials++;
+    }
+    return trials;
+}
+
+void setUp() {
+}
+
+void tearDown() {
+}
+
+void test_finds_acceleration_limit_over_ramp() {
+    Motor motor = nema17();
+    AutoTuner tuner(config);
+    runTune(tuner, motor);
+    TEST_ASSERT_EQUAL_INT(TUNE_DONE, tuner.phase());
+
+    // The ramp's last reading, at its top speed, is the hardest
+    float limit = trueLimit(motor, tuner.baseline(), config.maxAcceleration,
+                            [&](float a) { return motor.load(rampVelocity(a), a); });
+    // Three bisection steps after a 1.5x overshoot leave about 1/16 of the
+    // passing value; the noise shifts the edge a little further
+    TEST_ASSERT_LESS_THAN_FLOAT(limit * config.margin * 1.02f, tuner.acceleration());
+    TEST_ASSERT_GREATER_THAN_FLOAT(limit * config.margin * 0.85f, tuner.acceleration());
+}
+
+void test_finds_velocity_limit_at_tuned_acceleration() {
+    Motor motor = nema17();
+    AutoTuner tuner(config);
+    runTune(tuner, motor);
+    TEST_ASSERT_EQUAL_INT(TUNE_DONE, tuner.phase());
+
+    // Passing means holding the speed at cruise without stalling on the ramp there
+    float acceleration = tuner.acceleration();
+    float limit = trueLimit(motor, tuner.baseline(), config.maxVelocity,
+                            [&](float v) { return motor.stalls(v, acceleration) ? 1 : motor.load(v, 0); });
+    TEST_ASSERT_LESS_THAN_FLOAT(limit * config.margin * 1.02f, tuner.velocity());
+    TEST_ASSERT_GREATER_THAN_FLOAT(limit * config.margin * 0.85f, tuner.velocity());
+}
+
+void test_fast_motor_raises_speed_above_default() {
+    // Holds well over DEFAULT_MAX_SPEED; a start acceleration of 180 alone
+    // could not reach it within the trial travel
+    Motor motor = nema17();
+    motor.cornerSpeed = 240.0f;
+    AutoTuner tuner(config);
+    runTune(tuner, motor);
+    TEST_ASSERT_EQUAL_INT(TUNE_DONE, tuner.phase());
+    TEST_ASSERT_GREATER_THAN_FLOAT(sqrtf(0.8f * config.startAcceleration * config.travel), tuner.velocity());
+    TEST_ASSERT_GREATER_THAN_FLOAT(1.5f * DEFAULT_MAX_SPEED, tuner.velocity());
+    TEST_ASSERT_FALSE(motor.stalls(tuner.velocity(), tuner.acceleration()));
+}
+
+void test_strong_motor_stops_at_configured_maximum() {
+    Motor motor = nema17();
+    motor.holdingTorque = 100.0f;
+    AutoTuner tuner(config);
+    runTune(tuner, motor);
+    TEST_ASSERT_EQUAL_INT(TUNE_DONE, tuner.phase());
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, config.maxVelocity * config.margin, tuner.velocity());
+    TEST_ASSERT_FLOAT_WITHIN(0.1f, config.maxAcceleration * config.margin, tuner.acceleration());
+}
+
+void test_weak_motor_stays_below_first_stall() {
+    // Passes the baseline but stalls on the first step up
+    Motor motor = nema17();
+    motor.holdingTorque = 0.41f;
+    motor.noise = 1.0f;
+    AutoTuner tuner(config);
+    runTune(tuner, motor);
+    TEST_ASSERT_EQUAL_INT(TUNE_DONE, tuner.phase());
+    TEST_ASSERT_LESS_THAN_FLOAT(config.startVelocity * config.growth * config.margin, tuner.velocity());
+    TEST_ASSERT_GREATER_THAN_FLOAT(config.startVelocity * config.margin - 0.01f, tuner.velocity());
+}
+
+void test_no_stallguard_readings_fails() {
+    // Driver not in StallGuard mode: the baseline reads near zero
+    Motor motor = nema17();
+    motor.sgMax = 10.0f;
+    motor.noise = 0;
+    AutoTuner tuner(config);
+    int trials = runTune(tuner, motor);
+    TEST_ASSERT_EQUAL_INT(TUNE_FAILED, tuner.phase());
+    TEST_ASSERT_EQUAL_INT(1, trials);
+}
+
+void test_trials_without_samples_count_as_stalls() {
+    // A trial that never reached its tested state proves nothing
+    Motor motor = nema17();
+    AutoTuner tuner(config);
+    tuner.start();
+    for (int i = 0; i < SAMPLES_PER_TRIAL; i++) {
+        tuner.addSample(motor.reading(config.startVelocity, 0));
+    }
+    tuner.finishTrial();
+    TEST_ASSERT_EQUAL_INT(TUNE_ACCELERATION, tuner.phase());
+    for (int trial = 0; trial < MAX_TRIALS && tuner.running(); trial++) {
+        tuner.finishTrial();
+    }
+    TEST_ASSERT_EQUAL_INT(TUNE_DONE, tuner.phase());
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, config.startVelocity * config.margin, tuner.velocity());
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, config.startAcceleration * config.margin, tuner.acceleration());
+}
+
+void test_search_is_bounded() {
+    Motor motor = nema17();
+    AutoTuner tuner(config);
+    int trials = runTune(tuner, motor);
+    // Baseline, growth to the first stall and the refinements, per phase
+    TEST_ASSERT_LESS_THAN(30, trials);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_finds_acceleration_limit_over_ramp);
+    RUN_TEST(test_finds_velocity_limit_at_tuned_acceleration);
+    RUN_TEST(test_fast_motor_raises_speed_above_default);
+    RUN_TEST(test_strong_motor_stops_at_configured_maximum);
+    RUN_TEST(test_weak_motor_stays_below_first_stall);
+    RUN_TEST(test_no_stallguard_readings_fails);
+    RUN_TEST(test_trials_without_samples_count_as_stalls);
+    RUN_TEST(test_search_is_bounded);
+    return UNITY_END();
+}
@@ -0,0 +1,380 @@
+// BulkReceiver and the bulk CRCs. The host side follows mac/ota_update.py:
+// a window of chunks in flight, back to the nak'ed offset on a nak, and a
+// resume with the same start command when the replies stop.
+//
+//   pio test -e native -f test_bulk
+
+#include <stdint.h>
+#include <string.h>
+#include <unity.h>
+#include <vector>
+#include "bulk.h"
+
+#define IMAGE_SIZE 20000  // Not a multiple of the chunk size
+#define CHUNK 244  // Payload per chunk at a 253-byte MTU
+#define MAX_PACKETS 100000  // Guard against a transfer that never ends
+
+struct RecordingSink : public BulkSink {
+    std::vector<uint8_t> data;
+    uint32_t size = 0;
+    int begins = 0;
+    int finishes = 0;
+    int aborts = 0;
+    long failAt = -1;  // Refuse the write that would pass this many bytes
+
+    bool begin(uint32_t length) override {
+        begins++;
+        size = length;
+        data.clear();
+        return true;
+    }
+
+    bool write(const uint8_t* bytes, size_t length) override {
+        if (failAt >= 0 && data.size() + length > (size_t)failAt) {
+            return false;
+        }
+        data.insert(data.end(), bytes, bytes + length);
+        return true;
+    }
+
+    bool finish() override {
+        finishes++;
+        return true;
+    }
+
+    void abort() override {
+        aborts++;
+    }
+};
+
+static std::vector<uint8_t> image;
+
+static void makeImage(size_t size) {
+    image.resize(size);
+    uint32_t seed = 1;
+    for (size_t i = 0; i < size; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        image[i] = seed >> 24;
+    }
+}
+
+static uint32_t imageCrc() {
+    return bulkCrc32(0, image.data(), image.size());
+}
+
+static size_t packet(uint8_t* buffer, uint32_t offset, size_t length) {
+    uint16_t crc = bulkCrc16(&image[offset], length);
+    memcpy(buffer, &offset, sizeof(offset));
+    memcpy(buffer + sizeof(offset), &crc, sizeof(crc));
+    memcpy(buffer + BULK_CHUNK_HEADER, &image[offset], length);
+    return BULK_CHUNK_HEADER + length;
+}
+
+static BulkReceiver::Result send(BulkReceiver& receiver, uint32_t offset) {
+    uint8_t buffer[BULK_CHUNK_HEADER + BULK_MAX_CHUNK];
+    size_t length = image.size() - offset < CHUNK ? image.size() - offset : CHUNK;
+    return receiver.receive(buffer, packet(buffer, offset, length));
+}
+
+struct Transfer {
+    BulkReceiver::Result result;
+    uint32_t packets;
+    uint32_t resumes;
+};
+
+// Host loop over a link that loses lossPercent of the packets and flips a
+// byte in corruptPercent of them, pseudo-randomly but repeatably
+static Transfer transfer(BulkReceiver& receiver, RecordingSink& sink, uint32_t lossPercent, uint32_t corruptPercent) {
+    Transfer run = { BulkReceiver::BULK_NONE, 0, 0 };
+    uint32_t seed = 12345;
+    TEST_ASSERT_TRUE(receiver.start(&sink, BULK_OTA, image.size(), imageCrc()));
+    uint32_t offset = receiver.received();
+    uint32_t acked = offset;
+    while (run.packets < MAX_PACKETS) {
+        // Fill the window, collecting the replies as the host would see them
+        std::vector<std::pair<BulkReceiver::Result, uint32_t>> replies;
+        while (offset < image.size() && offset - acked < BULK_WINDOW * CHUNK) {
+            uint8_t buffer[BULK_CHUNK_HEADER + BULK_MAX_CHUNK];
+            size_t length = image.size() - offset < CHUNK ? image.size() - offset : CHUNK;
+            size_t packetLength = packet(buffer, offset, length);
+            offset += length;
+            run.packets++;
+            seed = seed * 1664525u + 1013904223u;
+            uint32_t chance = (seed >> 16) % 100;
+            if (chance < lossPercent) {
+                continue;
+            }
+            if (chance < lossPercent + corruptPercent) {
+                buffer[BULK_CHUNK_HEADER + length / 2] ^= 0x40;
+            }
+            BulkReceiver::Result result = receiver.receive(buffer, packetLength);
+            if (result != BulkReceiver::BULK_NONE) {
+                replies.push_back({ result, receiver.received() });
+            }
+        }
+
+        if (replies.empty()) {
+            // Tail chunks lost, or the acks were: ask where the device is
+            run.resumes++;
+            TEST_ASSERT_TRUE(receiver.start(&sink, BULK_OTA, image.size(), imageCrc()));
+            acked = offset = receiver.received();
+            continue;
+        }
+        for (auto& reply : replies) {
+            switch (reply.first) {
+            case BulkReceiver::BULK_ACK:
+                acked = reply.second > acked ? reply.second : acked;
+                break;
+            case BulkReceiver::BULK_NAK:
+                acked = offset = reply.second;
+                break;
+            case BulkReceiver::BULK_DONE:
+            case BulkReceiver::BULK_FAILED:
+                run.result = reply.first;
+                return run;
+            default:
+                break;
+            }
+        }
+    }
+    return run;
+}
+
+void setUp() {
+    makeImage(IMAGE_SIZE);
+}
+
+void tearDown() {
+}
+
+void test_crc16_ccitt_check_value() {
+    const uint8_t check[] = "123456789";
+    TEST_ASSERT_EQUAL_HEX16(0x29B1, bulkCrc16(check, 9));
+    TEST_ASSERT_EQUAL_HEX16(0xFFFF, bulkCrc16(check, 0));
+}
+
+void test_crc32_matches_zlib() {
+    const uint8_t check[] = "123456789";
+    TEST_ASSERT_EQUAL_HEX32(0xCBF43926, bulkCrc32(0, check, 9));
+    TEST_ASSERT_EQUAL_HEX32(0, bulkCrc32(0, check, 0));
+}
+
+void test_crc32_continues_across_chunks() {
+    uint32_t crc = 0;
+    for (size_t offset = 0; offset < image.size(); offset += CHUNK) {
+        size_t length = image.size() - offset < CHUNK ? image.size() - offset : CHUNK;
+        crc = bulkCrc32(crc, &image[offset], length);
+    }
+    TEST_ASSERT_EQUAL_HEX32(imageCrc(), crc);
+}
+
+void test_clean_transfer() {
+    BulkReceiver receiver;
+    RecordingSink sink;
+    TEST_ASSERT_TRUE(receiver.start(&sink, BULK_OTA, image.size(), imageCrc()));
+    int acks = 0;
+    uint32_t chunks = 0;
+    BulkReceiver::Result result = BulkReceiver::BULK_NONE;
+    for (uint32_t offset = 0; offset < image.size(); offset += CHUNK) {
+        result = send(receiver, offset);
+        chunks++;
+        if (result == BulkReceiver::BULK_ACK) {
+            acks++;
+            TEST_ASSERT_EQUAL_UINT32(0, chunks % BULK_ACK_INTERVAL);
+        }
+    }
+    TEST_ASSERT_EQUAL(BulkReceiver::BULK_DONE, result);
+    TEST_ASSERT_EQUAL((chunks - 1) / BULK_ACK_INTERVAL, acks);
+    TEST_ASSERT_FALSE(receiver.active());
+    TEST_ASSERT_EQUAL(1, sink.finishes);
+    TEST_ASSERT_EQUAL(0, sink.aborts);
+    TEST_ASSERT_EQUAL_UINT32(image.size(), sink.data.size());
+    TEST_ASSERT_EQUAL_MEMORY(image.data(), sink.data.data(), image.size());
+}
+
+void test_empty_transfer_is_refused() {
+    BulkReceiver receiver;
+    RecordingSink sink;
+    TEST_ASSERT_FALSE(receiver.start(&sink, BULK_OTA, 0, 0));
+    TEST_ASSERT_FALSE(receiver.active());
+    TEST_ASSERT_EQUAL(0, sink.begins);
+}
+
+void test_bad_crc_naks_once_per_gap() {
+    BulkReceiver receiver;
+    RecordingSink sink;
+    TEST_ASSERT_TRUE(receiver.start(&sink, BULK_OTA, image.size(), imageCrc()));
+    TEST_ASSERT_EQUAL(BulkReceiver::BULK_NONE, send(receiver, 0));
+
+    uint8_t buffer[BULK_CHUNK_HEADER + BULK_MAX_CHUNK];
+    size_t length = packet(buffer, CHUNK, CHUNK);
+    buffer[BULK_CHUNK_HEADER] ^= 1;
+    TEST_ASSERT_EQUAL(BulkReceiver::BULK_NAK, receiver.receive(buffer, length));
+    TEST_ASSERT_EQUAL_UINT32(CHUNK, receiver.received());
+
+    // The rest of the window is dropped quietly
+    TEST_ASSERT_EQUAL(BulkReceiver::BULK_NONE, send(receiver, 2 * CHUNK));
+    TEST_ASSERT_EQUAL(BulkReceiver::BULK_NONE, send(receiver, 3 * CHUNK));
+    TEST_ASSERT_EQUAL_UINT32(CHUNK, sink.data.size());
+
+    // Resent from the nak'ed offset it goes on, and a later gap naks again
+    TEST_ASSERT_EQUAL(BulkReceiver::BULK_NONE, send(receiver, CHUNK));
+    TEST_ASSERT_EQUAL_UINT32(2 * CHUNK, receiver.received());
+    TEST_ASSERT_EQUAL(BulkReceiver::BULK_NAK, send(receiver, 4 * CHUNK));
+}
+
+void test_duplicate_and_oversize_chunks_nak() {
+    BulkReceiver receiver;
+    RecordingSink sink;
+    TEST_ASSERT_TRUE(receiver.start(&sink, BULK_OTA, image.size(), imageCrc()));
+    send(receiver, 0);
+    TEST_ASSERT_EQUAL(BulkReceiver::BULK_NAK, send(receiver, 0));
+    TEST_ASSERT_EQUAL_UINT32(CHUNK, sink.data.size());
+
+    // A payload running past the announced size
+    BulkReceiver small;
+    RecordingSink smallSink;
+    TEST_ASSERT_TRUE(small.start(&smallSink, BULK_OTA, CHUNK - 1, bulkCrc32(0, image.data(), CHUNK - 1)));
+    uint8_t buffer[BULK_CHUNK_HEADER + BULK_MAX_CHUNK];
+    TEST_ASSERT_EQUAL(BulkReceiver::BULK_NAK, small.receive(buffer, packet(buffer, 0, CHUNK)));
+    TEST_ASSERT_EQUAL(0, smallSink.data.size());
+}
+
+void test_header_only_packet_is_ignored() {
+    BulkReceiver receiver;
+    RecordingSink sink;
+    TEST_ASSERT_TRUE(receiver.start(&sink, BULK_OTA, image.size(), imageCrc()));
+    uint8_t buffer[BULK_CHUNK_HEADER] = { 0 };
+    TEST_ASSERT_EQUAL(BulkReceiver::BULK_NONE, receiver.receive(buffer, sizeof(buffer)));
+    TEST_ASSERT_EQUAL(BulkReceiver::BULK_NONE, receiver.receive(buffer, 0));
+}
+
+void test_resume_keeps_received_data() {
+    BulkReceiver receiver;
+    RecordingSink sink;
+    TEST_ASSERT_TRUE(receiver.start(&sink, BULK_OTA, image.size(), imageCrc()));
+    for (uint32_t offset = 0; offset < 10 * CHUNK; offset += CHUNK) {
+        send(receiver, offset);
+    }
+    // A gap nak'ed, then the link drops before the resend
+    TEST_ASSERT_EQUAL(BulkReceiver::BULK_NAK, send(receiver, 11 * CHUNK));
+
+    // Same start command: carries on from the last good offset with the nak re-armed
+    TEST_ASSERT_TRUE(receiver.start(&sink, BULK_OTA, image.size(), imageCrc()));
+    TEST_ASSERT_EQUAL(1, sink.begins);
+    TEST_ASSERT_EQUAL(0, sink.aborts);
+    TEST_ASSERT_EQUAL_UINT32(10 * CHUNK, receiver.received());
+    TEST_ASSERT_EQUAL(BulkReceiver::BULK_NAK, send(receiver, 12 * CHUNK));
+
+    BulkReceiver::Result result = BulkReceiver::BULK_NONE;
+    for (uint32_t offset = receiver.received(); offset < image.size(); offset += CHUNK) {
+        result = send(receiver, offset);
+    }
+    TEST_ASSERT_EQUAL(BulkReceiver::BULK_DONE, result);
+    TEST_ASSERT_EQUAL_MEMORY(image.data(), sink.data.data(), image.size());
+}
+
+void test_different_start_restarts() {
+    BulkReceiver receiver;
+    RecordingSink sink;
+    TEST_ASSERT_TRUE(receiver.start(&sink, BULK_OTA, image.size(), imageCrc()));
+    send(receiver, 0);
+    send(receiver, CHUNK);
+
+    // A different image: the partial one is dropped
+    TEST_ASSERT_TRUE(receiver.start(&sink, BULK_OTA, image.size(), imageCrc() ^ 1));
+    TEST_ASSERT_EQUAL(2, sink.begins);
+    TEST_ASSERT_EQUAL(1, sink.aborts);
+    TEST_ASSERT_EQUAL_UINT32(0, receiver.received());
+}
+
+void test_image_crc_mismatch_fails() {
+    BulkReceiver receiver;
+    RecordingSink sink;
+    TEST_ASSERT_TRUE(receiver.start(&sink, BULK_OTA, image.size(), imageCrc() ^ 0x80000000u));
+    BulkReceiver::Result result = BulkReceiver::BULK_NONE;
+    for (uint32_t offset = 0; offset < image.size(); offset += CHUNK) {
+        result = send(receiver, offset);
+    }
+    TEST_ASSERT_EQUAL(BulkReceiver::BULK_FAILED, result);
+    TEST_ASSERT_FALSE(receiver.active());
+    TEST_ASSERT_EQUAL(0, sink.finishes);
+    TEST_ASSERT_EQUAL(1, sink.aborts);
+}
+
+void test_sink_write_failure_fails() {
+    BulkReceiver receiver;
+    RecordingSink sink;
+    sink.failAt = 5 * CHUNK;
+    TEST_ASSERT_TRUE(receiver.start(&sink, BULK_OTA, image.size(), imageCrc()));
+    BulkReceiver::Result result = BulkReceiver::BULK_NONE;
+    uint32_t offset = 0;
+    for (; offset < image.size() && result != BulkReceiver::BULK_FAILED; offset += CHUNK) {
+        result = send(receiver, offset);
+    }
+    TEST_ASSERT_EQUAL(BulkReceiver::BULK_FAILED, result);
+    TEST_ASSERT_EQUAL_UINT32(6 * CHUNK, offset);
+    TEST_ASSERT_FALSE(receiver.active());
+    TEST_ASSERT_EQUAL(1, sink.aborts);
+    // Nothing more is accepted until a new start
+    TEST_ASSERT_EQUAL(BulkReceiver::BULK_NONE, send(receiver, 5 * CHUNK));
+}
+
+void test_host_recovers_from_lost_chunks() {
+    BulkReceiver receiver;
+    RecordingSink sink;
+    Transfer run = transfer(receiver, sink, 10, 0);
+    TEST_ASSERT_EQUAL(BulkReceiver::BULK_DONE, run.result);
+    TEST_ASSERT_EQUAL_MEMORY(image.data(), sink.data.data(), image.size());
+    TEST_ASSERT_EQUAL(1, sink.begins);
+}
+
+void test_host_recovers_from_corrupt_chunks() {
+    BulkReceiver receiver;
+    RecordingSink sink;
+    Transfer run = transfer(receiver, sink, 0, 10);
+    TEST_ASSERT_EQUAL(BulkReceiver::BULK_DONE, run.result);
+    TEST_ASSERT_EQUAL_MEMORY(image.data(), sink.data.data(), image.size());
+}
+
+void test_host_resumes_after_lost_tail() {
+    // Half the packets lost: windows often end with nothing to answer
+    BulkReceiver receiver;
+    RecordingSink sink;
+    Transfer run = transfer(receiver, sink, 50, 0);
+    TEST_ASSERT_EQUAL(BulkReceiver::BULK_DONE, run.result);
+    TEST_ASSERT_GREATER_THAN(0, run.resumes);
+    TEST_ASSERT_EQUAL_MEMORY(image.data(), sink.data.data(), image.size());
+    TEST_ASSERT_EQUAL(1, sink.begins);
+    TEST_ASSERT_EQUAL(0, sink.aborts);
+}
+
+void test_clean_link_needs_no_resends() {
+    BulkReceiver receiver;
+    RecordingSink sink;
+    Transfer run = transfer(receiver, sink, 0, 0);
+    TEST_ASSERT_EQUAL(BulkReceiver::BULK_DONE, run.result);
+    TEST_ASSERT_EQUAL_UINT32((IMAGE_SIZE + CHUNK - 1) / CHUNK, run.packets);
+    TEST_ASSERT_EQUAL_UINT32(0, run.resumes);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_crc16_ccitt_check_value);
+    RUN_TEST(test_crc32_matches_zlib);
+    RUN_TEST(test_crc32_continues_across_chunks);
+    RUN_TEST(test_clean_transfer);
+    RUN_TEST(test_empty_transfer_is_refused);
+    RUN_TEST(test_bad_crc_naks_once_per_gap);
+    RUN_TEST(test_duplicate_and_oversize_chunks_nak);
+    RUN_TEST(test_header_only_packet_is_ignored);
+    RUN_TEST(test_resume_keeps_received_data);
+    RUN_TEST(test_different_start_restarts);
+    RUN_TEST(test_image_crc_mismatch_fails);
+    RUN_TEST(test_sink_write_failure_fails);
+    RUN_TEST(test_host_recovers_from_lost_chunks);
+    RUN_TEST(test_host_recovers_from_corrupt_chunks);
+    RUN_TEST(test_host_resumes_after_lost_tail);
+    RUN_TEST(test_clean_link_needs_no_resends);
+    return UNITY_END();
+}
@@ -0,0 +1,77 @@
+// The text command parsers the BLE callbacks in main.cpp run on every write.
+// Anything they accept goes straight to the motion planner, so what they
+// refuse matters as much as what they read.
+//
+//   pio test -e native -f test_command
+
+#include <unity.h>
+#include "command.h"
+
+void setUp() {}
+void tearDown() {}
+
+void test_position_reads_both_axes() {
+    float pan = 0, tilt = 0;
+    TEST_ASSERT_TRUE(parsePosition("12.5,-30", pan, tilt));
+    TEST_ASSERT_EQUAL_FLOAT(12.5f, pan);
+    TEST_ASSERT_EQUAL_FLOAT(-30.0f, tilt);
+    TEST_ASSERT_FALSE(parsePosition("12.5", pan, tilt));
+}
+
+void test_jog_field_counts() {
+    float pan = 0, tilt = 0;
+    long timeout = -1;
+    TEST_ASSERT_EQUAL(3, parseJog("10,-5,250", pan, tilt, timeout));
+    TEST_ASSERT_EQUAL_FLOAT(10.0f, pan);
+    TEST_ASSERT_EQUAL_FLOAT(-5.0f, tilt);
+    TEST_ASSERT_EQUAL(250, timeout);
+
+    timeout = -1;
+    TEST_ASSERT_EQUAL(2, parseJog("1,2", pan, tilt, timeout));
+    TEST_ASSERT_EQUAL(-1, timeout);
+    TEST_ASSERT_EQUAL(0, parseJog("1", pan, tilt, timeout));
+}
+
+void test_limits_reads_all_fields() {
+    float fields[6];
+    TEST_ASSERT_TRUE(parseLimits("90,180,900,60,120,0", fields));
+    const float expected[6] = { 90, 180, 900, 60, 120, 0 };
+    for (int i = 0; i < 6; i++) {
+        TEST_ASSERT_EQUAL_FLOAT(expected[i], fields[i]);
+    }
+}
+
+void test_limits_rejects_malformed() {
+    float fields[6];
+    TEST_ASSERT_FALSE(parseLimits("90,180,900,60,120", fields));
+    TEST_ASSERT_FALSE(parseLimits("90,180,900,60,120,0,5", fields));
+    TEST_ASSERT_FALSE(parseLimits("90,,900,60,120,0", fields));
+    TEST_ASSERT_FALSE(parseLimits("90,180x,900,60,120,0", fields));
+}
+
+void test_limits_rejects_out_of_range() {
+    float fields[6];
+    TEST_ASSERT_FALSE(parseLimits("0,180,900,60,120,0", fields));
+    TEST_ASSERT_FALSE(parseLimits("90,-180,900,60,120,0", fields));
+    TEST_ASSERT_FALSE(parseLimits("90,180,-1,60,120,0", fields));
+}
+
+void test_limits_rejects_non_finite() {
+    float fields[6];
+    TEST_ASSERT_FALSE(parseLimits("inf,180,900,60,120,0", fields));
+    TEST_ASSERT_FALSE(parseLimits("90,INFINITY,900,60,120,0", fields));
+    TEST_ASSERT_FALSE(parseLimits("90,180,inf,60,120,0", fields));
+    TEST_ASSERT_FALSE(parseLimits("90,180,900,60,120,nan", fields));
+    TEST_ASSERT_FALSE(parseLimits("90,180,900,1e39,120,0", fields));
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_position_reads_both_axes);
+    RUN_TEST(test_jog_field_counts);
+    RUN_TEST(test_limits_reads_all_fields);
+    RUN_TEST(test_limits_rejects_malformed);
+    RUN_TEST(test_limits_rejects_out_of_range);
+    RUN_TEST(test_limits_rejects_non_finite);
+    return UNITY_END();
+}
@@ -0,0 +1,170 @@
+// ShaftEncoder against a mock TwoWire (test/mock/Wire.h) holding the
+// AS5600's registers. The shaft is turned by setting the raw angle between
+// reads, as the encoder task in main.cpp samples it.
+//
+//   pio test -e native -f test_encoder
+
+#include <unity.h>
+#include "encoder.h"
+
+#define AS5600_STATUS 0x0B
+#define AS5600_RAW_ANGLE 0x0C
+#define MAGNET_OK 0x20  // Detected, neither too weak nor too strong
+#define MAGNET_WEAK 0x30
+#define MAGNET_STRONG 0x28
+
+static TwoWire wire;
+
+static void setAngle(uint16_t raw) {
+    wire.registers[AS5600_RAW_ANGLE] = raw >> 8;
+    wire.registers[AS5600_RAW_ANGLE + 1] = raw & 0xFF;
+}
+
+// Fresh bus with an AS5600 at angle raw
+static void attach(uint8_t status, uint16_t raw) {
+    wire = TwoWire();
+    wire.address = AS5600_ADDRESS;
+    wire.registers[AS5600_STATUS] = status;
+    setAngle(raw);
+}
+
+// Turn the shaft by delta counts in steps of at most step, reading after each
+static bool turn(ShaftEncoder& encoder, long delta, int step) {
+    long angle = encoder.raw();
+    while (delta != 0) {
+        long move = delta > step ? step : delta < -step ? -step : delta;
+        angle = ((angle + move) % AS5600_COUNTS + AS5600_COUNTS) % AS5600_COUNTS;
+        delta -= move;
+        setAngle(angle);
+        if (!encoder.read()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void setUp() {
+}
+
+void tearDown() {
+}
+
+void test_begin_reads_initial_angle() {
+    attach(MAGNET_OK, 1234);
+    ShaftEncoder encoder(wire);
+    TEST_ASSERT_TRUE(encoder.begin(5, 6, 400000));
+    TEST_ASSERT_TRUE(wire.started);
+    TEST_ASSERT_TRUE(encoder.present());
+    TEST_ASSERT_EQUAL_UINT16(1234, encoder.raw());
+    TEST_ASSERT_EQUAL(1234, encoder.counts());
+    TEST_ASSERT_EQUAL_UINT32(0, encoder.errors());
+}
+
+void test_missing_magnet_is_not_present() {
+    attach(0x00, 1234);
+    ShaftEncoder encoder(wire);
+    TEST_ASSERT_FALSE(encoder.begin(5, 6, 400000));
+    TEST_ASSERT_FALSE(encoder.present());
+}
+
+void test_magnet_out_of_range_is_not_present() {
+    attach(MAGNET_WEAK, 1234);
+    ShaftEncoder weak(wire);
+    TEST_ASSERT_FALSE(weak.begin(5, 6, 400000));
+    TEST_ASSERT_FALSE(weak.present());
+
+    attach(MAGNET_STRONG, 1234);
+    ShaftEncoder strong(wire);
+    TEST_ASSERT_FALSE(strong.begin(5, 6, 400000));
+    TEST_ASSERT_FALSE(strong.present());
+}
+
+void test_no_device_is_not_present() {
+    attach(MAGNET_OK, 1234);
+    wire.connected = false;
+    ShaftEncoder encoder(wire);
+    TEST_ASSERT_FALSE(encoder.begin(5, 6, 400000));
+    TEST_ASSERT_FALSE(encoder.present());
+}
+
+void test_upper_bits_of_angle_are_ignored() {
+    attach(MAGNET_OK, 0);
+    wire.registers[AS5600_RAW_ANGLE] = 0xF3;
+    wire.registers[AS5600_RAW_ANGLE + 1] = 0x21;
+    ShaftEncoder encoder(wire);
+    TEST_ASSERT_TRUE(encoder.begin(5, 6, 400000));
+    TEST_ASSERT_EQUAL_UINT16(0x321, encoder.raw());
+}
+
+void test_wraps_forward_through_zero() {
+    attach(MAGNET_OK, 4000);
+    ShaftEncoder encoder(wire);
+    TEST_ASSERT_TRUE(encoder.begin(5, 6, 400000));
+    setAngle(100);
+    TEST_ASSERT_TRUE(encoder.read());
+    TEST_ASSERT_EQUAL_UINT16(100, encoder.raw());
+    TEST_ASSERT_EQUAL(4096 + 100, encoder.counts());
+}
+
+void test_wraps_backward_through_zero() {
+    attach(MAGNET_OK, 100);
+    ShaftEncoder encoder(wire);
+    TEST_ASSERT_TRUE(encoder.begin(5, 6, 400000));
+    setAngle(4000);
+    TEST_ASSERT_TRUE(encoder.read());
+    TEST_ASSERT_EQUAL(4000 - 4096, encoder.counts());
+}
+
+void test_counts_many_turns_both_ways() {
+    attach(MAGNET_OK, 2000);
+    ShaftEncoder encoder(wire);
+    TEST_ASSERT_TRUE(encoder.begin(5, 6, 400000));
+    // Just under half a turn per read is the fastest that still unwraps
+    TEST_ASSERT_TRUE(turn(encoder, 10L * AS5600_COUNTS + 123, AS5600_COUNTS / 2 - 1));
+    TEST_ASSERT_EQUAL(2000 + 10L * AS5600_COUNTS + 123, encoder.counts());
+    TEST_ASSERT_TRUE(turn(encoder, -13L * AS5600_COUNTS, 700));
+    TEST_ASSERT_EQUAL(2000 - 3L * AS5600_COUNTS + 123, encoder.counts());
+}
+
+void test_bus_error_keeps_last_reading() {
+    attach(MAGNET_OK, 4000);
+    ShaftEncoder encoder(wire);
+    TEST_ASSERT_TRUE(encoder.begin(5, 6, 400000));
+    setAngle(4090);
+    wire.failReads = 1;
+    TEST_ASSERT_FALSE(encoder.read());
+    TEST_ASSERT_EQUAL_UINT32(1, encoder.errors());
+    TEST_ASSERT_EQUAL(4000, encoder.counts());
+
+    // The next good read unwraps against the last good one
+    setAngle(50);
+    TEST_ASSERT_TRUE(encoder.read());
+    TEST_ASSERT_EQUAL(4096 + 50, encoder.counts());
+}
+
+void test_lost_device_counts_errors() {
+    attach(MAGNET_OK, 1000);
+    ShaftEncoder encoder(wire);
+    TEST_ASSERT_TRUE(encoder.begin(5, 6, 400000));
+    wire.connected = false;
+    for (int i = 0; i < 5; i++) {
+        TEST_ASSERT_FALSE(encoder.read());
+    }
+    TEST_ASSERT_EQUAL_UINT32(5, encoder.errors());
+    TEST_ASSERT_EQUAL(1000, encoder.counts());
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_begin_reads_initial_angle);
+    RUN_TEST(test_missing_magnet_is_not_present);
+    RUN_TEST(test_magnet_out_of_range_is_not_present);
+    RUN_TEST(test_no_device_is_not_present);
+    RUN_TEST(test_upper_bits_of_angle_are_ignored);
+    RUN_TEST(test_wraps_forward_through_zero);
+    RUN_TEST(test_wraps_backward_through_zero);
+    RUN_TEST(test_counts_many_turns_both_ways);
+    RUN_TEST(test_bus_error_keeps_last_reading);
+    RUN_TEST(test_lost_device_counts_errors);
+    return UNITY_END();
+}
@@ -0,0 +1,166 @@
+// MotionAxis with limits changed mid-move (LimitsCallbacks in main.cpp
+// applies them on the next motion tick). Geometry and default limits are
+// the pan axis's.
+//
+//   pio test -e native -f test_motion
+
+#include <math.h>
+#include <unity.h>
+#include "motion.h"
+
+#define STEPS_PER_DEGREE (200 * 16 * (170.0 / 18.0) / 360.0)
+#define TICK 0.001f  // Seconds per motion update
+#define MOVE 90.0  // Degrees
+#define SETTLE_TIMEOUT 10.0  // Seconds a move may take to come to rest
+
+static AxisLimits limitsDegrees(float velocity, float acceleration, float jerk) {
+    return { (float)(velocity * STEPS_PER_DEGREE), (float)(acceleration * STEPS_PER_DEGREE),
+             (float)(jerk * STEPS_PER_DEGREE) };
+}
+
+struct Run {
+    double peak;  // Furthest position reached, degrees
+    double peakVelocity;  // Degrees per second
+    double peakAcceleration;  // Degrees per second squared
+    double settleTime;  // Seconds until at rest
+    double final;  // Degrees
+};
+
+// A MOVE degree move from rest; at switchTime the limits change to after
+static Run runMove(const AxisLimits& before, const AxisLimits& after, double switchTime) {
+    MotionAxis axis(before);
+    axis.moveTo(lround(MOVE * STEPS_PER_DEGREE));
+    Run run = { 0, 0, 0, -1, 0 };
+    bool switched = false;
+    for (double t = 0; t < SETTLE_TIMEOUT; t += TICK) {
+        if (!switched && t >= switchTime) {
+            axis.setLimits(after);
+            switched = true;
+        }
+        axis.update(TICK);
+        run.peak = fmax(run.peak, axis.position() / STEPS_PER_DEGREE);
+        run.peakVelocity = fmax(run.peakVelocity, fabs(axis.velocity()) / STEPS_PER_DEGREE);
+        run.peakAcceleration = fmax(run.peakAcceleration, fabs(axis.acceleration()) / STEPS_PER_DEGREE);
+        if (switched && !axis.isMoving()) {
+            run.settleTime = t;
+            break;
+        }
+    }
+    run.final = axis.position() / STEPS_PER_DEGREE;
+    return run;
+}
+
+static const AxisLimits defaults = limitsDegrees(90, 180, 1800);
+static const AxisLimits gentle = limitsDegrees(20, 30, 300);
+
+void setUp() {
+}
+
+void tearDown() {
+}
+
+void test_unchanged_limits_reach_target() {
+    Run run = runMove(defaults, defaults, 0);
+    TEST_ASSERT_FLOAT_WITHIN(0.02, MOVE, run.final);
+    TEST_ASSERT_LESS_THAN_FLOAT(MOVE + 0.02, run.peak);
+    TEST_ASSERT_LESS_THAN_FLOAT(90.5, run.peakVelocity);
+}
+
+void test_lower_limits_while_accelerating() {
+    // Still ramping up at 400 ms
+    Run run = runMove(defaults, gentle, 0.4);
+    TEST_ASSERT_LESS_THAN_FLOAT(MOVE + 0.1, run.peak);
+    TEST_ASSERT_LESS_THAN_FLOAT(90.5, run.peakVelocity);
+    TEST_ASSERT_LESS_THAN_FLOAT(180.5, run.peakAcceleration);
+    TEST_ASSERT_GREATER_THAN_FLOAT(0, run.settleTime);
+    TEST_ASSERT_FLOAT_WITHIN(0.02, MOVE, run.final);
+}
+
+void test_lower_limits_at_cruise() {
+    Run run = runMove(defaults, gentle, 0.7);
+    TEST_ASSERT_LESS_THAN_FLOAT(MOVE + 0.1, run.peak);
+    TEST_ASSERT_LESS_THAN_FLOAT(90.5, run.peakVelocity);
+    TEST_ASSERT_FLOAT_WITHIN(0.02, MOVE, run.final);
+}
+
+void test_lower_acceleration_while_braking() {
+    // Braking for the target from about 0.6 s before arrival
+    Run run = runMove(defaults, limitsDegrees(90, 30, 1800), 0.95);
+    TEST_ASSERT_LESS_THAN_FLOAT(MOVE + 0.1, run.peak);
+    TEST_ASSERT_FLOAT_WITHIN(0.02, MOVE, run.final);
+}
+
+void test_lower_jerk_at_cruise() {
+    Run run = runMove(defaults, limitsDegrees(90, 180, 100), 0.7);
+    TEST_ASSERT_LESS_THAN_FLOAT(MOVE + 0.1, run.peak);
+    TEST_ASSERT_FLOAT_WITHIN(0.02, MOVE, run.final);
+}
+
+void test_lower_velocity_applies_at_once() {
+    MotionAxis axis(defaults);
+    axis.moveTo(lround(MOVE * STEPS_PER_DEGREE));
+    for (int i = 0; i < 700; i++) {
+        axis.update(TICK);
+    }
+    axis.setLimits(limitsDegrees(20, 180, 1800));
+    // Down from 90 to 20 deg/s takes well under half a second at these limits
+    for (int i = 0; i < 500; i++) {
+        axis.update(TICK);
+    }
+    TEST_ASSERT_FLOAT_WITHIN(0.5, 20, fabs(axis.velocity()) / STEPS_PER_DEGREE);
+}
+
+void test_lowered_limits_take_over_once_they_fit() {
+    MotionAxis axis(defaults);
+    axis.moveTo(lround(MOVE * STEPS_PER_DEGREE));
+    for (int i = 0; i < 400; i++) {
+        axis.update(TICK);
+    }
+    axis.setLimits(gentle);
+    TEST_ASSERT_EQUAL_INT((int)defaults.acceleration, (int)axis.activeLimits().acceleration);
+    TEST_ASSERT_EQUAL_INT((int)gentle.velocity, (int)axis.activeLimits().velocity);
+
+    // Handed over while still on the way, not only once at rest
+    bool movingAtHandover = false;
+    for (int i = 0; i < SETTLE_TIMEOUT / TICK && axis.isMoving(); i++) {
+        axis.update(TICK);
+        if (axis.activeLimits().acceleration == gentle.acceleration) {
+            movingAtHandover = axis.isMoving();
+            break;
+        }
+    }
+    TEST_ASSERT_TRUE(movingAtHandover);
+    TEST_ASSERT_EQUAL_INT((int)gentle.jerk, (int)axis.activeLimits().jerk);
+}
+
+void test_raised_limits_apply_at_once() {
+    MotionAxis axis(gentle);
+    axis.moveTo(lround(MOVE * STEPS_PER_DEGREE));
+    for (int i = 0; i < 300; i++) {
+        axis.update(TICK);
+    }
+    axis.setLimits(defaults);
+    TEST_ASSERT_EQUAL_INT((int)defaults.acceleration, (int)axis.activeLimits().acceleration);
+    TEST_ASSERT_EQUAL_INT((int)defaults.jerk, (int)axis.activeLimits().jerk);
+}
+
+void test_limits_at_rest_apply_at_once() {
+    MotionAxis axis(defaults);
+    axis.setLimits(gentle);
+    TEST_ASSERT_EQUAL_INT((int)gentle.acceleration, (int)axis.activeLimits().acceleration);
+    TEST_ASSERT_EQUAL_INT((int)gentle.velocity, (int)axis.activeLimits().velocity);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_unchanged_limits_reach_target);
+    RUN_TEST(test_lower_limits_while_accelerating);
+    RUN_TEST(test_lower_limits_at_cruise);
+    RUN_TEST(test_lower_acceleration_while_braking);
+    RUN_TEST(test_lower_jerk_at_cruise);
+    RUN_TEST(test_lower_velocity_applies_at_once);
+    RUN_TEST(test_lowered_limits_take_over_once_they_fit);
+    RUN_TEST(test_raised_limits_apply_at_once);
+    RUN_TEST(test_limits_at_rest_apply_at_once);
+    return UNITY_END();
+}
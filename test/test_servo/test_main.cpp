@@ -0,0 +1,281 @@
+// VisualServo closing the loop through MotionAxis, with a simulated camera
+// that sees the subject relative to where the axis was at capture time and
+// reports it after a transport latency, plus ClockSync against a host clock
+// with jittery delivery. Gains, limits and frame rate are main.cpp's
+// defaults on the pan axis.
+//
+//   pio test -e native -f test_servo
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unity.h>
+#include "motion.h"
+#include "servo.h"
+
+#define STEPS_PER_DEGREE (200 * 16 * (170.0 / 18.0) / 360.0)
+#define TICK 1000  // Microseconds per motion update
+#define FRAME_INTERVAL 33333  // 30 frames per second
+#define LATENCY 100000  // Capture to arrival, microseconds
+#define MAX_QUEUED 16  // Frames in flight
+
+static ServoGains defaultGains() {
+    return { 6.0f, 2.0f, (float)(5.0 * STEPS_PER_DEGREE), 0.5f, 0.0f };
+}
+
+static AxisLimits defaultLimits() {
+    return { (float)(90 * STEPS_PER_DEGREE), (float)(180 * STEPS_PER_DEGREE), (float)(1800 * STEPS_PER_DEGREE) };
+}
+
+// Subject position in degrees at time t in seconds
+typedef double (*Subject)(double t);
+
+struct Loop {
+    bool compensate;  // Stamp frames with their capture time, not their arrival
+    uint32_t latency;
+    uint32_t start;  // micros() at t = 0, to exercise wrap-around
+};
+
+struct Response {
+    double peak;  // Largest axis position, degrees
+    double finalError;  // Subject minus axis at the end, degrees
+    double maxLateError;  // Largest |error| over the last second, degrees
+    double settleTime;  // Last time |error| exceeded the settle band, seconds
+    float peakCommand;  // Largest |velocity command|, steps/s
+};
+
+#define SETTLE_BAND 0.5  // Degrees
+
+static Response run(Subject subject, double duration, const Loop& loop, float velocityLimit = 0) {
+    MotionAxis motion(defaultLimits());
+    VisualServo servo(defaultGains());
+    if (velocityLimit <= 0) {
+        velocityLimit = motion.limits().velocity;
+    }
+
+    // Frames in flight: arrival time, capture time stamp, error in steps
+    uint32_t arrival[MAX_QUEUED];
+    uint32_t stamp[MAX_QUEUED];
+    float measured[MAX_QUEUED];
+    int head = 0;
+    int count = 0;
+
+    Response response = { -1e9, 0, 0, 0, 0 };
+    long ticks = lround(duration * 1000000 / TICK);
+    for (long i = 0; i <= ticks; i++) {
+        uint32_t now = loop.start + i * TICK;
+        double t = i * TICK / 1000000.0;
+        long position = lround(motion.position());
+        servo.record(position, now);
+
+        if (i % (FRAME_INTERVAL / TICK) == 0 && count < MAX_QUEUED) {
+            int slot = (head + count++) % MAX_QUEUED;
+            arrival[slot] = now + loop.latency;
+            stamp[slot] = loop.compensate ? now : now + loop.latency;
+            measured[slot] = (subject(t) * STEPS_PER_DEGREE - position);
+        }
+        while (count > 0 && (int32_t)(now - arrival[head]) >= 0) {
+            servo.measure(measured[head], stamp[head]);
+            head = (head + 1) % MAX_QUEUED;
+            count--;
+        }
+
+        float command = servo.update(position, motion.velocity(), now, TICK / 1000000.0f, velocityLimit);
+        response.peakCommand = fmaxf(response.peakCommand, fabsf(command));
+        motion.setVelocity(command);
+        motion.update(TICK / 1000000.0f);
+
+        double degrees = motion.position() / STEPS_PER_DEGREE;
+        double error = subject(t) - degrees;
+        response.peak = fmax(response.peak, degrees);
+        if (fabs(error) > SETTLE_BAND) {
+            response.settleTime = t;
+        }
+        if (t >= duration - 1.0) {
+            response.maxLateError = fmax(response.maxLateError, fabs(error));
+        }
+        response.finalError = error;
+    }
+    return response;
+}
+
+static double smallStep(double t) {
+    (void)t;
+    return 5.0;
+}
+
+static double farSubject(double t) {
+    (void)t;
+    return 150.0;
+}
+
+static double rampSubject(double t) {
+    return 30.0 * t;
+}
+
+static double sineSubject(double t) {
+    return 10.0 * sin(2 * M_PI * 0.25 * t);
+}
+
+static const Loop compensated = { true, LATENCY, 0 };
+static const Loop uncompensated = { false, LATENCY, 0 };
+
+void setUp() {
+}
+
+void tearDown() {
+}
+
+void test_step_settles_on_subject() {
+    Response r = run(smallStep, 4.0, compensated);
+    TEST_ASSERT_LESS_THAN_FLOAT(1.0f, (float)r.settleTime);
+    TEST_ASSERT_LESS_THAN_FLOAT(5.0f * 1.1f, (float)r.peak);
+    TEST_ASSERT_LESS_THAN_FLOAT(0.3f, (float)r.maxLateError);
+}
+
+void test_latency_compensation_keeps_loop_stable() {
+    // The same frames stamped with their arrival time leave 100 ms of
+    // latency inside the loop, which the gains cannot take
+    Response with = run(smallStep, 6.0, compensated);
+    Response without = run(smallStep, 6.0, uncompensated);
+    TEST_ASSERT_LESS_THAN_FLOAT(0.5f, (float)(with.peak - 5.0));
+    TEST_ASSERT_GREATER_THAN_FLOAT(5.0f, (float)(without.peak - 5.0));
+    TEST_ASSERT_LESS_THAN_FLOAT(0.2f, (float)with.maxLateError);
+    TEST_ASSERT_GREATER_THAN_FLOAT(1.0f, (float)without.maxLateError);
+}
+
+void test_moving_subject_tracked() {
+    // Constant speed: the target velocity estimate feeds forward
+    Response ramp = run(rampSubject, 6.0, compensated);
+    TEST_ASSERT_LESS_THAN_FLOAT(0.3f, (float)ramp.maxLateError);
+
+    Response sine = run(sineSubject, 8.0, compensated);
+    Response late = run(sineSubject, 8.0, uncompensated);
+    TEST_ASSERT_LESS_THAN_FLOAT(2.0f, (float)sine.maxLateError);
+    TEST_ASSERT_LESS_THAN_FLOAT((float)late.maxLateError / 5, (float)sine.maxLateError);
+}
+
+void test_saturation_does_not_wind_up() {
+    // A long slew at a low velocity limit keeps the output saturated for
+    // seconds; integrating all the while would carry the axis far past
+    float limit = 20 * STEPS_PER_DEGREE;
+    Response r = run(farSubject, 12.0, compensated, limit);
+    TEST_ASSERT_LESS_OR_EQUAL(limit, r.peakCommand);
+    TEST_ASSERT_LESS_THAN_FLOAT(150.0f + 1.0f, (float)r.peak);
+    TEST_ASSERT_LESS_THAN_FLOAT(0.2f, (float)r.maxLateError);
+}
+
+void test_follows_micros_wrap() {
+    Loop wrapping = compensated;
+    wrapping.start = 0xFFFFFFFFu - 1500000;  // micros() wraps 1.5 s in
+    Response r = run(smallStep, 4.0, wrapping);
+    Response reference = run(smallStep, 4.0, compensated);
+    TEST_ASSERT_FLOAT_WITHIN(0.01, reference.peak, r.peak);
+    TEST_ASSERT_FLOAT_WITHIN(0.01, reference.finalError, r.finalError);
+}
+
+void test_lost_subject_stops() {
+    VisualServo servo(defaultGains());
+    float limit = defaultLimits().velocity;
+    servo.record(0, 0);
+    servo.measure(1000, 0);
+    TEST_ASSERT_TRUE(servo.tracking());
+    TEST_ASSERT_GREATER_THAN_FLOAT(0.0f, servo.update(0, 0, 1000, 0.001f, limit));
+    TEST_ASSERT_GREATER_THAN_FLOAT(0.0f, servo.update(0, 0, SERVO_LOST_TIMEOUT, 0.001f, limit));
+    TEST_ASSERT_EQUAL_FLOAT(0.0f, servo.update(0, 0, SERVO_LOST_TIMEOUT + 1000, 0.001f, limit));
+    TEST_ASSERT_FALSE(servo.tracking());
+}
+
+void test_measurement_uses_position_at_capture() {
+    // Axis moving at 1000 steps/s; a frame captured at 50 ms sees the
+    // subject 200 steps ahead of the axis as it was then
+    VisualServo servo(defaultGains());
+    for (uint32_t now = 0; now <= 150000; now += TICK) {
+        servo.record(now / 1000, now);
+    }
+    servo.measure(200, 50000);
+    // Proportional term only: the full gain applies beyond scheduleError
+    ServoGains gains = { 1.0f, 1.0f, 0.0f, 0.0f, 0.0f };
+    servo.setGains(gains);
+    float command = servo.update(250, 0, 50000, 0, 1e9f);
+    TEST_ASSERT_FLOAT_WITHIN(1.0f, 0.0f, command);
+    command = servo.update(150, 0, 50000, 0, 1e9f);
+    TEST_ASSERT_FLOAT_WITHIN(1.0f, 100.0f, command);
+}
+
+// ClockSync: the host clock runs offset from micros() and messages arrive
+// after a transport delay of at least MIN_DELAY
+#define MIN_DELAY 8000
+#define MAX_DELAY 40000
+#define MESSAGE_INTERVAL 33333
+
+static uint32_t syncSeed;
+
+static uint32_t transportDelay() {
+    syncSeed = syncSeed * 1664525u + 1013904223u;
+    return MIN_DELAY + (syncSeed >> 16) % (MAX_DELAY - MIN_DELAY);
+}
+
+// Between messages near the fastest delay the offset creeps up, so the
+// estimate stays within a few milliseconds of it rather than exactly on it
+#define SYNC_TOLERANCE 3000
+
+// Largest |estimate - true send time - MIN_DELAY| after the first second,
+// with the host clock running drift parts per million fast
+static int32_t syncError(uint32_t localStart, uint32_t hostStart, double drift, int messages) {
+    ClockSync sync;
+    syncSeed = 7;
+    int32_t worst = 0;
+    for (int i = 0; i < messages; i++) {
+        uint32_t elapsed = (uint32_t)i * MESSAGE_INTERVAL;
+        uint32_t sent = localStart + elapsed;
+        uint32_t host = hostStart + (uint32_t)llround(elapsed * (1 + drift / 1e6));
+        uint32_t estimate = sync.toLocal(host, sent + transportDelay());
+        int32_t error = (int32_t)(estimate - sent) - MIN_DELAY;
+        if (elapsed > 1000000 && abs(error) > worst) {
+            worst = abs(error);
+        }
+    }
+    return worst;
+}
+
+void test_clock_sync_takes_fastest_delay() {
+    TEST_ASSERT_LESS_THAN(SYNC_TOLERANCE, syncError(5000000, 123456789, 0, 600));
+}
+
+void test_clock_sync_follows_drift() {
+    // A host clock 100 ppm fast or slow moves about 3 us per message, within the creep
+    TEST_ASSERT_LESS_THAN(SYNC_TOLERANCE, syncError(5000000, 123456789, 100, 3000));
+    TEST_ASSERT_LESS_THAN(SYNC_TOLERANCE, syncError(5000000, 123456789, -100, 3000));
+}
+
+void test_clock_sync_ignores_a_slow_message() {
+    ClockSync sync;
+    uint32_t first = sync.toLocal(1000000, 2000000 + MIN_DELAY);
+    TEST_ASSERT_EQUAL_UINT32(2000000 + MIN_DELAY, first);
+    // Half a second late: the offset only creeps
+    uint32_t late = sync.toLocal(1100000, 2100000 + 500000);
+    TEST_ASSERT_LESS_THAN(2100000 + MIN_DELAY + 100, late);
+}
+
+void test_clock_sync_across_wrap() {
+    // Both clocks wrap mid-run; the same delays give the same errors
+    TEST_ASSERT_EQUAL(syncError(5000000, 123456789, 0, 600),
+                      syncError(0xFFFFFFFFu - 3000000, 0xFFFFFFFFu - 1000000, 0, 600));
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_step_settles_on_subject);
+    RUN_TEST(test_latency_compensation_keeps_loop_stable);
+    RUN_TEST(test_moving_subject_tracked);
+    RUN_TEST(test_saturation_does_not_wind_up);
+    RUN_TEST(test_follows_micros_wrap);
+    RUN_TEST(test_lost_subject_stops);
+    RUN_TEST(test_measurement_uses_position_at_capture);
+    RUN_TEST(test_clock_sync_takes_fastest_delay);
+    RUN_TEST(test_clock_sync_follows_drift);
+    RUN_TEST(test_clock_sync_ignores_a_slow_message);
+    RUN_TEST(test_clock_sync_across_wrap);
+    return UNITY_END();
+}
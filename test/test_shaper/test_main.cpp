@@ -0,0 +1,134 @@
+// InputShaper on a payload modelled as a damped spring-mass on the axis:
+// the residual vibration after a move, shaped and unshaped, at the design
+// frequency and off it. The moves are trapezoidal (no jerk limit) so they
+// excite the resonance hard.
+//
+//   pio test -e native -f test_shaper
+
+#include <math.h>
+#include <unity.h>
+#include "motion.h"
+#include "shaper.h"
+
+#define TICK 0.001f  // Seconds per motion update
+#define SUBSTEPS 20  // Model integration steps per tick
+#define FREQUENCY 8.0f  // Payload resonance, Hz
+#define DAMPING 0.05f
+#define MOVE 2000  // Steps
+#define RUN_TIME 3.0  // Seconds simulated per move
+
+// Payload position x following the shaped axis position u through a spring
+struct Payload {
+    double x;
+    double v;
+    double omega;
+    double zeta;
+
+    void step(double u, double du, double dt) {
+        double a = -omega * omega * (x - u) - 2 * zeta * omega * (v - du);
+        v += a * dt;
+        x += v * dt;
+    }
+};
+
+// Largest payload swing about the target once the shaped axis has arrived
+static double residual(ShaperType type, float designFrequency, float actualFrequency) {
+    // About half a resonance period of acceleration, so the move rings
+    MotionAxis axis({ 20000, 300000, 0 });
+    InputShaper shaper;
+    TEST_ASSERT_TRUE(shaper.configure(type, designFrequency, DAMPING, TICK));
+    Payload payload = { 0, 0, 2 * M_PI * actualFrequency, DAMPING };
+
+    axis.moveTo(MOVE);
+    double swing = 0;
+    double stopped = -1;
+    for (double t = 0; t < RUN_TIME; t += TICK) {
+        double before = shaper.position();
+        axis.update(TICK);
+        shaper.update(axis.position(), axis.velocity());
+        for (int i = 0; i < SUBSTEPS; i++) {
+            double f = (i + 1.0) / SUBSTEPS;
+            payload.step(before + (shaper.position() - before) * f, shaper.velocity(), TICK / SUBSTEPS);
+        }
+        if (stopped < 0 && !axis.isMoving()) {
+            stopped = t;
+        }
+        // Swing amplitude, whatever the phase
+        if (stopped >= 0 && t > stopped + shaper.duration()) {
+            swing = fmax(swing, hypot(payload.x - MOVE, payload.v / payload.omega));
+        }
+    }
+    return swing;
+}
+
+void setUp() {
+}
+
+void tearDown() {
+}
+
+void test_unshaped_move_rings() {
+    // Establishes that the test move excites the payload at all
+    TEST_ASSERT_GREATER_THAN_FLOAT(10.0, residual(SHAPER_NONE, FREQUENCY, FREQUENCY));
+}
+
+void test_shapers_cancel_vibration_at_design_frequency() {
+    double unshaped = residual(SHAPER_NONE, FREQUENCY, FREQUENCY);
+    TEST_ASSERT_LESS_THAN_FLOAT(0.05 * unshaped, residual(SHAPER_ZV, FREQUENCY, FREQUENCY));
+    TEST_ASSERT_LESS_THAN_FLOAT(0.05 * unshaped, residual(SHAPER_ZVD, FREQUENCY, FREQUENCY));
+    // EI deliberately leaves up to 5% at the design frequency
+    TEST_ASSERT_LESS_THAN_FLOAT(0.08 * unshaped, residual(SHAPER_EI, FREQUENCY, FREQUENCY));
+}
+
+void test_robust_shapers_tolerate_frequency_error() {
+    // Payload 20% stiffer than calibrated
+    float actual = FREQUENCY * 1.2f;
+    double unshaped = residual(SHAPER_NONE, FREQUENCY, actual);
+    double zv = residual(SHAPER_ZV, FREQUENCY, actual);
+    double zvd = residual(SHAPER_ZVD, FREQUENCY, actual);
+    double ei = residual(SHAPER_EI, FREQUENCY, actual);
+    TEST_ASSERT_LESS_THAN_FLOAT(0.5 * unshaped, zv);
+    TEST_ASSERT_LESS_THAN_FLOAT(zv, zvd);
+    TEST_ASSERT_LESS_THAN_FLOAT(zv, ei);
+    TEST_ASSERT_LESS_THAN_FLOAT(0.15 * unshaped, ei);
+}
+
+void test_shaped_move_ends_on_target() {
+    InputShaper shaper;
+    TEST_ASSERT_TRUE(shaper.configure(SHAPER_ZVD, FREQUENCY, DAMPING, TICK));
+    for (int i = 0; i < 1000; i++) {
+        shaper.update(MOVE, 0);
+    }
+    TEST_ASSERT_FLOAT_WITHIN(1e-3, MOVE, shaper.position());
+    TEST_ASSERT_FLOAT_WITHIN(1e-3, 0, shaper.velocity());
+}
+
+void test_delay_matches_shaper_type() {
+    InputShaper shaper;
+    float halfPeriod = 0.5f / (FREQUENCY * sqrtf(1 - DAMPING * DAMPING));
+    TEST_ASSERT_TRUE(shaper.configure(SHAPER_ZV, FREQUENCY, DAMPING, TICK));
+    TEST_ASSERT_FLOAT_WITHIN(TICK, halfPeriod, shaper.duration());
+    TEST_ASSERT_TRUE(shaper.configure(SHAPER_ZVD, FREQUENCY, DAMPING, TICK));
+    TEST_ASSERT_FLOAT_WITHIN(TICK, 2 * halfPeriod, shaper.duration());
+}
+
+void test_rejects_what_does_not_fit() {
+    InputShaper shaper;
+    // Two half periods of 0.5 Hz are 2 s, beyond SHAPER_HISTORY ticks
+    TEST_ASSERT_FALSE(shaper.configure(SHAPER_ZVD, 0.5f, DAMPING, TICK));
+    TEST_ASSERT_FALSE(shaper.configure(SHAPER_ZV, 0, DAMPING, TICK));
+    TEST_ASSERT_FALSE(shaper.configure(SHAPER_ZV, FREQUENCY, 1.0f, TICK));
+    TEST_ASSERT_TRUE(shaper.configure(SHAPER_NONE, 0, 0, TICK));
+    TEST_ASSERT_EQUAL_INT(SHAPER_NONE, shaper.type());
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_unshaped_move_rings);
+    RUN_TEST(test_shapers_cancel_vibration_at_design_frequency);
+    RUN_TEST(test_robust_shapers_tolerate_frequency_error);
+    RUN_TEST(test_shaped_move_ends_on_target);
+    RUN_TEST(test_delay_matches_shaper_type);
+    RUN_TEST(test_rejects_what_does_not_fit);
+    return UNITY_END();
+}
@@ -0,0 +1,245 @@
+// Vision kernels on synthetic QVGA YUYV frames: a skin-toned face on a
+// shaded background with sensor noise, optionally with a smaller skin patch
+// (a hand) and scattered skin-coloured pixels. The fast kernels must match
+// the scalar ones byte for byte, as the on-device "bench" command checks,
+// and the pipeline must put the target on the face.
+//
+//   pio test -e native -f test_vision
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include <unity.h>
+#include "vision.h"
+
+#define CAPTURE_WIDTH (2 * VISION_WIDTH)
+#define CAPTURE_HEIGHT (2 * VISION_HEIGHT)
+#define CAPTURE_BYTES (CAPTURE_WIDTH * CAPTURE_HEIGHT * 2)
+#define FACE_RADIUS 16  // Capture pixels
+#define NOISE 8  // Peak sensor noise per byte
+#define RANDOM_FRAMES 20
+
+// Skin and background colours, well inside and outside the chroma box
+#define SKIN_Y 160
+#define SKIN_U 100
+#define SKIN_V 150
+#define BACKGROUND_U 128
+#define BACKGROUND_V 115
+
+struct Scene {
+    int faceX;  // Capture pixels; negative for no face
+    int faceY;
+    int handX;  // Top left of a 12x12 skin patch; negative for none
+    int handY;
+    uint8_t faceLuma;
+    uint32_t speckles;  // Isolated skin-coloured pixel pairs
+};
+
+static uint8_t capture[CAPTURE_BYTES];
+static VisionFrame reference;
+static VisionFrame fast;
+static uint8_t referenceMask[VISION_PIXELS];
+static uint8_t fastMask[VISION_PIXELS];
+static uint32_t seed;
+
+static uint32_t random32() {
+    seed = seed * 1664525u + 1013904223u;
+    return seed;
+}
+
+static uint8_t noisy(int value) {
+    value += (int)((random32() >> 16) % (2 * NOISE + 1)) - NOISE;
+    return value < 0 ? 0 : value > 255 ? 255 : value;
+}
+
+static void setPair(int x, int y, int luma, int u, int v) {
+    uint8_t* pair = capture + (y * CAPTURE_WIDTH + (x & ~1)) * 2;
+    pair[0] = noisy(luma);
+    pair[1] = noisy(u);
+    pair[2] = noisy(luma);
+    pair[3] = noisy(v);
+}
+
+static void render(const Scene& scene) {
+    for (int y = 0; y < CAPTURE_HEIGHT; y++) {
+        for (int x = 0; x < CAPTURE_WIDTH; x += 2) {
+            // Chroma is shared per pixel pair, so test the pair's centre
+            float dx = x + 1 - scene.faceX;
+            float dy = y + 0.5f - scene.faceY;
+            bool face = scene.faceX >= 0 && dx * dx + dy * dy <= FACE_RADIUS * FACE_RADIUS;
+            bool hand = scene.handX >= 0 && x >= scene.handX && x < scene.handX + 12 &&
+                        y >= scene.handY && y < scene.handY + 12;
+            if (face || hand) {
+                setPair(x, y, scene.faceLuma, SKIN_U, SKIN_V);
+            } else {
+                setPair(x, y, 60 + x * 140 / CAPTURE_WIDTH, BACKGROUND_U, BACKGROUND_V);
+            }
+        }
+    }
+    for (uint32_t i = 0; i < scene.speckles; i++) {
+        setPair(random32() % CAPTURE_WIDTH, random32() % CAPTURE_HEIGHT, SKIN_Y, SKIN_U, SKIN_V);
+    }
+}
+
+static void randomCapture() {
+    for (int i = 0; i < CAPTURE_BYTES; i++) {
+        capture[i] = random32() >> 24;
+    }
+}
+
+// Both pipelines over the capture; returns the target from the fast one
+static VisionTarget detect() {
+    visionDownscaleScalar(capture, CAPTURE_WIDTH, CAPTURE_HEIGHT, reference);
+    visionDownscaleFast(capture, CAPTURE_WIDTH, CAPTURE_HEIGHT, fast);
+    visionSkinMaskScalar(reference, referenceMask);
+    visionSkinMaskFast(fast, fastMask);
+    VisionTarget referenceTarget;
+    VisionTarget target;
+    visionCentroid(referenceMask, referenceTarget);
+    visionCentroid(fastMask, target);
+    TEST_ASSERT_EQUAL(referenceTarget.found, target.found);
+    TEST_ASSERT_EQUAL_FLOAT(referenceTarget.x, target.x);
+    TEST_ASSERT_EQUAL_FLOAT(referenceTarget.y, target.y);
+    return target;
+}
+
+static void assertFramesMatch() {
+    TEST_ASSERT_EQUAL_MEMORY(reference.y, fast.y, VISION_PIXELS);
+    TEST_ASSERT_EQUAL_MEMORY(reference.u, fast.u, VISION_PIXELS);
+    TEST_ASSERT_EQUAL_MEMORY(reference.v, fast.v, VISION_PIXELS);
+    TEST_ASSERT_EQUAL_MEMORY(referenceMask, fastMask, VISION_PIXELS);
+}
+
+static float normalisedX(int captureX) {
+    return (captureX / 2.0f - VISION_WIDTH / 2) / (VISION_WIDTH / 2);
+}
+
+static float normalisedY(int captureY) {
+    return (captureY / 2.0f - VISION_HEIGHT / 2) / (VISION_HEIGHT / 2);
+}
+
+void setUp() {
+    seed = 1;
+}
+
+void tearDown() {
+}
+
+void test_downscale_averages_two_by_two() {
+    memset(capture, 0, sizeof(capture));
+    // Top left working pixel: Y 10, 21 over 31, 40; U 100 over 103; V 7 over 8
+    uint8_t top[] = { 10, 100, 21, 7 };
+    uint8_t bottom[] = { 31, 103, 40, 8 };
+    memcpy(capture, top, 4);
+    memcpy(capture + CAPTURE_WIDTH * 2, bottom, 4);
+    visionDownscaleScalar(capture, CAPTURE_WIDTH, CAPTURE_HEIGHT, reference);
+    visionDownscaleFast(capture, CAPTURE_WIDTH, CAPTURE_HEIGHT, fast);
+    // Rows are averaged first, each rounding down: (20 + 30) / 2
+    TEST_ASSERT_EQUAL_UINT8(25, reference.y[0]);
+    TEST_ASSERT_EQUAL_UINT8(101, reference.u[0]);
+    TEST_ASSERT_EQUAL_UINT8(7, reference.v[0]);
+    TEST_ASSERT_EQUAL_UINT8(25, fast.y[0]);
+    TEST_ASSERT_EQUAL_UINT8(101, fast.u[0]);
+    TEST_ASSERT_EQUAL_UINT8(7, fast.v[0]);
+}
+
+void test_downscale_ignores_other_sizes() {
+    memset(&reference, 0xAA, sizeof(reference));
+    memset(&fast, 0xAA, sizeof(fast));
+    randomCapture();
+    visionDownscaleScalar(capture, CAPTURE_WIDTH, CAPTURE_HEIGHT / 2, reference);
+    visionDownscaleFast(capture, CAPTURE_WIDTH / 2, CAPTURE_HEIGHT, fast);
+    TEST_ASSERT_EACH_EQUAL_UINT8(0xAA, reference.y, VISION_PIXELS);
+    TEST_ASSERT_EACH_EQUAL_UINT8(0xAA, fast.y, VISION_PIXELS);
+}
+
+void test_fast_kernels_match_on_random_frames() {
+    for (int i = 0; i < RANDOM_FRAMES; i++) {
+        randomCapture();
+        detect();
+        assertFramesMatch();
+    }
+}
+
+void test_fast_kernels_match_on_scenes() {
+    Scene scenes[] = {
+        { 160, 120, -1, -1, SKIN_Y, 0 },
+        { 40, 30, 250, 180, SKIN_Y, 200 },
+        { 300, 220, 20, 20, SKIN_Y, 2000 },
+        { -1, -1, -1, -1, SKIN_Y, 500 },
+    };
+    for (const Scene& scene : scenes) {
+        render(scene);
+        detect();
+        assertFramesMatch();
+    }
+}
+
+// Every value of one channel with the other two inside the box
+void test_mask_thresholds_match_box() {
+    for (int channel = 0; channel < 3; channel++) {
+        for (int i = 0; i < VISION_PIXELS; i++) {
+            uint8_t value = i & 0xFF;
+            reference.y[i] = channel == 0 ? value : SKIN_Y;
+            reference.u[i] = channel == 1 ? value : SKIN_U;
+            reference.v[i] = channel == 2 ? value : SKIN_V;
+        }
+        visionSkinMaskScalar(reference, referenceMask);
+        visionSkinMaskFast(reference, fastMask);
+        TEST_ASSERT_EQUAL_MEMORY(referenceMask, fastMask, VISION_PIXELS);
+        for (int value = 0; value < 256; value++) {
+            bool inside = channel == 0 ? value >= VISION_Y_MIN
+                        : channel == 1 ? value >= VISION_U_MIN && value <= VISION_U_MAX
+                        : value >= VISION_V_MIN && value <= VISION_V_MAX;
+            TEST_ASSERT_EQUAL_UINT8(inside, fastMask[value]);
+        }
+    }
+}
+
+void test_finds_face() {
+    int positions[][2] = { { 160, 120 }, { 60, 50 }, { 250, 190 }, { 100, 170 } };
+    for (auto& position : positions) {
+        render({ position[0], position[1], -1, -1, SKIN_Y, 0 });
+        VisionTarget target = detect();
+        TEST_ASSERT_TRUE(target.found);
+        TEST_ASSERT_FLOAT_WITHIN(0.02f, normalisedX(position[0]), target.x);
+        TEST_ASSERT_FLOAT_WITHIN(0.02f, normalisedY(position[1]), target.y);
+        TEST_ASSERT_GREATER_THAN_FLOAT(0.3f, target.confidence);
+    }
+}
+
+void test_face_wins_over_hand_and_speckles() {
+    render({ 220, 80, 60, 160, SKIN_Y, 300 });
+    VisionTarget target = detect();
+    TEST_ASSERT_TRUE(target.found);
+    TEST_ASSERT_FLOAT_WITHIN(0.05f, normalisedX(220), target.x);
+    TEST_ASSERT_FLOAT_WITHIN(0.05f, normalisedY(80), target.y);
+}
+
+void test_no_face_is_not_found() {
+    render({ -1, -1, -1, -1, SKIN_Y, 300 });
+    VisionTarget target = detect();
+    TEST_ASSERT_FALSE(target.found);
+    TEST_ASSERT_EQUAL_FLOAT(0, target.x);
+    TEST_ASSERT_EQUAL_FLOAT(0, target.y);
+}
+
+void test_dark_face_is_not_found() {
+    // Skin chroma but below the brightness floor
+    render({ 160, 120, -1, -1, VISION_Y_MIN - NOISE - 4, 0 });
+    TEST_ASSERT_FALSE(detect().found);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_downscale_averages_two_by_two);
+    RUN_TEST(test_downscale_ignores_other_sizes);
+    RUN_TEST(test_fast_kernels_match_on_random_frames);
+    RUN_TEST(test_fast_kernels_match_on_scenes);
+    RUN_TEST(test_mask_thresholds_match_box);
+    RUN_TEST(test_finds_face);
+    RUN_TEST(test_face_wins_over_hand_and_speckles);
+    RUN_TEST(test_no_face_is_not_found);
+    RUN_TEST(test_dark_face_is_not_found);
+    return UNITY_END();
+}